@@ -2,9 +2,20 @@
 // Also credit to Southern New Hampshire University
 
 #include <iostream>         // cout, cerr
+#include <algorithm>        // max
+#include <chrono>           // frame and pick timing
+#include <cmath>            // ceil, sqrt
 #include <cstdlib>          // EXIT_FAILURE
-#include <GL/glew.h>        // GLEW library
+#include <cstring>          // memcpy, strcmp, strtok
+#include <random>           // stress scene layout
+#include <vector>
+#include "GLLoader.h"       // GLEW library
+#ifdef BREAKFAST_HEADLESS
+#include "HeadlessContext.h"
+typedef struct GLFWwindow GLFWwindow; // no window in the headless build
+#else
 #include <GLFW/glfw3.h>     // GLFW library
+#endif
 
 // GLM Math Header inclusions
 #include <glm/glm.hpp>
@@ -12,8 +23,22 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Camera.h"
-#include "Cylinder.h"
-#include "Sphere.h"
+#include "CpuProfiler.h"
+#include "DebugOutput.h"
+#include "FrustumCulling.h"
+#include "GBuffer.h"
+#include "GeometryArena.h"
+#include "GeometryCache.h"
+#include "LightClusters.h"
+#include "MeshLod.h"
+#include "RenderQueue.h"
+#include "SceneBvh.h"
+#include "SceneFile.h"
+#include "TextureLoader.h"
+#include "TransformBatch.h"
+#ifdef BREAKFAST_GPU_TIMERS
+#include "GpuTimers.h"
+#endif
 
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -26,6 +51,14 @@ using namespace std; // Standard namespace
 #ifndef GLSL
 #define GLSL(Version, Source) "#version " #Version " core \n" #Source
 #endif
+/*Shader program Macro for shaders that use an extension where the driver has it*/
+#ifndef GLSL_EXT
+#define GLSL_EXT(Version, Extension, Source) "#version " #Version " core \n#extension " #Extension " : enable \n" #Source
+#endif
+/*Shader program Macro for the rest of a shader whose first source carries the version*/
+#ifndef GLSL_BODY
+#define GLSL_BODY(Source) #Source
+#endif
 
 // Unnamed namespace
 namespace
@@ -36,14 +69,6 @@ namespace
     const int WINDOW_WIDTH = 2560;
     const int WINDOW_HEIGHT = 1440;
 
-    // Stores the GL data relative to a given mesh
-    struct GLMesh
-    {
-        GLuint vao[6];         // Handle for the vertex array object
-        GLuint vbos[10];     // Handles for the vertex buffer objects
-        GLuint nIndices;    // Number of indices of the mesh
-    };
-
     // plane structure
     struct plane {
         vector<float> verts;
@@ -57,35 +82,317 @@ namespace
 
     // Main GLFW window
     GLFWwindow* gWindow = nullptr;
-    // Triangle mesh data
-    GLMesh gMesh;
+#ifdef BREAKFAST_HEADLESS
+    // Offscreen context that replaces the window in the benchmark build
+    HeadlessContext gHeadless;
+    // Number of frames the benchmark renders
+    int gBenchmarkFrames = 500;
+    // How far the benchmark camera backs away from its usual spot
+    float gBenchmarkDolly = 0.0f;
+    // Window position the benchmark picks at (--pick X Y), negative to skip picking
+    float gBenchmarkPickX = -1.0f, gBenchmarkPickY = -1.0f;
+    // Extra light counts the benchmark renders with in turn (--light-sweep 0,64,256)
+    vector<int> gBenchmarkLightSweep;
+#endif
+    // Triangle mesh data: every mesh lives in one shared vertex/index buffer
+    GeometryArena gGeometry;
+    // Spheres and cylinders with the same tessellation share one unit mesh
+    GeometryCache gGeometryCache(gGeometry);
+    // Arena handles of the built-in meshes
+    int gPlaneMesh, gCubeMesh;
+    // Level of detail chains of the generated shapes
+    bool gLodEnabled = true;
+    vector<LodChain> gLodChains;
+
+    // Scene description, loaded at startup (--scene path, text or compiled)
+    SceneFile gScene;
+    const char* gScenePath = "resources/scenes/breakfast.scene";
+    // What each primitive of the scene draws with
+    struct PrimitiveMesh
+    {
+        PrimitiveShape shape;   // size of an instance of the unit mesh; scale 1 for plane and cube
+        int mesh;               // handle in gGeometry (the LOD level matching the primitive's own tessellation)
+        int lod;                // chain in gLodChains, -1 when LOD is off and for plane and cube
+        PickShape pickShape;
+    };
+    vector<PrimitiveMesh> gPrimitiveMeshes;
+    // Triangles submitted this frame, all paths
+    unsigned long long gFrameTriangles = 0;
+    // World bounds of every scene object, tested against the frustum each frame
+    bool gCullEnabled = true;
+    CullBounds gCullBounds;
+    vector<unsigned char> gVisible;         // per scene object, 1 when drawn this frame
+    int gFrameVisible = 0;
+    // The same objects in a hierarchy: mouse picking, and culling with --cull bvh
+    SceneBvh gSceneBvh;
+    bool gCullWithBvh = false;
+    // View-projection of the last frame, which clicks are picked against
+    glm::mat4 gViewProjection(1.0f);
     // Texture
-    GLuint gTextureTable, gTextureCup, gTextureTea, gTextureLemon, gTextureOrange, gTextureCloth, gTexturePlate;
+    TextureLoader gTextures;
+    vector<GLuint> gTextureIds;             // per texture of the scene
     glm::vec2 gUVScale(1.0f, 1.0f);
     // Shader program
     GLuint gProgramId;
     //GLuint gProgramId2;
 
+    // Uniform locations, resolved once after the shader program is linked
+    GLint gTransformLoc;
+    GLint gUVScaleLoc;
+    GLint gPositionOffsetLoc;
+    GLint gPositionScaleLoc;
+    GLint gLodFadeLoc;
+    GLint gRadiusScaleLoc;
+    // Position decode, LOD fade and cylinder taper the forward program currently holds
+    VertexDecode gBoundDecode = {};
+    float gBoundLodFade = 1.0f;
+    glm::vec2 gBoundRadiusScale = glm::vec2(1.0f);
+
+    // Uniform block binding points (must match the shaders)
+    const GLuint FRAME_BLOCK_BINDING = 0;
+    const GLuint DRAW_BLOCK_BINDING = 1;
+
+    // Per-frame data, std140 layout of the FrameBlock uniform block
+    struct FrameUniforms
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 viewProjection;   // the only matrix that changes with the camera in the vertex shaders
+        glm::vec4 viewPosition;     // xyz used
+        glm::vec4 clusterScale;     // xy: clusters per pixel, zw: view depth to slice
+        glm::ivec4 clusterGrid;     // xyz used
+    };
+
+    // Per-draw material data, std140 layout of the DrawBlock uniform block
+    struct DrawUniforms
+    {
+        glm::vec3 ambientStrength;
+        GLfloat specularIntensity;  // packs into the vec3's padding
+        GLint multipleTextures;     // std140 bool is 4 bytes
+    };
+
+    // Lighting components of each material of the scene, one slot each in the draw uniform buffer
+    vector<DrawUniforms> gMaterials;
+
+    // Uniform buffer objects for the two blocks
+    GLuint gFrameUbo;
+    GLuint gDrawUbo;
+    GLint gDrawUboStride;   // size of one draw slot rounded up to the offset alignment
+
+    // Model and normal matrices of every scene object, indexed by object in
+    // every vertex shader. Computed and uploaded once, then again only for the
+    // objects that move
+    const GLuint TRANSFORM_STORAGE_BINDING = 5;
+    TransformBatch gTransformBatch;
+    GLuint gTransformBuffer;
+    int gFrameTransformUpdates = 0;         // objects recomputed and uploaded this frame
+    int gSpinningObjects = 0;               // objects turned in place every frame (--spin N)
+
+    // A drawable object of the scene
+    struct SceneObject
+    {
+        const char* name;
+        int mesh;               // handle in gGeometry
+        glm::mat4 model;
+        int material;           // slot in gMaterials
+        GLuint texture;         // texture unit 0
+        GLuint extraTexture;    // texture unit 1 when the material has multiple textures, otherwise 0
+        int textureSet;         // entry in gTextureSets for texture and extraTexture
+        int lod;                // chain in gLodChains, -1 to always draw mesh
+        LodState lodState;
+        GLint instanceMaterial; // entry in the instanced path's material buffer
+        glm::vec2 radiusScale;  // taper of a shared unit cylinder (PrimitiveShape), 1 otherwise
+        PickShape pickShape;    // what mouse picks test against
+#ifdef BREAKFAST_GPU_TIMERS
+        int gpuTimerPass;       // the timer pass of name, looked up once
+#endif
+    };
+    vector<SceneObject> gSceneObjects;
+
+    // Forward path: the visible objects sorted by the state they need
+    // ---------------------------------------------------------------
+    // Textures an object binds on units 0 and 1, shared by every object using both
+    struct TextureSet
+    {
+        GLuint texture;
+        GLuint extraTexture;
+    };
+    vector<TextureSet> gTextureSets;
+    // Index of the forward program and of the arena's vertex array in the sort keys
+    const int FORWARD_PROGRAM_KEY = 0;
+    const int ARENA_VERTEX_ARRAY_KEY = 0;
+    RenderQueue gRenderQueue;
+    // State the forward path set this frame, and the settings it skipped because
+    // the previous draw had already made them
+    int gFrameStateChanges = 0;
+    int gFrameStatesAvoided = 0;
+
+    // How URender submits the scene
+    enum RenderMode
+    {
+        RENDER_FORWARD,     // one draw call per object
+        RENDER_INDIRECT,    // whole scene in one glMultiDrawElementsIndirect
+        RENDER_INSTANCED,   // one glDrawElementsInstancedBaseVertex per distinct mesh
+        RENDER_MODE_COUNT
+    };
+    RenderMode gRenderMode = RENDER_FORWARD;
+
+    // Where the lights are evaluated, whichever way the scene is submitted
+    enum ShadingMode
+    {
+        SHADING_FORWARD,    // in every object's fragment shader, for every fragment drawn
+        SHADING_DEFERRED,   // objects write a G-buffer, then one fullscreen pass lights each pixel once
+        SHADING_MODE_COUNT
+    };
+    ShadingMode gShading = SHADING_FORWARD;
+
+    // Deferred shading path
+    // ----------------------
+    GBuffer gGBuffer;
+    GLuint gDeferredProgramId;
+    GLuint gDeferredVao;                    // no attributes: the fullscreen triangle comes from gl_VertexID
+    GLint gInverseViewProjectionLoc;
+    const GLuint GBUFFER_FIRST_UNIT = 2;    // after the texture set on units 0 and 1
+
+    // Multi-draw indirect path
+    // -------------------------
+    // Layout of one command in the indirect buffer (fixed by OpenGL)
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Per-draw data, std430 layout of the DrawBuffer storage block; indexed by firstDraw + gl_DrawID
+    struct IndirectDrawData
+    {
+        glm::vec3 ambientStrength;
+        GLfloat specularIntensity;  // packs into the vec3's padding
+        GLint multipleTextures;
+        GLfloat lodFade;            // dither mask while the object's LOD blends, 1 otherwise
+        GLint transform;            // entry in the TransformBuffer
+        GLint padding;
+        glm::vec4 positionOffset;   // mesh position decode, xyz used
+        glm::vec4 positionScale;
+        glm::vec4 radiusScale;      // cylinder taper, xy used
+    };
+
+    // Consecutive draws that sample the same texture set: one multi-draw each,
+    // so the samplers never depend on the draw
+    struct IndirectBatch
+    {
+        int textureSet;
+        GLint firstDraw;
+        GLsizei drawCount;
+    };
+
+    // Storage block binding point (must match the indirect vertex shader)
+    const GLuint DRAW_STORAGE_BINDING = 2;
+
+    GLuint gIndirectProgramId;
+    GLuint gIndirectCommandBuffer;
+    GLuint gIndirectDrawBuffer;
+    GLsizei gIndirectDrawCapacity = 0;      // two draws per object, for LOD blends
+    vector<IndirectBatch> gIndirectBatches;
+    bool gIndirectDirty = false;            // LOD changed since the buffers were written
+    unsigned long long gIndirectTriangles = 0;
+    GLint gIndirectFirstDrawLoc;
+
+    // Instanced path
+    // --------------
+    // Per-instance data, std430 layout of the InstanceBuffer storage block;
+    // indexed by firstInstance + gl_InstanceID
+    struct InstanceData
+    {
+        glm::vec2 radiusScale;      // cylinder taper, as in SceneObject
+        GLfloat lodFade;            // dither mask while the object's LOD blends, 1 otherwise
+        GLint material;             // index into the MaterialBuffer
+        GLint transform;            // entry in the TransformBuffer
+        GLint padding;
+    };
+
+    // One material, std430 layout of the MaterialBuffer storage block
+    struct InstanceMaterial
+    {
+        glm::vec3 ambientStrength;
+        GLfloat specularIntensity;
+        GLint multipleTextures;
+        GLint padding[3];
+    };
+
+    // Consecutive instances that draw the same mesh with the same texture set
+    struct InstanceBatch
+    {
+        int textureSet;
+        int mesh;
+        GLint firstInstance;
+        GLsizei instanceCount;
+    };
+
+    // Storage block binding points (must match the instanced shaders)
+    const GLuint INSTANCE_STORAGE_BINDING = 3;
+    const GLuint MATERIAL_STORAGE_BINDING = 4;
+
+    GLuint gInstancedProgramId;
+    GLuint gInstanceBuffer;
+    GLuint gInstanceMaterialBuffer;
+    GLsizei gInstanceCapacity = 0;          // two instances per object, for LOD blends
+    vector<InstanceBatch> gInstanceBatches;
+    bool gInstancesDirty = false;           // LOD changed since the buffer was written
+    unsigned long long gInstancedTriangles = 0;
+    GLint gInstancedFirstLoc;
+    GLint gInstancedOffsetLoc;
+    GLint gInstancedScaleLoc;
+
+    // Deterministic stress scene: copies of the tableware on a grid (--stress N)
+    int gStressSettings = 0;
+    const float STRESS_SPACING = 8.0f;      // between place settings, world units
+
+    // GL debug output (--gl-debug off|async|sync); release builds default to a context without it
+#ifdef NDEBUG
+    DebugOutputMode gDebugOutputMode = DEBUG_OUTPUT_OFF;
+#else
+    DebugOutputMode gDebugOutputMode = DEBUG_OUTPUT_ASYNC;
+#endif
+    DebugOutput gDebugOutput;
+
+    // Chrome trace written at exit when --trace is given
+    const char* gTracePath = nullptr;
+
+    // GPU pass timing: compiled out unless BREAKFAST_GPU_TIMERS is defined
+#ifdef BREAKFAST_GPU_TIMERS
+    GpuTimers gGpuTimers;
+    const char* gGpuTimersCsv = "gpu_timers.csv";
+#define GPU_TIMER_FRAME() gGpuTimers.beginFrame()
+#define GPU_TIMER_BEGIN(name) gGpuTimers.begin(name)
+#define GPU_TIMER_BEGIN_PASS(pass) gGpuTimers.begin(pass)
+#define GPU_TIMER_END() gGpuTimers.end()
+#else
+#define GPU_TIMER_FRAME() ((void)0)
+#define GPU_TIMER_BEGIN(name) ((void)0)
+#define GPU_TIMER_BEGIN_PASS(pass) ((void)0)
+#define GPU_TIMER_END() ((void)0)
+#endif
+
     // camera
     // constructor format: Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH)
     Camera gCamera(glm::vec3(-4.0f, 6.0f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f), -70.0, -60.0);
+#ifndef BREAKFAST_HEADLESS
+    // mouse and keyboard state of the window
     float gLastX = WINDOW_WIDTH / 2.0f;
     float gLastY = WINDOW_HEIGHT / 2.0f;
     bool gFirstMouse = true;
     float addedSpeed = 0.05f;
+#endif
 
     // timing
     float gDeltaTime = 0.0f; // time between current frame and last frame
+#ifndef BREAKFAST_HEADLESS
     float gLastFrame = 0.0f;
-
-    // cylinders
-    Cylinder cylinder1(1.0f, 1.5f, 2.0f, 25, 8, true);
-    Cylinder cylinder2(1.35f, 1.35f, 0.1f, 25, 8, true);
-    Cylinder cylinder3(1.4f, 1.9, 0.25f, 25, 8, true);
-
-    // sphere
-    //Sphere::Sphere(float radius, int sectors, int stacks, bool smooth)
-    Sphere sphere1(0.9, 36, 18, true);
+#endif
 
     // plane
     plane plane1 = {};
@@ -97,22 +404,21 @@ namespace
     glm::mat4 projection;
     bool select_ortho = false;
 
-    // lighting global variables
+    // lighting global variables: every light of the scene in a storage buffer,
+    // listed per froxel cluster each frame
     //--------------------------
-    // light 1
-    glm::vec3 gLightPosition1(3.0f, 5.0f, -5.0f);
-    glm::vec3 gLightColor1(1.0f, 1.0f, 1.0f);
-    GLfloat light_1_strength = 1.0f;
-    // light 2
-    glm::vec3 gLightPosition2(-4.0f, 3.0f, 3.0f);
-    glm::vec3 gLightColor2(0.5f, 0.5f, 1.0f);
-    GLfloat light_2_strength = 1.0f;
+    const GLuint LIGHT_STORAGE_BINDING = 6;
+    const GLuint CLUSTER_STORAGE_BINDING = 7;
+    LightClusters gLightClusters;
+    GLuint gLightBuffer;
+    GLuint gClusterBuffer;
+    int gExtraLights = 0;                   // seeded small lights added to the scene's (--lights N)
+    double gFrameClusterMs = 0.0;           // CPU time of this frame's light assignment
+    // size of the default framebuffer, which the cluster tiles divide
+    int gViewportWidth = WINDOW_WIDTH;
+    int gViewportHeight = WINDOW_HEIGHT;
     // base object color
     //glm::vec3 gObjectColor(1.f, 0.2f, 0.0f);
-    // light components
-    glm::vec3 gAmbientStrength(glm::vec3(0.1f));
-    glm::vec3 gDiffuseStrength(glm::vec3(1.0f));
-    float gSpecularIntensity = 0.6f;
 
 }
 
@@ -122,35 +428,73 @@ namespace
  * and render graphics on the screen
  */
 bool UInitialize(int, char* [], GLFWwindow** window);
+#ifndef BREAKFAST_HEADLESS
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
-void setupCupBuffers(GLMesh& mesh);
-void setupPlaneBuffers(GLMesh& mesh);
-void setupHandleBuffers(GLMesh& mesh);
-void setupTeaBuffers(GLMesh& mesh);
-void setupSphereBuffers(GLMesh& mesh);
-void setupPlateBuffers(GLMesh& mesh);
+#else
+void URunBenchmark(int frames);
+void URunLightSweep(int frames);
+#endif
+void UCreateMeshes();
 void createPlaneMesh();
 void createCubeMesh();
-void UDestroyMesh(GLMesh& mesh);
+void UDestroyMesh(GeometryArena& geometry);
 void URender();
-bool UCreateTexture(const char* filename, GLuint& textureId, int textureUnit);
 void UDestroyTexture(GLuint textureId);
-void flipImageVertically(unsigned char* image, int width, int height, int channels);
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId, const char* fragShaderPrefix = NULL, const char* vtxShaderPrefix = NULL);
 void UDestroyShaderProgram(GLuint programId);
-
-// for debugging
-void APIENTRY glDebugOutput(GLenum source, GLenum type, unsigned int id, GLenum severity,
-    GLsizei length, const char* message, const void* userParam);
-
-
-/* Cube Vertex Shader Source Code*/
-const GLchar* vertexShaderSource = GLSL(440,
+void UGetUniformLocations(GLuint programId);
+void UCreateUniformBuffers();
+void UUpdateFrameUniforms(const glm::mat4& view, const glm::mat4& projection);
+void UBindDrawUniforms(int slot);
+void USetPositionDecode(const VertexDecode& decode);
+void USetLodFade(float fade);
+void USetRadiusScale(const glm::vec2& radiusScale);
+bool UUpdateLods(const glm::mat4& view, const glm::mat4& projection);
+int UGetObjectDraws(const SceneObject& object, int meshes[2], float fades[2]);
+void UDestroyUniformBuffers();
+bool ULoadScene(const char* path);
+void UCreateSceneObjects();
+void UAddSceneObject(const char* name, int mesh, const glm::mat4& model, int material, GLuint texture, GLuint extraTexture = 0);
+void UCreateStressScene(int settings);
+void UCreateCullBounds();
+void UCreateTransforms();
+void UUpdateTransforms();
+void UMoveObject(int index, const glm::mat4& model);
+void USpinObjects(float deltaTime);
+void UDestroyTransforms();
+void UCreateLights(int extra);
+void UAssignLights(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+void UDestroyLights();
+bool UCullObjects(const glm::mat4& viewProjection);
+int UPickObject(float x, float y, float width, float height);
+bool UCreateIndirectDraws();
+void UWriteIndirectDraws();
+void URenderIndirect();
+void UDestroyIndirectDraws();
+bool UCreateInstancedDraws();
+void UWriteInstances();
+void URenderInstanced();
+void UDestroyInstancedDraws();
+void URenderForward(const glm::mat4& view);
+void UBindTextureSet(int textureSet);
+bool UCreateDeferredShading();
+void USetShading(ShadingMode shading);
+bool UBeginGeometryPass();
+void URenderDeferredLighting(const glm::mat4& viewProjection);
+void UDestroyDeferredShading();
+
+
+/* Vertex Shader Prefix Source Code*/
+// The first source of every object vertex shader: the vertex attributes and
+// outputs, the frame block, the cached transforms and the normal decode. The
+// draw parameters extension is only used by the indirect vertex shader, which
+// is only compiled when the driver has it
+const GLchar* vertexShaderPrefix = GLSL_EXT(440, GL_ARB_shader_draw_parameters,
 
     layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
 layout(location = 1) in vec3 normal; // VAP position 1 for normals
@@ -160,51 +504,220 @@ out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate;
 
-//Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Written once per frame (binding 0)
+layout(std140, binding = 0) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 viewPosition;
+    vec4 clusterScale;      // xy: clusters per pixel; the slice of a view depth is int(log(depth) * z + w)
+    ivec4 clusterGrid;      // clusters along x, y and z
+};
+
+// Cached transforms of every object (binding 5)
+struct ObjectTransform
+{
+    mat4 model;
+    mat3 normalMatrix;
+};
+layout(std430, binding = 5) readonly buffer TransformBuffer
+{
+    ObjectTransform transforms[];
+};
+
+// Normals arrive as 2 octahedral components instead of xyz
+uniform bool octahedralNormals;
+
+vec3 decodeNormal(vec3 stored)
+{
+    if (!octahedralNormals)
+        return stored;
+    vec3 n = vec3(stored.xy, 1.0 - abs(stored.x) - abs(stored.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+);
+
+
+
+/* Cube Vertex Shader Source Code*/
+// compiled after vertexShaderPrefix
+const GLchar* vertexShaderSource = GLSL_BODY(
+
+// Entry of the object being drawn
+uniform int transform;
+
+// Position decode of the mesh being drawn: identity for float vertices,
+// the mesh bounds for quantized ones
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+// Base and top radius of a shared unit cylinder (z from -0.5 to 0.5); (1, 1) leaves any mesh alone
+uniform vec2 radiusScale;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    vec3 localPosition = positionOffset + positionScale * position;
+    vec3 localNormal = decodeNormal(normal);
+
+    // taper: the side leans by the radius difference, the caps keep their normals
+    localPosition.xy *= mix(radiusScale.x, radiusScale.y, localPosition.z + 0.5);
+    localNormal.z += (radiusScale.x - radiusScale.y) * length(localNormal.xy);
 
-    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+    vec4 worldPosition = transforms[transform].model * vec4(localPosition, 1.0f);
+    gl_Position = viewProjection * worldPosition; // Transforms vertices into clip coordinates
 
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexFragmentPos = vec3(worldPosition); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = transforms[transform].normalMatrix * localNormal; // get normal vectors in world space only, inverse transpose computed on the CPU
     vertexTextureCoordinate = textureCoordinate;
 }
 );
 
 
 
+/* Lighting Shader Source Code*/
+// The first source of every fragment shader that lights a surface: the frame
+// block, the lights and their clusters, the Phong loop over them and the LOD
+// dither mask of the object fragment shaders
+const GLchar* lightingShaderSource = GLSL(440,
+
+// Camera and light cluster grid: written once per frame (binding 0)
+layout(std140, binding = 0) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 viewPosition;
+    vec4 clusterScale;      // xy: clusters per pixel; the slice of a view depth is int(log(depth) * z + w)
+    ivec4 clusterGrid;      // clusters along x, y and z
+};
+
+// Every light of the scene (binding 6)
+struct PointLight
+{
+    vec4 positionRange;     // range 0 reaches everywhere with no falloff
+    vec4 colorStrength;
+};
+layout(std430, binding = 6) readonly buffer LightBuffer
+{
+    PointLight lights[];
+};
+// Start and length of each cluster's light list, then the lists (binding 7)
+layout(std430, binding = 7) readonly buffer ClusterBuffer
+{
+    uint clusterData[];
+};
+
+// Froxel of this fragment: its screen tile and the depth slice of its view depth
+uint clusterOf(vec3 worldPosition)
+{
+    float depth = max(-(view * vec4(worldPosition, 1.0)).z, 1e-6);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterScale.xy), clusterGrid.xy - 1);
+    int slice = clamp(int(log(depth) * clusterScale.z + clusterScale.w), 0, clusterGrid.z - 1);
+    return uint((slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x);
+}
+
+// Phong lighting of a surface by every light that reaches its cluster,
+// times the surface color
+vec3 shadeSurface(vec3 position, vec3 norm, vec3 surfaceColor, vec3 ambientStrength, float specularIntensity)
+{
+    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+
+    float highlightSize = 16.0f; // Set specular highlight size
+    vec3 viewDir = normalize(viewPosition - position); // Calculate view direction
+    vec3 ambient = vec3(0.0);
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+
+    // EVERY LIGHT THAT REACHES THIS FRAGMENT'S CLUSTER:
+    //--------------------------------------------------
+    uint cluster = clusterOf(position);
+    uint first = clusterData[2u * cluster];
+    uint end = first + clusterData[2u * cluster + 1u];
+    for (uint i = first; i < end; ++i)
+    {
+        PointLight light = lights[clusterData[i]];
+        vec3 toLight = light.positionRange.xyz - position;
+        float lightDistance = length(toLight);
+
+        // lights with a range fade out smoothly by its end, so no cluster edge shows
+        vec3 lightColor = light.colorStrength.w * light.colorStrength.rgb;
+        if (light.positionRange.w > 0.0) {
+            float ratio = lightDistance / light.positionRange.w;
+            ratio *= ratio;
+            float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+            lightColor *= window * window / (1.0 + lightDistance * lightDistance);
+        }
+
+        //Calculate Ambient lighting*/
+        ambient += ambientStrength * lightColor; // Generate ambient light color
+
+        //Calculate Diffuse lighting*/
+        vec3 lightDirection = toLight / lightDistance; // Calculate distance (light direction) between light source and fragments/pixels on cube
+        float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
+        diffuse += impact * lightColor; // Generate diffuse light color
+
+        //Calculate Specular lighting*/
+        vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+        //Calculate specular component
+        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+        specular += specularIntensity * specularComponent * lightColor;
+    }
+
+    // CALCULATE PHONG RESULT
+    //-----------------------
+    return (ambient + diffuse + specular) * surfaceColor;
+}
+
+// While an object switches LOD levels both are drawn with complementary
+// ordered-dither masks: the incoming level keeps the fragments below
+// fade (0 to 1), the outgoing one those above fade + 1 (fade in -1 to 0)
+bool lodHidden(float fade)
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 cell = ivec2(gl_FragCoord.xy) & 3;
+    float threshold = (bayer[cell.y * 4 + cell.x] + 0.5) / 16.0;
+    return fade >= 0.0 ? threshold >= fade : threshold < fade + 1.0;
+}
+);
+
+
 /* Cube Fragment Shader Source Code*/
-const GLchar* fragmentShaderSource = GLSL(440,
+// compiled after lightingShaderSource
+const GLchar* fragmentShaderSource = GLSL_BODY(
 
     in vec3 vertexNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate;
 
-out vec4 fragmentColor; // For outgoing cube color to the GPU
-
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec3 lightPos1;
-uniform vec3 lightColor1;
-uniform float light_1_strength;
-uniform vec3 lightPos2;
-uniform vec3 lightColor2;
-uniform float light_2_strength;
-uniform vec3 ambientStrength;
-uniform float specularIntensity;
-uniform vec3 viewPosition;
+layout(location = 0) out vec4 fragmentColor; // For outgoing cube color to the GPU, or the albedo in the geometry pass
+// Deferred shading: the surface goes to the G-buffer and is lit afterwards, once per pixel
+layout(location = 1) out vec4 surfaceNormal;
+layout(location = 2) out vec4 surfaceMaterial;
+uniform bool geometryPass;
+
+// Material of the object being drawn (binding 1)
+layout(std140, binding = 1) uniform DrawBlock
+{
+    vec3 ambientStrength;
+    float specularIntensity;
+    bool multipleTextures;
+};
+
 uniform sampler2D uTexture; // Useful when working with multiple textures
 uniform sampler2D uTextureExtra;
-uniform bool multipleTextures;
 uniform vec2 uvScale;
 //uniform vec3 objectColor;
+// LOD blend: 1 draws every fragment
+uniform float lodFade;
 
 void main()
 {
+    if (lodHidden(lodFade))
+        discard;
+
     // Texture holds the color to be used for all three components of Phong lighting model
     vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
     // if there is a second image
@@ -217,47 +730,16 @@ void main()
         }
     }
 
-    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
-
-    // FIRST LIGHT:
-    //-------------
-    //Calculate Ambient lighting*/
-    vec3 ambient = ambientStrength * lightColor1; // Generate ambient light color
-
-    //Calculate Diffuse lighting*/
-    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 lightDirection = normalize(lightPos1 - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 diffuse = impact * lightColor1; // Generate diffuse light color
-
-    //Calculate Specular lighting*/
-    float highlightSize = 16.0f; // Set specular highlight size
-    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-    //Calculate specular component
-    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    vec3 specular = specularIntensity * specularComponent * lightColor1;
-
-    // SECOND LIGHT:
-    //--------------
-    // ambient lighting - add first and second light ambient numbers
-    ambient += light_2_strength * (ambientStrength * lightColor2);
-
-    // diffuse lighting
-    lightDirection = normalize(lightPos2 - vertexFragmentPos);
-    impact = max(dot(norm, lightDirection), 0.0);
-    // add first and second light diffuses
-    diffuse += light_2_strength * (impact * lightColor2);
-
-    // specular lighting
-    reflectDir = reflect(-lightDirection, norm);
-    specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    // add first and second light speculars
-    specular += light_2_strength * (specularIntensity * specularComponent * lightColor2);
+    if (geometryPass) {
+        fragmentColor = vec4(textureColor.rgb, 1.0);
+        surfaceNormal = vec4(normalize(vertexNormal), 0.0);
+        surfaceMaterial = vec4(ambientStrength, specularIntensity);
+        return;
+    }
 
-    // CALCULATE PHONG RESULT
-    //-----------------------
-    vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
+    // PHONG LIGHTING BY EVERY LIGHT OF THIS FRAGMENT'S CLUSTER
+    //--------------------------------------------------------
+    vec3 phong = shadeSurface(vertexFragmentPos, normalize(vertexNormal), textureColor.xyz, ambientStrength, specularIntensity);
 
     fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
 }
@@ -266,225 +748,855 @@ void main()
 
 
 
-/* ------------------- MAIN -------------------*/
-int main(int argc, char* argv[])
+/* Multi-draw indirect Vertex Shader Source Code*/
+// model matrix and material come from the per-draw storage buffer, indexed by
+// firstDraw + gl_DrawIDARB; compiled after vertexShaderPrefix
+const GLchar* indirectVertexShaderSource = GLSL_BODY(
+
+flat out int drawId; // For looking up the material in the fragment shader
+
+// One entry per draw command (binding 2)
+struct DrawData
 {
-    if (!UInitialize(argc, argv, &gWindow))
-        return EXIT_FAILURE;
+    vec3 ambientStrength;
+    float specularIntensity;
+    int multipleTextures;
+    float lodFade;
+    int transform;
+    vec4 positionOffset;
+    vec4 positionScale;
+    vec4 radiusScale;
+};
+layout(std430, binding = 2) readonly buffer DrawBuffer
+{
+    DrawData draws[];
+};
 
-    // Create the shader program
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
-        return EXIT_FAILURE;
+// Entry of this multi-draw's first command; gl_DrawIDARB counts from it
+uniform int firstDraw;
 
-    // Load table texture
-    const char* texFilename1 = "resources/textures/wood.jpg";
-    if (!UCreateTexture(texFilename1, gTextureTable, 0))
-    {
-        cout << "Failed to load texture " << texFilename1 << endl;
-        return EXIT_FAILURE;
-    }
-    else {
-        cout << "Successfully loaded texture " << texFilename1 << endl;
-    }
+void main()
+{
+    int draw = firstDraw + gl_DrawIDARB;
+    int transform = draws[draw].transform;
+    vec3 localPosition = draws[draw].positionOffset.xyz + draws[draw].positionScale.xyz * position;
+    vec3 localNormal = decodeNormal(normal);
 
-    // Load mug texture
-    const char* texFilename2 = "resources/textures/marble.jpg";
-    if (!UCreateTexture(texFilename2, gTextureCup, 0))
-    {
-        cout << "Failed to load texture " << texFilename2 << endl;
-        return EXIT_FAILURE;
-    }
-    else {
-        cout << "Successfully loaded texture " << texFilename2 << endl;
-    }
+    // shared unit cylinders are tapered per draw, as in the forward vertex shader
+    vec2 radiusScale = draws[draw].radiusScale.xy;
+    localPosition.xy *= mix(radiusScale.x, radiusScale.y, localPosition.z + 0.5);
+    localNormal.z += (radiusScale.x - radiusScale.y) * length(localNormal.xy);
 
-    // Load tea texture
-    const char* texFilename3 = "resources/textures/tea.png";
-    if (!UCreateTexture(texFilename3, gTextureTea, 0))
-    {
-        cout << "Failed to load texture " << texFilename3 << endl;
-        return EXIT_FAILURE;
-    }
-    else {
-        cout << "Successfully loaded texture " << texFilename3 << endl;
-    }
+    vec4 worldPosition = transforms[transform].model * vec4(localPosition, 1.0f);
+    gl_Position = viewProjection * worldPosition; // Transforms vertices into clip coordinates
 
-    // Load lemon texture
-    const char* texFilename4 = "resources/textures/lemon.png";
-    // use unit GL_TEXTURE1 instead of GL_TEXTURE0, so I can use two textures on one object
-    if (!UCreateTexture(texFilename4, gTextureLemon, 1))
-    {
-        cout << "Failed to load texture " << texFilename3 << endl;
-        return EXIT_FAILURE;
-    }
-    else {
-        cout << "Successfully loaded texture " << texFilename4 << endl;
-    }
+    vertexFragmentPos = vec3(worldPosition); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-    // Load orange texture
-    const char* texFilename5 = "resources/textures/orange.jpg";
-    if (!UCreateTexture(texFilename5, gTextureOrange, 0))
-    {
-        cout << "Failed to load texture " << texFilename5 << endl;
-        return EXIT_FAILURE;
-    }
-    else {
-        cout << "Successfully loaded texture " << texFilename5 << endl;
-    }
+    vertexNormal = transforms[transform].normalMatrix * localNormal; // get normal vectors in world space only, inverse transpose computed on the CPU
+    vertexTextureCoordinate = textureCoordinate;
+    drawId = draw;
+}
+);
 
-    // Load cloth texture
-    const char* texFilename6 = "resources/textures/knit.jpg";
-    if (!UCreateTexture(texFilename6, gTextureCloth, 0))
-    {
-        cout << "Failed to load texture " << texFilename6 << endl;
-        return EXIT_FAILURE;
-    }
-    else {
-        cout << "Successfully loaded texture " << texFilename6 << endl;
-    }
 
-    // Load plate texture
-    const char* texFilename7 = "resources/textures/plate.png";
-    if (!UCreateTexture(texFilename7, gTexturePlate, 0))
-    {
-        cout << "Failed to load texture " << texFilename7 << endl;
-        return EXIT_FAILURE;
-    }
-    else {
-        cout << "Successfully loaded texture " << texFilename7 << endl;
-    }
 
+/* Multi-draw indirect Fragment Shader Source Code*/
+// compiled after lightingShaderSource
+const GLchar* indirectFragmentShaderSource = GLSL_BODY(
 
+    in vec3 vertexNormal; // For incoming normals
+in vec3 vertexFragmentPos; // For incoming fragment position
+in vec2 vertexTextureCoordinate;
+flat in int drawId; // Same for every fragment of a draw
 
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
-    // We set the texture as texture unit 1
-    glUniform1i(glGetUniformLocation(gProgramId, "uTextureExtra"), 1);
+layout(location = 0) out vec4 fragmentColor; // For outgoing cube color to the GPU, or the albedo in the geometry pass
+// Deferred shading: the surface goes to the G-buffer and is lit afterwards, once per pixel
+layout(location = 1) out vec4 surfaceNormal;
+layout(location = 2) out vec4 surfaceMaterial;
+uniform bool geometryPass;
 
+// One entry per draw command (binding 2)
+struct DrawData
+{
+    vec3 ambientStrength;
+    float specularIntensity;
+    int multipleTextures;
+    float lodFade;
+    int transform;
+    vec4 positionOffset;
+    vec4 positionScale;
+    vec4 radiusScale;
+};
+layout(std430, binding = 2) readonly buffer DrawBuffer
+{
+    DrawData draws[];
+};
 
-    // Sets the background color of the window to black (it will be implicitely used by glClear)
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+// the texture set of the current multi-draw, on units 0 and 1 as in the forward path
+uniform sampler2D uTexture;
+uniform sampler2D uTextureExtra;
+uniform vec2 uvScale;
 
-    // render loop
-    // one iteration of this loop is one frame. 60FPS means this loop repeats 60 times per second
-    // -----------
-    while (!glfwWindowShouldClose(gWindow))
-    {
-        // per-frame timing
-        // --------------------
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
-        gLastFrame = currentFrame;
+void main()
+{
+    DrawData draw = draws[drawId];
+    if (lodHidden(draw.lodFade))
+        discard;
 
-        // input
-        // -----
-        UProcessInput(gWindow);
+    vec3 ambientStrength = draw.ambientStrength;
+    float specularIntensity = draw.specularIntensity;
 
-        // Render this frame
-        URender();
+    // Texture holds the color to be used for all three components of Phong lighting model
+    vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+    // if there is a second image
+    if (draw.multipleTextures != 0) {
+        // find the color of the second texture based on this fragment's tex coord 
+        vec4 extraTexture = texture(uTextureExtra, vertexTextureCoordinate);
+        // if this location is not fully transparent, use its color
+        if (extraTexture.a != 0.0) {
+            textureColor = extraTexture;
+        }
+    }
 
-        glfwPollEvents();
+    if (geometryPass) {
+        fragmentColor = vec4(textureColor.rgb, 1.0);
+        surfaceNormal = vec4(normalize(vertexNormal), 0.0);
+        surfaceMaterial = vec4(ambientStrength, specularIntensity);
+        return;
     }
 
-    // Release mesh data
-    UDestroyMesh(gMesh);
+    // PHONG LIGHTING BY EVERY LIGHT OF THIS FRAGMENT'S CLUSTER
+    //--------------------------------------------------------
+    vec3 phong = shadeSurface(vertexFragmentPos, normalize(vertexNormal), textureColor.xyz, ambientStrength, specularIntensity);
 
-    // Release textures
-    UDestroyTexture(gTextureTable);
-    UDestroyTexture(gTextureCup);
-    UDestroyTexture(gTextureTea);
-    UDestroyTexture(gTextureLemon);
-    UDestroyTexture(gTextureOrange);
-    UDestroyTexture(gTextureCloth);
-    UDestroyTexture(gTexturePlate);
+    fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+}
+);
 
-    // Release shader programs
-    UDestroyShaderProgram(gProgramId);
 
-    exit(EXIT_SUCCESS); // Terminates the program successfully
-}
+/* Instanced Vertex Shader Source Code*/
+// model matrix and material index come from the per-instance storage buffer, indexed by
+// firstInstance + gl_InstanceID; every instance of a draw shares one mesh.
+// Compiled after vertexShaderPrefix
+const GLchar* instancedVertexShaderSource = GLSL_BODY(
 
+flat out int material; // For looking up the material in the fragment shader
+flat out float lodFade;
 
-/* ------------------- Initialize GLFW, GLEW, window, and everything else -------------------*/
-bool UInitialize(int argc, char* argv[], GLFWwindow** window)
+// One entry per instance (binding 3)
+struct InstanceData
 {
-    // GLFW: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    // for debugging
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+    vec2 radiusScale;
+    float lodFade;
+    int material;
+    int transform;
+};
+layout(std430, binding = 3) readonly buffer InstanceBuffer
+{
+    InstanceData instances[];
+};
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+// First instance of this draw in the buffer
+uniform int firstInstance;
+// Position decode of the mesh being drawn, as in the forward vertex shader
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
-    // GLFW: window creation
-    // ---------------------
-    * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
-    if (*window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return false;
-    }
-    glfwMakeContextCurrent(*window);
-    glfwSetFramebufferSizeCallback(*window, UResizeWindow);
-    glfwSetCursorPosCallback(*window, UMousePositionCallback);
-    glfwSetScrollCallback(*window, UMouseScrollCallback);
-    glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
-    glfwSetKeyCallback(*window, key_callback);
+void main()
+{
+    InstanceData instance = instances[firstInstance + gl_InstanceID];
+    int transform = instance.transform;
+    vec3 localPosition = positionOffset + positionScale * position;
+    vec3 localNormal = decodeNormal(normal);
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // shared unit cylinders are tapered per instance, as in the forward vertex shader
+    localPosition.xy *= mix(instance.radiusScale.x, instance.radiusScale.y, localPosition.z + 0.5);
+    localNormal.z += (instance.radiusScale.x - instance.radiusScale.y) * length(localNormal.xy);
 
-    // GLEW: initialize
-    // ----------------
-    // Note: if using GLEW version 1.13 or earlier
-    glewExperimental = GL_TRUE;
-    GLenum GlewInitResult = glewInit();
+    vec4 worldPosition = transforms[transform].model * vec4(localPosition, 1.0f);
+    gl_Position = viewProjection * worldPosition; // Transforms vertices into clip coordinates
 
-    if (GLEW_OK != GlewInitResult)
-    {
-        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
-        return false;
-    }
+    vertexFragmentPos = vec3(worldPosition); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-    // Displays GPU OpenGL version
-    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
+    vertexNormal = transforms[transform].normalMatrix * localNormal; // get normal vectors in world space only, inverse transpose computed on the CPU
+    vertexTextureCoordinate = textureCoordinate;
+    material = instance.material;
+    lodFade = instance.lodFade;
+}
+);
 
-    // create the plane mesh
-    createPlaneMesh();
-    // create cube mesh
-    createCubeMesh();
 
-    // generate all the vertex arrays
-    glGenVertexArrays(6, gMesh.vao);
 
-    // Create all the buffers: 2 for each mesh: first one for the vertex data, second one for the indices
-    glGenBuffers(10, gMesh.vbos);
+/* Instanced Fragment Shader Source Code*/
+// compiled after lightingShaderSource
+const GLchar* instancedFragmentShaderSource = GLSL_BODY(
 
-    // set up all the GPU buffer objects
-    setupCupBuffers(gMesh);
-    setupPlaneBuffers(gMesh);
-    setupHandleBuffers(gMesh);
-    setupTeaBuffers(gMesh);
-    setupSphereBuffers(gMesh);
-    setupPlateBuffers(gMesh);
+    in vec3 vertexNormal; // For incoming normals
+in vec3 vertexFragmentPos; // For incoming fragment position
+in vec2 vertexTextureCoordinate;
+flat in int material; // Same for every fragment of an instance
+flat in float lodFade;
+
+layout(location = 0) out vec4 fragmentColor; // For outgoing cube color to the GPU, or the albedo in the geometry pass
+// Deferred shading: the surface goes to the G-buffer and is lit afterwards, once per pixel
+layout(location = 1) out vec4 surfaceNormal;
+layout(location = 2) out vec4 surfaceMaterial;
+uniform bool geometryPass;
+
+// One entry per material (binding 4)
+struct MaterialData
+{
+    vec3 ambientStrength;
+    float specularIntensity;
+    int multipleTextures;
+};
+layout(std430, binding = 4) readonly buffer MaterialBuffer
+{
+    MaterialData materials[];
+};
+
+// the texture set of the current draw, on units 0 and 1 as in the forward path
+uniform sampler2D uTexture;
+uniform sampler2D uTextureExtra;
+uniform vec2 uvScale;
+
+void main()
+{
+    MaterialData draw = materials[material];
+    if (lodHidden(lodFade))
+        discard;
+
+    vec3 ambientStrength = draw.ambientStrength;
+    float specularIntensity = draw.specularIntensity;
+
+    // Texture holds the color to be used for all three components of Phong lighting model
+    vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+    // if there is a second image
+    if (draw.multipleTextures != 0) {
+        // find the color of the second texture based on this fragment's tex coord 
+        vec4 extraTexture = texture(uTextureExtra, vertexTextureCoordinate);
+        // if this location is not fully transparent, use its color
+        if (extraTexture.a != 0.0) {
+            textureColor = extraTexture;
+        }
+    }
+
+    if (geometryPass) {
+        fragmentColor = vec4(textureColor.rgb, 1.0);
+        surfaceNormal = vec4(normalize(vertexNormal), 0.0);
+        surfaceMaterial = vec4(ambientStrength, specularIntensity);
+        return;
+    }
+
+    // PHONG LIGHTING BY EVERY LIGHT OF THIS FRAGMENT'S CLUSTER
+    //--------------------------------------------------------
+    vec3 phong = shadeSurface(vertexFragmentPos, normalize(vertexNormal), textureColor.xyz, ambientStrength, specularIntensity);
+
+    fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+}
+);
+
+
+
+/* Deferred Lighting Vertex Shader Source Code*/
+// one triangle that covers the whole screen, from gl_VertexID alone
+const GLchar* deferredVertexShaderSource = GLSL(440,
+
+    void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+);
+
+
+/* Deferred Lighting Fragment Shader Source Code*/
+// Phong lighting of the G-buffer's surface at every pixel, with the lights of its
+// cluster, as in the object fragment shaders; compiled after lightingShaderSource
+const GLchar* deferredFragmentShaderSource = GLSL_BODY(
+
+    out vec4 fragmentColor; // For outgoing pixel color to the GPU
+
+// What the geometry pass wrote, in GBufferTarget order
+uniform sampler2D gbufferAlbedo;
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferMaterial;
+uniform sampler2D gbufferDepth;
+// Clip space back to world space
+uniform mat4 inverseViewProjection;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbufferDepth, pixel, 0).r;
+    // no surface: keep the clear color
+    if (depth == 1.0)
+        discard;
+
+    // world position of the surface from its depth and its place in the G-buffer
+    vec2 screen = gl_FragCoord.xy / vec2(textureSize(gbufferDepth, 0));
+    vec4 world = inverseViewProjection * vec4(screen * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec3 vertexFragmentPos = world.xyz / world.w;
+
+    vec3 textureColor = texelFetch(gbufferAlbedo, pixel, 0).rgb;
+    vec4 material = texelFetch(gbufferMaterial, pixel, 0);
+    vec3 ambientStrength = material.rgb;
+    float specularIntensity = material.a;
+
+    // PHONG LIGHTING BY EVERY LIGHT OF THIS PIXEL'S CLUSTER
+    //-----------------------------------------------------
+    vec3 norm = texelFetch(gbufferNormal, pixel, 0).xyz;
+    vec3 phong = shadeSurface(vertexFragmentPos, norm, textureColor, ambientStrength, specularIntensity);
+
+    fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+}
+);
+
+
+
+
+/* ------------------- MAIN -------------------*/
+int main(int argc, char* argv[])
+{
+    CpuProfiler::setThreadName("main");
+    // everything up to the first frame
+    ProfileZone startupZone("startup");
+
+    if (!UInitialize(argc, argv, &gWindow))
+        return EXIT_FAILURE;
+
+    // Queue every texture of the scene and start decoding them on the worker
+    // pool; the names are valid right away and show a placeholder until uploaded
+    for (int i = 0; i < gScene.getTextureCount(); ++i)
+    {
+        const char* path = gScene.getTextures()[i].path;
+        gTextureIds.push_back(gTextures.load(path));
+        if (gTextureIds.back() == 0)
+        {
+            cout << "Failed to load texture " << path << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    gTextures.start();
+
+    // Create the shader program
+    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId, lightingShaderSource, vertexShaderPrefix))
+        return EXIT_FAILURE;
+
+    // look up the remaining plain uniforms once
+    UGetUniformLocations(gProgramId);
+
+    // create the per-frame and per-draw uniform buffers
+    UCreateUniformBuffers();
+
+    // the scene's lights and any extra ones, listed per cluster every frame
+    UCreateLights(gExtraLights);
+
+    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
+    glUseProgram(gProgramId);
+    // We set the texture as texture unit 0
+    glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
+    // We set the texture as texture unit 1
+    glUniform1i(glGetUniformLocation(gProgramId, "uTextureExtra"), 1);
+    // texture coordinate scale never changes
+    glUniform2fv(gUVScaleLoc, 1, glm::value_ptr(gUVScale));
+    // neither does the vertex format
+    glUniform1i(glGetUniformLocation(gProgramId, "octahedralNormals"), gGeometry.getVertexFormat().attributes[1].components == 2);
+    USetPositionDecode(gGeometry.getMesh(0).decode);
+    glUniform1f(gLodFadeLoc, gBoundLodFade);
+    glUniform2fv(gRadiusScaleLoc, 1, glm::value_ptr(gBoundRadiusScale));
+
+
+    // place the objects now that meshes and textures exist
+    UCreateSceneObjects();
+    if (gStressSettings > 0)
+        UCreateStressScene(gStressSettings);
+    UCreateCullBounds();
+    UCreateTransforms();
+
+    // build the multi-draw indirect and instanced buffers; without support only the forward path is available
+    if (!UCreateIndirectDraws() && gRenderMode == RENDER_INDIRECT)
+    {
+        cout << "Multi-draw indirect path unavailable, using forward rendering" << endl;
+        gRenderMode = RENDER_FORWARD;
+    }
+    if (!UCreateInstancedDraws() && gRenderMode == RENDER_INSTANCED)
+    {
+        cout << "Instanced path unavailable, using forward rendering" << endl;
+        gRenderMode = RENDER_FORWARD;
+    }
+
+    // the lighting pass of the deferred path; every render mode can write the G-buffer
+    if (!UCreateDeferredShading() && gShading == SHADING_DEFERRED)
+    {
+        cout << "Deferred shading unavailable, using forward shading" << endl;
+        gShading = SHADING_FORWARD;
+    }
+    USetShading(gShading);
+
+    // Sets the background color of the window to black (it will be implicitely used by glClear)
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+#ifdef BREAKFAST_GPU_TIMERS
+    gGpuTimers.create(gGpuTimersCsv);
+#endif
+
+    startupZone.end();
+
+#ifdef BREAKFAST_HEADLESS
+    // time the scene with its real textures
+    gTextures.finish();
+
+    // render a fixed number of frames offscreen and report their cost, or
+    // the cost of each light count of the sweep
+    if (gBenchmarkLightSweep.empty())
+        URunBenchmark(gBenchmarkFrames);
+    else
+        URunLightSweep(gBenchmarkFrames);
+#else
+    // render loop
+    // one iteration of this loop is one frame. 60FPS means this loop repeats 60 times per second
+    // -----------
+    while (!glfwWindowShouldClose(gWindow))
+    {
+        PROFILE_ZONE("frame");
+
+        // per-frame timing
+        // --------------------
+        float currentFrame = glfwGetTime();
+        gDeltaTime = currentFrame - gLastFrame;
+        gLastFrame = currentFrame;
+
+        // input
+        // -----
+        UProcessInput(gWindow);
+
+        // swap in textures whose decode finished; one per frame keeps frames smooth
+        gTextures.update(1);
+
+        // Render this frame
+        URender();
+
+        {
+            PROFILE_ZONE("glfwPollEvents");
+            glfwPollEvents();
+        }
+    }
+#endif
+
+    if (gTracePath != nullptr && CpuProfiler::writeChromeTrace(gTracePath))
+        cout << "Wrote trace " << gTracePath << endl;
+
+#ifdef BREAKFAST_GPU_TIMERS
+    // flush the last frames' timings before the context goes away
+    gGpuTimers.destroy();
+#endif
+
+    // Release mesh data
+    UDestroyMesh(gGeometry);
+
+    // Release uniform buffers
+    UDestroyUniformBuffers();
+    UDestroyIndirectDraws();
+    UDestroyInstancedDraws();
+    UDestroyTransforms();
+    UDestroyLights();
+    UDestroyDeferredShading();
+
+    // Release textures
+    gTextures.destroy();
+    for (size_t i = 0; i < gTextureIds.size(); ++i)
+        UDestroyTexture(gTextureIds[i]);
+
+    // Release shader programs
+    UDestroyShaderProgram(gProgramId);
+    UDestroyShaderProgram(gIndirectProgramId);
+    UDestroyShaderProgram(gInstancedProgramId);
+    UDestroyShaderProgram(gDeferredProgramId);
+
+    // what the debug context reported over the whole run
+    gDebugOutput.report();
+
+    exit(EXIT_SUCCESS); // Terminates the program successfully
+}
+
+
+/* ------------------- Initialize GLFW, GLEW, window, and everything else -------------------*/
+bool UInitialize(int argc, char* argv[], GLFWwindow** window)
+{
+    PROFILE_ZONE("UInitialize");
+
+    // command line: --scene path, --render-mode forward|indirect|instanced, --vertex-format float|unorm16|half,
+    // --index-topology list|strip, --lod on|off, --stress N, --spin N, --cull on|off|bvh, --cull-path scalar|sse2|avx2,
+    // --trace out.json, --no-texture-cache, --gl-debug off|async|sync, --lights N, --light-clusters on|off,
+    // --shading forward|deferred, --frames N, --dolly D, --pick X Y and --light-sweep A,B,... (benchmark only), --gpu-csv path (GPU timer builds only)
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--render-mode") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "indirect") == 0)
+                gRenderMode = RENDER_INDIRECT;
+            else if (strcmp(argv[i], "instanced") == 0)
+                gRenderMode = RENDER_INSTANCED;
+            else if (strcmp(argv[i], "forward") == 0)
+                gRenderMode = RENDER_FORWARD;
+            else
+                cout << "Unknown render mode " << argv[i] << ", using forward" << endl;
+        }
+        else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (!gGeometry.setVertexFormat(argv[i]))
+                cout << "Unknown vertex format " << argv[i] << ", using float" << endl;
+        }
+        else if (strcmp(argv[i], "--index-topology") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "strip") == 0)
+                gGeometry.setIndexTopology(INDEX_TRIANGLE_STRIP);
+            else if (strcmp(argv[i], "list") == 0)
+                gGeometry.setIndexTopology(INDEX_TRIANGLES);
+            else
+                cout << "Unknown index topology " << argv[i] << ", using list" << endl;
+        }
+        else if (strcmp(argv[i], "--lod") == 0 && i + 1 < argc)
+            gLodEnabled = strcmp(argv[++i], "off") != 0;
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            gScenePath = argv[++i];
+        else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc)
+            gStressSettings = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spin") == 0 && i + 1 < argc)
+            gSpinningObjects = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc)
+        {
+            ++i;
+            gCullEnabled = strcmp(argv[i], "off") != 0;
+            gCullWithBvh = strcmp(argv[i], "bvh") == 0;
+        }
+        else if (strcmp(argv[i], "--cull-path") == 0 && i + 1 < argc)
+        {
+            ++i;
+            int path = 0;
+            while (path < CULL_PATH_COUNT && strcmp(argv[i], UCullPathName((CullPath)path)) != 0)
+                ++path;
+            if (path < CULL_PATH_COUNT)
+                USetCullPath((CullPath)path);
+            else
+                cout << "Unknown cull path " << argv[i] << endl;
+        }
+        else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            gExtraLights = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--light-clusters") == 0 && i + 1 < argc)
+            gLightClusters.setClustered(strcmp(argv[++i], "off") != 0);
+        else if (strcmp(argv[i], "--shading") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "deferred") == 0)
+                gShading = SHADING_DEFERRED;
+            else if (strcmp(argv[i], "forward") == 0)
+                gShading = SHADING_FORWARD;
+            else
+                cout << "Unknown shading " << argv[i] << ", using forward" << endl;
+        }
+#ifdef BREAKFAST_HEADLESS
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            gBenchmarkFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dolly") == 0 && i + 1 < argc)
+            gBenchmarkDolly = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--pick") == 0 && i + 2 < argc)
+        {
+            gBenchmarkPickX = (float)atof(argv[++i]);
+            gBenchmarkPickY = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--light-sweep") == 0 && i + 1 < argc)
+        {
+            // comma-separated counts of extra lights
+            for (char* count = strtok(argv[++i], ","); count != nullptr; count = strtok(nullptr, ","))
+                gBenchmarkLightSweep.push_back(atoi(count));
+        }
+#endif
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            gTracePath = argv[++i];
+        else if (strcmp(argv[i], "--no-texture-cache") == 0)
+            gTextures.setCacheEnabled(false);
+        else if (strcmp(argv[i], "--gl-debug") == 0 && i + 1 < argc)
+        {
+            ++i;
+            int mode = 0;
+            while (mode < DEBUG_OUTPUT_MODE_COUNT && strcmp(argv[i], UDebugOutputModeName((DebugOutputMode)mode)) != 0)
+                ++mode;
+            if (mode < DEBUG_OUTPUT_MODE_COUNT)
+                gDebugOutputMode = (DebugOutputMode)mode;
+            else
+                cout << "Unknown GL debug mode " << argv[i] << endl;
+        }
+#ifdef BREAKFAST_GPU_TIMERS
+        else if (strcmp(argv[i], "--gpu-csv") == 0 && i + 1 < argc)
+            gGpuTimersCsv = argv[++i];
+#endif
+    }
+
+#ifdef BREAKFAST_HEADLESS
+    if (gBenchmarkFrames < 1)
+        gBenchmarkFrames = 1;
+    // back the camera away along its view direction to see the scene shrink
+    gCamera.Position -= gCamera.Front * gBenchmarkDolly;
+
+    // EGL: surfaceless context instead of a window
+    // --------------------------------------------
+    (void)window;   // stays NULL: there is nothing to present to
+    if (!gHeadless.create(4, 4, gDebugOutputMode != DEBUG_OUTPUT_OFF))
+        return false;
+
+    // GLEW: initialize
+    // ----------------
+    glewExperimental = GL_TRUE;
+    GLenum GlewInitResult = glewInit();
+
+    // GLEW built against GLX reports a missing X display after loading the
+    // core entry points, which is expected without a window
+    if (GLEW_OK != GlewInitResult && GLEW_ERROR_NO_GLX_DISPLAY != GlewInitResult)
+    {
+        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
+        return false;
+    }
+
+    // offscreen back buffer at the window resolution
+    if (!gHeadless.createFramebuffer(WINDOW_WIDTH, WINDOW_HEIGHT))
+        return false;
+#else
+    // GLFW: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // a debug context only when its output is wanted; otherwise skip error checking too where GLFW can
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, gDebugOutputMode != DEBUG_OUTPUT_OFF);
+#ifdef GLFW_CONTEXT_NO_ERROR
+    glfwWindowHint(GLFW_CONTEXT_NO_ERROR, gDebugOutputMode == DEBUG_OUTPUT_OFF);
+#endif
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    // GLFW: window creation
+    // ---------------------
+    * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+    if (*window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(*window);
+    glfwSetFramebufferSizeCallback(*window, UResizeWindow);
+    glfwSetCursorPosCallback(*window, UMousePositionCallback);
+    glfwSetScrollCallback(*window, UMouseScrollCallback);
+    glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+    glfwSetKeyCallback(*window, key_callback);
+
+    // tell GLFW to capture our mouse
+    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    // GLEW: initialize
+    // ----------------
+    // Note: if using GLEW version 1.13 or earlier
+    glewExperimental = GL_TRUE;
+    GLenum GlewInitResult = glewInit();
+
+    if (GLEW_OK != GlewInitResult)
+    {
+        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
+        return false;
+    }
+#endif
+
+    // Displays GPU OpenGL version
+    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
+
+    // debug output is set up here once; frames never touch it
+    gDebugOutput.create(gDebugOutputMode);
+
+    // read the scene; its primitives decide which meshes are built
+    if (!ULoadScene(gScenePath))
+        return false;
 
+    // set up all the GPU buffer objects
+    UCreateMeshes();
 
     return true;
 }
 
 
+#ifdef BREAKFAST_HEADLESS
+/* ------------------- Render frames offscreen and print their cost -------------------*/
+void URunBenchmark(int frames)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    cout << "INFO: Renderer: " << glGetString(GL_RENDERER) << endl;
+    cout << "INFO: Benchmark: " << frames << " frames at " << WINDOW_WIDTH << "x" << WINDOW_HEIGHT << endl;
+
+    vector<double> frameMs(frames);
+    unsigned long long glCalls = 0;
+    unsigned long long triangles = 0;
+    unsigned long long visibleObjects = 0;
+    unsigned long long transformUpdates = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point last = start;
+
+    for (int i = 0; i < frames; ++i)
+    {
+        // fixed time step so the scene is identical on every run
+        gDeltaTime = 1.0f / 60.0f;
+
+        PROFILE_ZONE("frame");
+
+        // Render this frame (ends with glFinish through the headless present)
+        unsigned long long callsBefore = gGLCallCount;
+        URender();
+        unsigned long long frameCalls = gGLCallCount - callsBefore;
+        glCalls += frameCalls;
+        triangles += gFrameTriangles;
+        visibleObjects += gFrameVisible;
+        transformUpdates += gFrameTransformUpdates;
+
+        Clock::time_point now = Clock::now();
+        frameMs[i] = std::chrono::duration<double, std::milli>(now - last).count();
+        last = now;
+
+        cout << "frame " << i << ": " << frameMs[i] << " ms, " << frameCalls << " GL calls, " << gFrameTriangles << " triangles, "
+            << gFrameVisible << " visible, " << gSceneObjects.size() - gFrameVisible << " culled, "
+            << gFrameTransformUpdates << " transforms recomputed" << endl;
+    }
+
+    double totalMs = std::chrono::duration<double, std::milli>(last - start).count();
+    double minMs = frameMs[0], maxMs = frameMs[0];
+    for (int i = 1; i < frames; ++i)
+    {
+        if (frameMs[i] < minMs) minMs = frameMs[i];
+        if (frameMs[i] > maxMs) maxMs = frameMs[i];
+    }
+
+    cout << "---------------" << endl;
+    cout << "frames:     " << frames << endl;
+    cout << "total:      " << totalMs << " ms" << endl;
+    cout << "avg frame:  " << totalMs / frames << " ms (min " << minMs << ", max " << maxMs << ")" << endl;
+    cout << "fps:        " << frames * 1000.0 / totalMs << endl;
+    cout << "GL calls:   " << glCalls / frames << " per frame (GLEW-dispatched entry points)" << endl;
+    cout << "triangles:  " << triangles / frames << " per frame" << endl;
+    cout << "objects:    " << visibleObjects / frames << " visible, " << gSceneObjects.size() - visibleObjects / frames
+        << " culled per frame (" << (gCullEnabled ? (gCullWithBvh ? "bvh" : UCullPathName(UGetCullPath())) : "culling off") << ")" << endl;
+    cout << "transforms: " << transformUpdates / (double)frames << " recomputed per frame (" << gTransformBatch.size() << " objects cached)" << endl;
+    cout << "lights:     " << gLightClusters.size() << " (" << (gLightClusters.isClustered() ? "clustered" : "clusters off") << "), "
+        << gLightClusters.getLitClusterCount() << " of " << LIGHT_CLUSTER_COUNT << " clusters lit, up to " << gLightClusters.getMaxClusterLights()
+        << " per cluster, assigned in " << gFrameClusterMs << " ms in the last frame" << endl;
+    if (gShading == SHADING_DEFERRED)
+        cout << "shading:    deferred (G-buffer " << gGBuffer.getWidth() << "x" << gGBuffer.getHeight() << ", "
+            << gGBuffer.getByteCount() / (1024.0 * 1024.0) << " MB)" << endl;
+    else
+        cout << "shading:    forward" << endl;
+    if (gRenderMode == RENDER_FORWARD)
+        cout << "state:      " << gFrameStateChanges << " changes, " << gFrameStatesAvoided << " avoided in the last frame ("
+            << gTextureSets.size() << " texture sets, " << gMaterials.size() << " materials)" << endl;
+
+    // picking through the last frame: the requested position, then a fixed spread of rays over the window
+    if (gBenchmarkPickX >= 0.0f && gBenchmarkPickY >= 0.0f)
+    {
+        UPickObject(gBenchmarkPickX, gBenchmarkPickY, (float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
+
+        const int rays = 100000;
+        std::mt19937 random(7);
+        vector<glm::vec3> origins(rays), directions(rays);
+        for (int r = 0; r < rays; ++r)
+            UCursorRay(gViewProjection, (random() % WINDOW_WIDTH) + 0.5f, (random() % WINDOW_HEIGHT) + 0.5f,
+                (float)WINDOW_WIDTH, (float)WINDOW_HEIGHT, origins[r], directions[r]);
+
+        int hits = 0;
+        Clock::time_point pickStart = Clock::now();
+        for (int r = 0; r < rays; ++r)
+            if (gSceneBvh.pick(origins[r], directions[r], 1.0f) >= 0)
+                ++hits;
+        double pickMs = std::chrono::duration<double, std::milli>(Clock::now() - pickStart).count();
+
+        // every object moved (to where it already is): the worst case of an incremental refit
+        for (int i = 0; i < gSceneBvh.size(); ++i)
+            gSceneBvh.setTransform(i, gSceneObjects[i].model);
+        Clock::time_point refitStart = Clock::now();
+        gSceneBvh.refit();
+        double refitMs = std::chrono::duration<double, std::milli>(Clock::now() - refitStart).count();
+
+        cout << "picks:      " << pickMs * 1000.0 / rays << " us per ray over " << rays << " rays (" << hits * 100.0 / rays << "% hit)" << endl;
+        cout << "BVH refit:  " << refitMs << " ms with all " << gSceneBvh.size() << " objects moved" << endl;
+    }
+}
+
+
+/* ------------------- Render with each light count of the sweep and print its cost -------------------*/
+// With clusters the frame time should stay roughly flat as lights are added
+// around the scene; --light-clusters off shows the cost of shading every
+// fragment with every light. Each count is timed with forward and, when
+// available, deferred shading, so --stress shows how overlapping objects
+// weigh on each
+void URunLightSweep(int frames)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    ShadingMode requested = gShading;
+    int shadingCount = gDeferredProgramId != 0 ? SHADING_MODE_COUNT : 1;
+    const char* names[SHADING_MODE_COUNT] = { "forward", "deferred" };
+
+    cout << "INFO: Renderer: " << glGetString(GL_RENDERER) << endl;
+    cout << "INFO: Light sweep: " << frames << " frames per count at " << WINDOW_WIDTH << "x" << WINDOW_HEIGHT << ", "
+        << (gLightClusters.isClustered() ? "clustered" : "clusters off") << ", " << gSceneObjects.size() << " objects" << endl;
+
+    for (size_t s = 0; s < gBenchmarkLightSweep.size(); ++s)
+    {
+        UCreateLights(gBenchmarkLightSweep[s]);
+
+        double clusterMs = 0.0;
+        double clusterLights = 0.0;
+        double frameMs[SHADING_MODE_COUNT] = { 0.0, 0.0 };
+        for (int shading = 0; shading < shadingCount; ++shading)
+        {
+            USetShading((ShadingMode)shading);
+
+            // one untimed frame for the new buffer
+            gDeltaTime = 1.0f / 60.0f;
+            URender();
+
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < frames; ++i)
+            {
+                gDeltaTime = 1.0f / 60.0f;
+                URender();
+                clusterMs += gFrameClusterMs;
+                clusterLights += gLightClusters.getClusterLightCount();
+            }
+            frameMs[shading] = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+        }
+        clusterMs /= frames * shadingCount;
+        clusterLights /= frames * shadingCount;
+
+        int lit = gLightClusters.getLitClusterCount();
+        cout << "lights " << gLightClusters.size() << ":";
+        for (int shading = 0; shading < shadingCount; ++shading)
+            cout << " " << names[shading] << " " << frameMs[shading] << " ms,";
+        cout << " assignment " << clusterMs << " ms, " << lit << " clusters lit, " << (lit > 0 ? clusterLights / lit : 0.0)
+            << " lights per lit cluster (max " << gLightClusters.getMaxClusterLights() << ")" << endl;
+    }
+    USetShading(requested);
+}
+#else
 /* ------------------- Process key input for current frame -------------------*/
 // called every render loop, making it a very fast input reader
 void UProcessInput(GLFWwindow* window)
 {
+    PROFILE_ZONE("UProcessInput");
+
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
@@ -512,6 +1624,22 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         select_ortho = !select_ortho;
 
     }
+
+    // M cycles through the render modes, skipping unavailable ones
+    if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        const char* names[RENDER_MODE_COUNT] = { "forward", "indirect", "instanced" };
+        do
+            gRenderMode = (RenderMode)((gRenderMode + 1) % RENDER_MODE_COUNT);
+        while ((gRenderMode == RENDER_INDIRECT && gIndirectDrawCapacity == 0)
+            || (gRenderMode == RENDER_INSTANCED && gInstanceCapacity == 0));
+        cout << "Render mode: " << names[gRenderMode] << endl;
+    }
+
+    // G switches between forward and deferred shading
+    if (key == GLFW_KEY_G && action == GLFW_PRESS && gDeferredProgramId != 0) {
+        USetShading(gShading == SHADING_FORWARD ? SHADING_DEFERRED : SHADING_FORWARD);
+        cout << "Shading: " << (gShading == SHADING_DEFERRED ? "deferred" : "forward") << endl;
+    }
 }
 
 
@@ -519,6 +1647,9 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    // a minimized window reports 0
+    gViewportWidth = width > 0 ? width : 1;
+    gViewportHeight = height > 0 ? height : 1;
 }
 
 
@@ -568,7 +1699,15 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
     case GLFW_MOUSE_BUTTON_LEFT:
     {
         if (action == GLFW_PRESS)
-            cout << "Left mouse button pressed" << endl;
+        {
+            // while the cursor steers the camera it is hidden: pick through the center of the view
+            int width, height;
+            glfwGetWindowSize(window, &width, &height);
+            double x = width * 0.5, y = height * 0.5;
+            if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED)
+                glfwGetCursorPos(window, &x, &y);
+            UPickObject((float)x, (float)y, (float)width, (float)height);
+        }
         else
             cout << "Left mouse button released" << endl;
     }
@@ -597,874 +1736,1437 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
         break;
     }
 }
+#endif
 
 /* ------------------- Function for rendering frame -------------------*/
 void URender()
 {
+    PROFILE_ZONE("URender");
 
-    // for debugging
-    int flags; glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
-    if (flags & GL_CONTEXT_FLAG_DEBUG_BIT)
-    {
-        glEnable(GL_DEBUG_OUTPUT);
-        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-        glDebugMessageCallback(glDebugOutput, nullptr);
-        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
-    }
+    // read back the GPU timings of an older frame
+    GPU_TIMER_FRAME();
 
     // Enable z-depth
     glEnable(GL_DEPTH_TEST);
 
     // Clear the frame and z buffers
+    GPU_TIMER_BEGIN("clear");
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GPU_TIMER_END();
 
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
 
 
     // create projection with either perspective or Orthographic matrix
+    float nearPlane, farPlane;
     if (select_ortho) {
         // creates an orthographic view matrix
-        projection = glm::ortho(-(float)WINDOW_WIDTH * 0.01f, (float)WINDOW_WIDTH * 0.01f, -(float)WINDOW_HEIGHT * 0.01f, (float)WINDOW_HEIGHT * 0.01f, 0.001f, 1000.0f);
+        nearPlane = 0.001f;
+        farPlane = 1000.0f;
+        projection = glm::ortho(-(float)WINDOW_WIDTH * 0.01f, (float)WINDOW_WIDTH * 0.01f, -(float)WINDOW_HEIGHT * 0.01f, (float)WINDOW_HEIGHT * 0.01f, nearPlane, farPlane);
     }
     else {
         // Creates a perspective projection
-        projection = glm::perspective(45.0f, (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        nearPlane = 0.1f;
+        farPlane = 100.0f;
+        projection = glm::perspective(45.0f, (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, nearPlane, farPlane);
     }
 
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    // list the lights that reach each cluster of this view
+    UAssignLights(view, projection, nearPlane, farPlane);
 
-    //---------------------- CUP CYLINDER ----------------------
-
-    // 1. Scales the object by 2
-    glm::mat4 scale = glm::mat4(1.0f);
-    // 2. Rotates shape 
-    glm::mat4 rotation = glm::mat4(1.0f);
-    rotation = glm::rotate(rotation, -1.5708f, glm::vec3(1.0, 0.0f, 0.0f));
-    // 3. Place object at the origin
-    glm::mat4 translation = glm::mat4(1.0f);
-    translation = glm::translate(translation, glm::vec3(0.0f, 1.00f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 model = translation * rotation * scale;
-
-    // specify color of cylinder
-    GLfloat myColor[] = { 0.7f, 0.7f, 0.7f, 1.0f };
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // set texture uniform variable in shader program
-    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-    // Reference matrix uniforms from the shader program for the color, light color, light position, and camera position
-    GLint lightColor1Loc = glGetUniformLocation(gProgramId, "lightColor1");
-    GLint lightColor2Loc = glGetUniformLocation(gProgramId, "lightColor2");
-    GLint lightPosition1Loc = glGetUniformLocation(gProgramId, "lightPos1");
-    GLint lightPosition2Loc = glGetUniformLocation(gProgramId, "lightPos2");
-    GLint lightStrength1Loc = glGetUniformLocation(gProgramId, "light_1_strength");
-    GLint lightStrength2Loc = glGetUniformLocation(gProgramId, "light_2_strength");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
-    GLint ambientStrengthLoc = glGetUniformLocation(gProgramId, "ambientStrength");
-    GLint diffuseStrengthLoc = glGetUniformLocation(gProgramId, "diffuseStrength");
-    GLint specularIntensityLoc = glGetUniformLocation(gProgramId, "specularIntensity");
-
-    // Pass color, light, and camera data to the shader program's corresponding uniforms
-    glUniform3f(lightColor1Loc, gLightColor1.r, gLightColor1.g, gLightColor1.b);
-    glUniform3f(lightColor2Loc, gLightColor2.r, gLightColor2.g, gLightColor2.b);
-    glUniform3f(lightPosition1Loc, gLightPosition1.x, gLightPosition1.y, gLightPosition1.z);
-    glUniform3f(lightPosition2Loc, gLightPosition2.x, gLightPosition2.y, gLightPosition2.z);
-    glUniform1f(lightStrength1Loc, light_1_strength);
-    glUniform1f(lightStrength2Loc, light_2_strength);
-    glUniform3f(ambientStrengthLoc, gAmbientStrength.r, gAmbientStrength.g, gAmbientStrength.b);
-    glUniform3f(diffuseStrengthLoc, gDiffuseStrength.r, gAmbientStrength.g, gAmbientStrength.b);
-    glUniform1f(specularIntensityLoc, gSpecularIntensity);;
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    // tell fragment shader there is not multiple textures
-    GLuint multipleTexturesLoc = glGetUniformLocation(gProgramId, "multipleTextures");
-    glUniform1i(multipleTexturesLoc, false);
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[0]);
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureCup);
+    // Pass view, projection, cluster grid, and camera data to the shader program in one upload
+    UUpdateFrameUniforms(view, projection);
+
+    // move what moves this frame, refitting the BVH over all of it at once
+    USpinObjects(gDeltaTime);
+    gSceneBvh.refit();
+
+    // drop every object outside the view, then pick the level of detail of the rest
+    gFrameTriangles = 0;
+    gViewProjection = projection * view;
+    bool changed = UCullObjects(gViewProjection);
+    UUpdateTransforms();
+    if (UUpdateLods(view, projection))
+        changed = true;
+    if (changed)
+        gIndirectDirty = gInstancesDirty = true;
+
+    // Activate the shared VAO that holds every mesh
+    gGeometry.bind();
+
+    // deferred: the objects below write the G-buffer instead of lighting themselves
+    bool deferred = gShading == SHADING_DEFERRED && UBeginGeometryPass();
+
+    if (gRenderMode == RENDER_INDIRECT)
+    {
+        // the whole scene in one multi-draw
+        PROFILE_ZONE("URenderIndirect");
+        GPU_TIMER_BEGIN("indirect");
+        URenderIndirect();
+        GPU_TIMER_END();
+    }
+    else if (gRenderMode == RENDER_INSTANCED)
+    {
+        // one instanced draw per distinct mesh
+        PROFILE_ZONE("URenderInstanced");
+        GPU_TIMER_BEGIN("instanced");
+        URenderInstanced();
+        GPU_TIMER_END();
+    }
+    else
+    {
+        // one draw per object, ordered by state and then front to back
+        PROFILE_ZONE("URenderForward");
+        URenderForward(view);
+    }
 
-    // Draws the cup cylinder
-    glDrawElements(GL_TRIANGLES, cylinder1.getIndexCount(), GL_UNSIGNED_INT, NULL);
+    // then light every covered pixel once
+    if (deferred)
+    {
+        PROFILE_ZONE("URenderDeferredLighting");
+        GPU_TIMER_BEGIN("lighting");
+        URenderDeferredLighting(gViewProjection);
+        GPU_TIMER_END();
+    }
 
     // Deactivate the Vertex Array Object
     glBindVertexArray(0);
 
+#ifdef BREAKFAST_HEADLESS
+    PROFILE_ZONE("present");
+    gHeadless.present();         // Waits for the offscreen frame to finish
+#else
+    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    PROFILE_ZONE("glfwSwapBuffers");
+    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+#endif
+}
 
-    //---------------------- CUP HANDLE - CUBE 1 ----------------------
 
-    // set up cup handle buffers
-    setupHandleBuffers(gMesh);
 
-    // Change model view before drawing handle
-    scale = glm::mat4(1.0f);
-    scale = glm::scale(scale, glm::vec3(0.3f, 0.1f, 1.1f));
-    rotation = glm::mat4(1.0f);
-    rotation = glm::rotate(rotation, 0.0f, glm::vec3(1.0, 0.0f, 0.0f));
-    translation = glm::mat4(1.0f);
-    translation = glm::translate(translation, glm::vec3(0.0f, 1.5f, 1.55f));
-    model = translation * rotation * scale;
+/* ------------------- Register every mesh in the geometry arena and upload once -------------------*/
+void UCreateMeshes()
+{
+    PROFILE_ZONE("UCreateMeshes");
 
-    // specify color of cube
-    myColor[0] = 0.7f;
-    myColor[1] = 0.7f;
-    myColor[2] = 0.7f;
+    // create the plane mesh
+    createPlaneMesh();
+    // create cube mesh
+    createCubeMesh();
 
-    // Set new model matrix and color in shader's uniform variables
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
+    // each mesh is a registry call; all of them share one VAO and two buffers.
+    // The scene's cylinders and spheres come from the cache in the arena's
+    // topology, so primitives that differ only in size (the cup, tea and
+    // plate) share one unit mesh. With LOD they also get coarser and finer
+    // levels: 2x, 1x, 1/2, 1/4 and 1/8 of their sector and stack counts
+    gPlaneMesh = gGeometry.addMesh(plane1.verts.data(), (unsigned int)plane1.verts.size() / GeometryArena::FLOATS_PER_VERTEX);
+    gCubeMesh = gGeometry.addMesh(cube1.verts.data(), (unsigned int)cube1.verts.size() / GeometryArena::FLOATS_PER_VERTEX);
+    const int LOD_LEVELS = 5;
+    for (int i = 0; i < gScene.getPrimitiveCount(); ++i)
+    {
+        const ScenePrimitiveDesc& desc = gScene.getPrimitives()[i];
+        PrimitiveMesh primitive;
+        primitive.lod = -1;
+        primitive.shape.scale = glm::vec3(1.0f);
+        primitive.shape.radiusScale = glm::vec2(1.0f);
+        primitive.pickShape = PICK_BOX;
+        if (desc.shape == SCENE_PLANE || desc.shape == SCENE_CUBE)
+        {
+            primitive.mesh = desc.shape == SCENE_PLANE ? gPlaneMesh : gCubeMesh;
+            gPrimitiveMeshes.push_back(primitive);
+            continue;
+        }
 
-    // tell fragment shader there is not multiple textures
-    glUniform1i(multipleTexturesLoc, false);
+        // only the tessellation picks the mesh; the sizes go into the model matrices
+        int minStacks = 1;
+        if (desc.shape == SCENE_SPHERE)
+        {
+            primitive.shape = USpherePrimitive(desc.baseRadius, desc.sectorCount, desc.stackCount, desc.smooth != 0);
+            primitive.pickShape = PICK_SPHERE;
+            minStacks = 3;
+        }
+        else
+        {
+            primitive.shape = UCylinderPrimitive(desc.baseRadius, desc.topRadius, desc.height, desc.sectorCount, desc.stackCount, desc.smooth != 0);
+            primitive.pickShape = PICK_CYLINDER;
+        }
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[2]);
+        if (gLodEnabled)
+        {
+            primitive.lod = (int)gLodChains.size();
+            gLodChains.push_back(UAddLodChain(gGeometryCache, primitive.shape.key, 6, minStacks, LOD_LEVELS));
+            primitive.mesh = gLodChains[primitive.lod].getLevel(1).mesh;
+        }
+        else
+            primitive.mesh = gGeometryCache.get(primitive.shape.key);
+        gPrimitiveMeshes.push_back(primitive);
+    }
+    cout << "INFO: Geometry cache: " << gGeometryCache.getMisses() << " meshes built, "
+        << gGeometryCache.getHits() << " shared" << endl;
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureCup);
+    // one upload for the whole scene; nothing is re-uploaded while rendering
+    gGeometry.upload();
 
-    // Draw cup handle piece #1
-    glDrawArrays(GL_TRIANGLES, 0, cube1.verts.size() / 8);
+    // what quantization costs and saves
+    const VertexCodec& format = gGeometry.getVertexFormat();
+    if (format.stride != sizeof(GeometryArena::SourceFormat::Vertex))
+    {
+        const VertexFormatError& error = gGeometry.getFormatError();
+        cout << "INFO: Vertex format " << format.name << ": " << format.stride << " bytes/vertex, "
+            << gGeometry.getVertexCount() * format.stride / 1024.0f << " KB for " << gGeometry.getVertexCount()
+            << " vertices (float: " << gGeometry.getVertexCount() * sizeof(GeometryArena::SourceFormat::Vertex) / 1024.0f << " KB)" << endl;
+        cout << "INFO: Vertex format max error: position " << error.position << ", normal "
+            << error.normalDegrees << " deg, uv " << error.texCoord << endl;
+    }
+    cout << "INFO: Index buffer: " << gGeometry.getIndexCount() << " " << gGeometry.getIndexWidth() * 8 << "-bit "
+        << (gGeometry.getIndexTopology() == INDEX_TRIANGLE_STRIP ? "strip" : "list") << " indices, " << gGeometry.getIndexCount() * gGeometry.getIndexWidth() / 1024.0f << " KB" << endl;
+}
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
 
-    //---------------------- CUP HANDLE - CUBE 2 ----------------------
+/* ------------------- Read the scene description -------------------*/
+// Text scenes are parsed, compiled ones read as they are. Everything is used
+// later, as the meshes, textures, objects and lights are created
+bool ULoadScene(const char* path)
+{
+    PROFILE_ZONE("ULoadScene");
 
-    scale = glm::mat4(1.0f);
-    scale = glm::scale(scale, glm::vec3(0.3f, 0.1f, 1.7f));
-    rotation = glm::mat4(1.0f);
-    rotation = glm::rotate(rotation, -0.785398f, glm::vec3(1.0, 0.0f, 0.0f));
-    translation = glm::mat4(1.0f);
-    translation = glm::translate(translation, glm::vec3(0.0f, 0.83f, 1.5f));
-    model = translation * rotation * scale;
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    if (!gScene.load(path))
+    {
+        cout << "Failed to load scene " << gScene.getError() << endl;
+        return false;
+    }
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    cout << "INFO: Scene " << path << ": " << gScene.getObjectCount() << " objects, " << gScene.getPrimitiveCount() << " primitives, "
+        << gScene.getMaterialCount() << " materials, " << gScene.getTextureCount() << " textures, " << gScene.getLightCount()
+        << " lights, " << gScene.getByteCount() / 1024.0f << " KB loaded in " << loadMs << " ms" << endl;
 
-    // Set new model matrix and color in shader's uniform variables
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
+    // materials, and the texture sets that follow from them, are fields of the forward path's sort keys
+    if (gScene.getMaterialCount() > (1 << RENDER_KEY_MATERIAL_BITS) || gScene.getMaterialCount() > (1 << RENDER_KEY_TEXTURE_SET_BITS))
+    {
+        cout << "Failed to load scene " << path << ": more than " << (1 << RENDER_KEY_MATERIAL_BITS) << " materials" << endl;
+        return false;
+    }
+    return true;
+}
 
-    // tell fragment shader there is not multiple textures
-    glUniform1i(multipleTexturesLoc, false);
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[2]);
 
-    // Draw cup handle piece #2
-    glDrawArrays(GL_TRIANGLES, 0, cube1.verts.size() / 8);
+/* ------------------- Place every object of the scene -------------------*/
+// The scene is static, so the model matrices are computed once here instead of every frame
+void UCreateSceneObjects()
+{
+    gSceneObjects.reserve(gScene.getObjectCount());
+    for (int i = 0; i < gScene.getObjectCount(); ++i)
+    {
+        const SceneObjectDesc& desc = gScene.getObjects()[i];
+        const PrimitiveMesh& primitive = gPrimitiveMeshes[desc.primitive];
+        const SceneMaterialDesc& material = gScene.getMaterials()[desc.material];
+
+        // the file holds translation * rotation * scale; the primitive's size goes last
+        glm::mat4 model = glm::make_mat4(desc.model) * glm::scale(glm::mat4(1.0f), primitive.shape.scale);
+
+        GLuint extraTexture = material.extraTexture == SCENE_NO_TEXTURE ? 0 : gTextureIds[material.extraTexture];
+        UAddSceneObject(desc.name, primitive.mesh, model, desc.material, gTextureIds[material.texture], extraTexture);
+        gSceneObjects.back().lod = primitive.lod;
+        gSceneObjects.back().radiusScale = primitive.shape.radiusScale;
+        gSceneObjects.back().pickShape = primitive.pickShape;
+    }
+}
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
+/* ------------------- Add one object to the scene -------------------*/
+void UAddSceneObject(const char* name, int mesh, const glm::mat4& model, int material, GLuint texture, GLuint extraTexture)
+{
+    SceneObject object;
+    object.name = name;
+    object.mesh = mesh;
+    object.model = model;
+    object.material = material;
+    object.texture = texture;
+    object.extraTexture = extraTexture;
+    object.lod = -1;
+    object.lodState.level = -1;
+    object.lodState.fromLevel = -1;
+    object.lodState.fade = 1.0f;
+    object.radiusScale = glm::vec2(1.0f);
+    object.pickShape = PICK_BOX;
+    object.instanceMaterial = 0;
+#ifdef BREAKFAST_GPU_TIMERS
+    object.gpuTimerPass = gGpuTimers.getPass(name);
+#endif
 
+    // objects with the same pair of textures share one set, so the forward path binds it once
+    object.textureSet = 0;
+    while (object.textureSet < (int)gTextureSets.size()
+        && (gTextureSets[object.textureSet].texture != texture || gTextureSets[object.textureSet].extraTexture != extraTexture))
+        ++object.textureSet;
+    if (object.textureSet == (int)gTextureSets.size())
+    {
+        TextureSet textures = { texture, extraTexture };
+        gTextureSets.push_back(textures);
+    }
+    gSceneObjects.push_back(object);
+}
 
-    //---------------------- TABLE ----------------------
 
-    // Change model view before drawing plane
-    scale = glm::mat4(1.0f);
-    scale = glm::scale(scale, glm::vec3(16.0f, 1.0f, 16.0f));
-    rotation = glm::mat4(1.0f);
-    rotation = glm::rotate(rotation, 1.5708f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::mat4(1.0f);
-    translation = glm::translate(translation, glm::vec3(-1.0f, -0.57f, -2.0f));
-    model = translation * rotation * scale;
 
-    // Set new model matrix and specular intensity in shader's uniform variables
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-    // change lighting components for this object
-    glUniform3f(ambientStrengthLoc, 0.0001f, 0.0001f, 0.0001f);
-    glUniform1f(specularIntensityLoc, 1.0f);
+/* ------------------- Create plane mesh -------------------*/
+void createPlaneMesh() {
+    // Position data  for plane
+    vector<float> verts = {
 
-    // tell fragment shader there is not multiple textures
-    glUniform1i(multipleTexturesLoc, false);
+        // position           // normal           // tex coordinate
+        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
+         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
+         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
+         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
+        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
+        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
+    };
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[1]);
+    // populate plane1 struct with this mesh data
+    verts.swap(plane1.verts);
+}
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureTable);
 
-    // Draw the plane
-    glDrawArrays(GL_TRIANGLES, 0, plane1.verts.size() / 8);
 
-    // set lighting components back to normal
-    glUniform3f(ambientStrengthLoc, gAmbientStrength.r, gAmbientStrength.g, gAmbientStrength.b);
-    glUniform3f(diffuseStrengthLoc, gDiffuseStrength.r, gAmbientStrength.g, gAmbientStrength.b);
-    glUniform1f(specularIntensityLoc, gSpecularIntensity);
+/* ------------------- Create cube mesh -------------------*/
+void createCubeMesh() {
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    vector<float> verts = {
 
+        // positions          // normals           // texture coords
+        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
+         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f,
+         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
+         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
+        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f,
+        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
 
+        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
+         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f,
+         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
+         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
+        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f,
+        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
 
-    //---------------------- CLOTH ----------------------
+        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
+        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
+        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
+        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
+        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
+        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
 
-    // Change model view before drawing plane
-    scale = glm::mat4(1.0f);
-    scale = glm::scale(scale, glm::vec3(3.0f, 1.0f, 3.0f));
-    rotation = glm::mat4(1.0f);
-    rotation = glm::rotate(rotation, -0.8f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::mat4(1.0f);
-    translation = glm::translate(translation, glm::vec3(0.0f, -0.56f, 0.0f));
-    model = translation * rotation * scale;
+         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
+         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
+         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
+         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
+         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
+         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
 
-    // Set new model matrix and specular intensity in shader's uniform variables
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-    // change lighting components for this object
-    glUniform3f(ambientStrengthLoc, 0.00001f, 0.00001f, 0.00001f);
-    glUniform1f(specularIntensityLoc, 0.0f);
+        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
+         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f,
+         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
+         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
+        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
+        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
 
-    // tell fragment shader there is not multiple textures
-    glUniform1i(multipleTexturesLoc, false);
+        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
+         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
+         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
+         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
+        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
+        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
+    };
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[1]);
+    // populate cube1 struct with this mesh data
+    verts.swap(cube1.verts);
+}
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureCloth);
 
-    // Draw the plane
-    glDrawArrays(GL_TRIANGLES, 0, plane1.verts.size() / 8);
 
-    // set lighting components back to normal
-    glUniform3f(ambientStrengthLoc, gAmbientStrength.r, gAmbientStrength.g, gAmbientStrength.b);
-    glUniform1f(specularIntensityLoc, gSpecularIntensity);
+/* ------------------- Destroy VAOs and VBOs -------------------*/
+void UDestroyMesh(GeometryArena& geometry)
+{
+    // delete the shared VAO and buffers
+    geometry.destroy();
+}
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
 
+/* ------------------- Deletes a texture -------------------*/
+void UDestroyTexture(GLuint textureId)
+{
+    glDeleteTextures(1, &textureId);
+}
 
-    //---------------------- TEA ----------------------
 
-    scale = glm::mat4(1.0f);
-    rotation = glm::mat4(1.0f);
-    rotation = glm::rotate(rotation, -1.5708f, glm::vec3(1.0, 0.0f, 0.0f));
-    translation = glm::mat4(1.0f);
-    translation = glm::translate(translation, glm::vec3(0.0f, 1.951f, 0.0f));
-    model = translation * rotation * scale;
 
-    // Set new model matrix and color in shader's uniform variables
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
+/* ------------------- Create the shader program from the vertex and fragment shader sources -------------------*/
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId, const char* fragShaderPrefix, const char* vtxShaderPrefix)
+{
+    PROFILE_ZONE("UCreateShaderProgram");
 
-    // tell fragment shader there is multiple textures
-    glUniform1i(multipleTexturesLoc, true);
+    // Compilation and linkage error reporting
+    int success = 0;
+    char infoLog[512]; // create character string of length 512 for the error log
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[3]);
+    // Create a Shader program object.
+    programId = glCreateProgram();
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureTea);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, gTextureLemon);
+    // Create the vertex and fragment shader objects
+    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
 
-    // Draw the tea cylinder
-    glDrawElements(GL_TRIANGLES, cylinder2.getIndexCount(), GL_UNSIGNED_INT, NULL);
+    // Retrive the shader source; a prefix (shared declarations, with the version) goes first
+    const char* vertexSources[2] = { vtxShaderPrefix, vtxShaderSource };
+    if (vtxShaderPrefix != NULL)
+        glShaderSource(vertexShaderId, 2, vertexSources, NULL);
+    else
+        glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
+    const char* fragmentSources[2] = { fragShaderPrefix, fragShaderSource };
+    if (fragShaderPrefix != NULL)
+        glShaderSource(fragmentShaderId, 2, fragmentSources, NULL);
+    else
+        glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    // Compile the vertex shader, and print compilation errors (if any)
+    glCompileShader(vertexShaderId); // compile the vertex shader
+    // check for shader compile errors
+    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
 
+    glCompileShader(fragmentShaderId); // compile the fragment shader
+    // check for shader compile errors
+    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
 
+        return false;
+    }
 
-    //---------------------- PLATE ----------------------
+    // Attached compiled shaders to the shader program
+    glAttachShader(programId, vertexShaderId);
+    glAttachShader(programId, fragmentShaderId);
 
-    scale = glm::mat4(1.0f);
-    rotation = glm::mat4(1.0f);
-    rotation = glm::rotate(rotation, -1.5708f, glm::vec3(0.0, 1.0f, 0.0f));
-    rotation = glm::rotate(rotation, -1.5708f, glm::vec3(1.0, 0.0f, 0.0f));
-    translation = glm::mat4(1.0f);
-    translation = glm::translate(translation, glm::vec3(-3.9f, 0.08f, -1.6f));
-    model = translation * rotation * scale;
+    glLinkProgram(programId);   // links the shader program
+    // check for linking errors
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
+
+    glUseProgram(programId);    // Uses the shader program
+
+    return true;
+}
+
+
+
+/* ------------------- Destroy shader program -------------------*/
+void UDestroyShaderProgram(GLuint programId)
+{
+    glDeleteProgram(programId); // delete the shader program
+}
+
+
+
+/* ------------------- Look up plain uniform locations once -------------------*/
+void UGetUniformLocations(GLuint programId)
+{
+    gTransformLoc = glGetUniformLocation(programId, "transform");
+    gUVScaleLoc = glGetUniformLocation(programId, "uvScale");
+    gPositionOffsetLoc = glGetUniformLocation(programId, "positionOffset");
+    gPositionScaleLoc = glGetUniformLocation(programId, "positionScale");
+    gLodFadeLoc = glGetUniformLocation(programId, "lodFade");
+    gRadiusScaleLoc = glGetUniformLocation(programId, "radiusScale");
+}
+
+
+
+/* ------------------- Create the per-frame and per-draw uniform buffers -------------------*/
+void UCreateUniformBuffers()
+{
+    glGenBuffers(1, &gFrameUbo);
+    glGenBuffers(1, &gDrawUbo);
+
+    // per-frame block: rewritten every frame
+    glBindBuffer(GL_UNIFORM_BUFFER, gFrameUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, gFrameUbo);
+
+    // per-draw block: one slot per material, each slot starting on a legal bind offset
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    gDrawUboStride = ((GLint)sizeof(DrawUniforms) + alignment - 1) / alignment * alignment;
+
+    // the materials never change, so they are uploaded once here
+    gMaterials.clear();
+    for (int i = 0; i < gScene.getMaterialCount(); ++i)
+    {
+        const SceneMaterialDesc& material = gScene.getMaterials()[i];
+        DrawUniforms slot = { glm::make_vec3(material.ambient), material.specular, material.extraTexture != SCENE_NO_TEXTURE };
+        gMaterials.push_back(slot);
+    }
+
+    vector<unsigned char> data(gDrawUboStride * (gMaterials.empty() ? 1 : gMaterials.size()), 0);
+    for (size_t i = 0; i < gMaterials.size(); ++i)
+        memcpy(&data[i * gDrawUboStride], &gMaterials[i], sizeof(DrawUniforms));
+
+    glBindBuffer(GL_UNIFORM_BUFFER, gDrawUbo);
+    glBufferData(GL_UNIFORM_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+
+
+/* ------------------- Write view, projection, camera and cluster grid once per frame -------------------*/
+void UUpdateFrameUniforms(const glm::mat4& view, const glm::mat4& projection)
+{
+    FrameUniforms frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewProjection = projection * view;
+    frame.viewPosition = glm::vec4(gCamera.Position, 1.0f);
+    frame.clusterScale = glm::vec4((float)LIGHT_CLUSTERS_X / gViewportWidth, (float)LIGHT_CLUSTERS_Y / gViewportHeight,
+        gLightClusters.getSliceScale(), gLightClusters.getSliceBias());
+    frame.clusterGrid = glm::ivec4(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z, 0);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, gFrameUbo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+}
+
+
+
+/* ------------------- Point the draw block at an object's material -------------------*/
+void UBindDrawUniforms(int slot)
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING, gDrawUbo, slot * gDrawUboStride, sizeof(DrawUniforms));
+}
+
+
+
+/* ------------------- Point the forward program at a mesh's position decode -------------------*/
+void USetPositionDecode(const VertexDecode& decode)
+{
+    // consecutive meshes often share it; float vertices always do
+    if (memcmp(&decode, &gBoundDecode, sizeof(VertexDecode)) == 0)
+        return;
+
+    glUniform3fv(gPositionOffsetLoc, 1, decode.offset);
+    glUniform3fv(gPositionScaleLoc, 1, decode.scale);
+    gBoundDecode = decode;
+}
+
+
+
+/* ------------------- Build the multi-draw indirect buffers -------------------*/
+// One DrawElementsIndirectCommand and one IndirectDrawData per scene object, two
+// while its LOD blends, grouped by texture set. The buffers are only rewritten
+// when a level changes, so a frame costs one multi-draw per texture set whatever
+// the object count.
+bool UCreateIndirectDraws()
+{
+    // gl_DrawIDARB needs ARB_shader_draw_parameters (core only in 4.6)
+    if (!GLEW_ARB_shader_draw_parameters)
+        return false;
+
+    if (!UCreateShaderProgram(indirectVertexShaderSource, indirectFragmentShaderSource, gIndirectProgramId, lightingShaderSource, vertexShaderPrefix))
+        return false;
+
+    // room for every object to blend at once; updated in place by UWriteIndirectDraws
+    gIndirectDrawCapacity = (GLsizei)gSceneObjects.size() * 2;
+    glGenBuffers(1, &gIndirectCommandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectCommandBuffer);
+    glBufferStorage(GL_DRAW_INDIRECT_BUFFER, gIndirectDrawCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenBuffers(1, &gIndirectDrawBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gIndirectDrawBuffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, gIndirectDrawCapacity * sizeof(IndirectDrawData), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    UWriteIndirectDraws();
+
+    glUseProgram(gIndirectProgramId);
+    glUniform1i(glGetUniformLocation(gIndirectProgramId, "uTexture"), 0);
+    glUniform1i(glGetUniformLocation(gIndirectProgramId, "uTextureExtra"), 1);
+    glUniform2fv(glGetUniformLocation(gIndirectProgramId, "uvScale"), 1, glm::value_ptr(gUVScale));
+    glUniform1i(glGetUniformLocation(gIndirectProgramId, "octahedralNormals"), gGeometry.getVertexFormat().attributes[1].components == 2);
+    gIndirectFirstDrawLoc = glGetUniformLocation(gIndirectProgramId, "firstDraw");
+    glUseProgram(gProgramId);
+
+    return true;
+}
+
+
+
+/* ------------------- Write the current draws of every object, grouped by texture set -------------------*/
+void UWriteIndirectDraws()
+{
+    PROFILE_ZONE("UWriteIndirectDraws");
 
-    // Set new model matrix and color in shader's uniform variables
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-    // change lighting components for this object
-    glUniform3f(ambientStrengthLoc, 0.08f, 0.08f, 0.08f);
-    glUniform1f(specularIntensityLoc, 0.5f);
+    // counting sort by texture set: count, then hand out each set's first slot
+    vector<GLint> setFirst(gTextureSets.size() + 1, 0);
+    for (size_t i = 0; i < gSceneObjects.size(); ++i)
+    {
+        if (!gVisible[i])
+            continue;
+        int meshes[2];
+        float fades[2];
+        setFirst[gSceneObjects[i].textureSet + 1] += UGetObjectDraws(gSceneObjects[i], meshes, fades);
+    }
 
-    // tell fragment shader there is multiple textures
-    glUniform1i(multipleTexturesLoc, false);
+    gIndirectBatches.clear();
+    for (size_t set = 0; set < gTextureSets.size(); ++set)
+    {
+        GLsizei count = setFirst[set + 1];
+        setFirst[set + 1] += setFirst[set];
+        if (count == 0)
+            continue;
+
+        IndirectBatch batch;
+        batch.textureSet = (int)set;
+        batch.firstDraw = setFirst[set];
+        batch.drawCount = count;
+        gIndirectBatches.push_back(batch);
+    }
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[5]);
+    vector<DrawElementsIndirectCommand> commands(setFirst.back());
+    vector<IndirectDrawData> draws(setFirst.back());
+    gIndirectTriangles = 0;
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTexturePlate);
+    for (size_t i = 0; i < gSceneObjects.size(); ++i)
+    {
+        if (!gVisible[i])
+            continue;
+        const SceneObject& object = gSceneObjects[i];
+        const DrawUniforms& material = gMaterials[object.material];
+
+        int meshes[2];
+        float fades[2];
+        int drawCount = UGetObjectDraws(object, meshes, fades);
+        for (int d = 0; d < drawCount; ++d)
+        {
+            const MeshRange& range = gGeometry.getMesh(meshes[d]);
+            GLint slot = setFirst[object.textureSet]++;
+
+            DrawElementsIndirectCommand& command = commands[slot];
+            command.count = range.indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = range.firstIndex;
+            command.baseVertex = range.baseVertex;
+            command.baseInstance = 0;
+
+            IndirectDrawData& draw = draws[slot];
+            draw.ambientStrength = material.ambientStrength;
+            draw.specularIntensity = material.specularIntensity;
+            draw.multipleTextures = material.multipleTextures;
+            draw.lodFade = fades[d];
+            draw.transform = (GLint)i;
+            draw.padding = 0;
+            draw.positionOffset = glm::vec4(glm::make_vec3(range.decode.offset), 0.0f);
+            draw.positionScale = glm::vec4(glm::make_vec3(range.decode.scale), 0.0f);
+            draw.radiusScale = glm::vec4(object.radiusScale, 0.0f, 0.0f);
+
+            gIndirectTriangles += range.triangleCount;
+        }
+    }
 
-    // Draw the tea cylinder
-    glDrawElements(GL_TRIANGLES, cylinder3.getIndexCount(), GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectCommandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gIndirectDrawBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, draws.size() * sizeof(IndirectDrawData), draws.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    // set lighting components back to normal
-    glUniform3f(ambientStrengthLoc, gAmbientStrength.r, gAmbientStrength.g, gAmbientStrength.b);
-    glUniform1f(specularIntensityLoc, gSpecularIntensity);
+    gIndirectDirty = false;
+}
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
 
 
+/* ------------------- Submit the scene with one multi-draw per texture set -------------------*/
+void URenderIndirect()
+{
+    glUseProgram(gIndirectProgramId);
 
+    // LOD levels changed or blends moved on since the last write
+    if (gIndirectDirty)
+        UWriteIndirectDraws();
+    gFrameTriangles += gIndirectTriangles;
 
-    //---------------------- ORANGE ----------------------
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_STORAGE_BINDING, gIndirectDrawBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectCommandBuffer);
 
-    scale = glm::mat4(1.0f);
-    rotation = glm::mat4(1.0f);
-    rotation = glm::rotate(rotation, 1.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    translation = glm::mat4(1.0f);
-    translation = glm::translate(translation, glm::vec3(-3.5f, 0.98f, -1.3f));
-    model = translation * rotation * scale;
+    // the shared arena VAO is bound by URender. Samplers stay uniform within
+    // each call, so the textures are bound between multi-draws rather than
+    // picked per draw in the shader
+    for (size_t i = 0; i < gIndirectBatches.size(); ++i)
+    {
+        const IndirectBatch& batch = gIndirectBatches[i];
+        UBindTextureSet(batch.textureSet);
+        glUniform1i(gIndirectFirstDrawLoc, batch.firstDraw);
+        glMultiDrawElementsIndirect(gGeometry.getPrimitiveMode(), gGeometry.getIndexType(),
+            (const void*)(batch.firstDraw * sizeof(DrawElementsIndirectCommand)), batch.drawCount, 0);
+    }
+}
 
-    // Set new model matrix and color in shader's uniform variables
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-    // change lighting components for this object
-    glUniform3f(ambientStrengthLoc, 0.08f, 0.08f, 0.08f);
-    glUniform1f(specularIntensityLoc, 0.3f);
 
-    // tell fragment shader there is multiple textures
-    glUniform1i(multipleTexturesLoc, false);
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[4]);
+/* ------------------- Destroy the multi-draw indirect buffers -------------------*/
+void UDestroyIndirectDraws()
+{
+    glDeleteBuffers(1, &gIndirectCommandBuffer);
+    glDeleteBuffers(1, &gIndirectDrawBuffer);
+}
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureOrange);
 
-    // Draw the tea cylinder
-    glDrawElements(GL_TRIANGLES, sphere1.getIndexCount(), GL_UNSIGNED_INT, NULL);
 
-    // set lighting components back to normal
-    glUniform3f(ambientStrengthLoc, gAmbientStrength.r, gAmbientStrength.g, gAmbientStrength.b);
-    glUniform1f(specularIntensityLoc, gSpecularIntensity);
+/* ------------------- Build the instanced path buffers -------------------*/
+// One InstanceData per scene object, two while its LOD blends, grouped by
+// texture set and mesh so that every combination is a single instanced draw.
+// Materials are shared: one entry per distinct material.
+bool UCreateInstancedDraws()
+{
+    if (!UCreateShaderProgram(instancedVertexShaderSource, instancedFragmentShaderSource, gInstancedProgramId, lightingShaderSource, vertexShaderPrefix))
+        return false;
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    vector<InstanceMaterial> materials;
+    for (size_t i = 0; i < gSceneObjects.size(); ++i)
+    {
+        SceneObject& object = gSceneObjects[i];
+        const DrawUniforms& slot = gMaterials[object.material];
+
+        InstanceMaterial material;
+        material.ambientStrength = slot.ambientStrength;
+        material.specularIntensity = slot.specularIntensity;
+        material.multipleTextures = slot.multipleTextures;
+        material.padding[0] = material.padding[1] = material.padding[2] = 0;
+
+        // a handful of combinations, however many objects share them
+        size_t m = 0;
+        while (m < materials.size() && memcmp(&materials[m], &material, sizeof(material)) != 0)
+            ++m;
+        if (m == materials.size())
+            materials.push_back(material);
+        object.instanceMaterial = (GLint)m;
+    }
 
+    glGenBuffers(1, &gInstanceMaterialBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gInstanceMaterialBuffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(InstanceMaterial), materials.data(), 0);
+
+    // room for every object to blend at once; updated in place by UWriteInstances
+    gInstanceCapacity = (GLsizei)gSceneObjects.size() * 2;
+    glGenBuffers(1, &gInstanceBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gInstanceBuffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, gInstanceCapacity * sizeof(InstanceData), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    UWriteInstances();
+
+    glUseProgram(gInstancedProgramId);
+    glUniform1i(glGetUniformLocation(gInstancedProgramId, "uTexture"), 0);
+    glUniform1i(glGetUniformLocation(gInstancedProgramId, "uTextureExtra"), 1);
+    glUniform2fv(glGetUniformLocation(gInstancedProgramId, "uvScale"), 1, glm::value_ptr(gUVScale));
+    glUniform1i(glGetUniformLocation(gInstancedProgramId, "octahedralNormals"), gGeometry.getVertexFormat().attributes[1].components == 2);
+    gInstancedFirstLoc = glGetUniformLocation(gInstancedProgramId, "firstInstance");
+    gInstancedOffsetLoc = glGetUniformLocation(gInstancedProgramId, "positionOffset");
+    gInstancedScaleLoc = glGetUniformLocation(gInstancedProgramId, "positionScale");
+    glUseProgram(gProgramId);
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    return true;
 }
 
 
 
-/* ------------------- Set up GPU buffers for cup cylinder -------------------*/
-void setupCupBuffers(GLMesh& mesh)
+/* ------------------- Write the current instances, grouped by texture set and mesh -------------------*/
+void UWriteInstances()
 {
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormals = 3;
-    const GLuint floatsPerUV = 2;
-    const GLuint floatsInEachStride = 8;
+    PROFILE_ZONE("UWriteInstances");
 
-    glBindVertexArray(mesh.vao[0]); // activate vertex array object
+    // counting sort by texture set, then mesh: count, then hand out each
+    // combination's first slot
+    int meshCount = gGeometry.getMeshCount();
+    vector<GLint> batchFirst(gTextureSets.size() * meshCount + 1, 0);
+    for (size_t i = 0; i < gSceneObjects.size(); ++i)
+    {
+        if (!gVisible[i])
+            continue;
+        const SceneObject& object = gSceneObjects[i];
+        int meshes[2];
+        float fades[2];
+        int drawCount = UGetObjectDraws(object, meshes, fades);
+        for (int d = 0; d < drawCount; ++d)
+            ++batchFirst[object.textureSet * meshCount + meshes[d] + 1];
+    }
 
-    // Activates the first buffer
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);
-    // Sends vertex data to the GPU
-    glBufferData(GL_ARRAY_BUFFER, cylinder1.getInterleavedVertexSize(), cylinder1.getInterleavedVertices(), GL_STATIC_DRAW);
+    gInstanceBatches.clear();
+    gInstancedTriangles = 0;
+    for (size_t key = 0; key + 1 < batchFirst.size(); ++key)
+    {
+        GLsizei count = batchFirst[key + 1];
+        batchFirst[key + 1] += batchFirst[key];
+        if (count == 0)
+            continue;
+
+        InstanceBatch batch;
+        batch.textureSet = (int)key / meshCount;
+        batch.mesh = (int)key % meshCount;
+        batch.firstInstance = batchFirst[key];
+        batch.instanceCount = count;
+        gInstanceBatches.push_back(batch);
+        gInstancedTriangles += (unsigned long long)gGeometry.getMesh(batch.mesh).triangleCount * count;
+    }
 
-    // activate second buffer for index array
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
-    // stores indices[] array on GPU
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinder1.getIndexSize(), cylinder1.getIndices(), GL_STATIC_DRAW);
+    vector<InstanceData> instances(batchFirst.back());
+    for (size_t i = 0; i < gSceneObjects.size(); ++i)
+    {
+        if (!gVisible[i])
+            continue;
+        const SceneObject& object = gSceneObjects[i];
+
+        int meshes[2];
+        float fades[2];
+        int drawCount = UGetObjectDraws(object, meshes, fades);
+        for (int d = 0; d < drawCount; ++d)
+        {
+            InstanceData& instance = instances[batchFirst[object.textureSet * meshCount + meshes[d]]++];
+            instance.radiusScale = object.radiusScale;
+            instance.lodFade = fades[d];
+            instance.material = object.instanceMaterial;
+            instance.transform = (GLint)i;
+            instance.padding = 0;
+        }
+    }
 
-    // Strides between vertex coordinates
-    GLint stride = cylinder1.getInterleavedStride();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gInstanceBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    // Create Vertex Attribute Pointers
-    // position attribute -- instructs GPU how to handle vertex position data
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0); // enables the vertex attribute array numbered 0
-    // normals attribute -- instructs GPU how to handle normals data
-    glVertexAttribPointer(1, floatsPerNormals, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1); // enables the vertex attribute array numbered 0
-    // texture coordinate attribute -- instructs GPU how to handle texture coordinates
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2); // enables the vertex attribute array numbered 0
+    gInstancesDirty = false;
 }
 
 
 
-/* ------------------- Set up GPU buffers for plane -------------------*/
-void setupPlaneBuffers(GLMesh& mesh) {
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormals = 3;
-    const GLuint floatsPerUV = 2;
-    const GLuint floatsInEachStride = 8;
-
-    glBindVertexArray(mesh.vao[1]); // activate vertex array object
+/* ------------------- Submit the scene with one instanced draw per texture set and mesh -------------------*/
+void URenderInstanced()
+{
+    glUseProgram(gInstancedProgramId);
 
-    // Activates the first buffer
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[2]);
-    // Sends vertex data to the GPU
-    glBufferData(GL_ARRAY_BUFFER, plane1.verts.size() * sizeof(float), plane1.verts.data(), GL_STATIC_DRAW);
+    // LOD levels changed or blends moved on since the last write
+    if (gInstancesDirty)
+        UWriteInstances();
+    gFrameTriangles += gInstancedTriangles;
 
-    // Strides between vertex coordinates
-    GLint stride = sizeof(float) * (floatsInEachStride);// The number of floats before each
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_STORAGE_BINDING, gInstanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_STORAGE_BINDING, gInstanceMaterialBuffer);
 
-    // Create Vertex Attribute Pointers
-    // instructs GPU how to handle vertex buffer object data
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0); // enables the vertex attribute array numbered 0
-    // normals attribute -- instructs GPU how to handle normals data
-    glVertexAttribPointer(1, floatsPerNormals, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1); // enables the vertex attribute array numbered 0
-    // texture coordinate attribute -- instructs GPU how to handle texture coordinates
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormals)));
-    glEnableVertexAttribArray(2); // enables the vertex attribute array numbered 0
+    // the shared arena VAO is bound by URender; the call count follows the
+    // number of texture set and mesh combinations, not the number of objects.
+    // Batches are sorted by set, so each set is bound once
+    int boundSet = -1;
+    for (size_t i = 0; i < gInstanceBatches.size(); ++i)
+    {
+        const InstanceBatch& batch = gInstanceBatches[i];
+        if (batch.textureSet != boundSet)
+        {
+            UBindTextureSet(batch.textureSet);
+            boundSet = batch.textureSet;
+        }
+        const VertexDecode& decode = gGeometry.getMesh(batch.mesh).decode;
+        glUniform3fv(gInstancedOffsetLoc, 1, decode.offset);
+        glUniform3fv(gInstancedScaleLoc, 1, decode.scale);
+        glUniform1i(gInstancedFirstLoc, batch.firstInstance);
+        gGeometry.drawInstanced(batch.mesh, batch.instanceCount);
+    }
 }
 
 
-/* ------------------- Set up GPU buffers for cup handle cubes -------------------*/
-void setupHandleBuffers(GLMesh& mesh) {
-
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormals = 3;
-    const GLuint floatsPerUV = 2;
-    const GLuint floatsInEachStride = 8;
 
-    glBindVertexArray(mesh.vao[2]); // activate vertex array object
-
-    // Activates the first buffer
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[3]);
-    // Sends vertex data to the GPU
-    glBufferData(GL_ARRAY_BUFFER, cube1.verts.size() * sizeof(float), cube1.verts.data(), GL_STATIC_DRAW);
-
-    // Strides between vertex coordinates
-    GLint stride = sizeof(float) * (floatsInEachStride);// The number of floats before each
-
-    // Create Vertex Attribute Pointers
-    // instructs GPU how to handle vertex buffer object data
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0); // enables the vertex attribute array numbered 0
-    // normals attribute -- instructs GPU how to handle normals data
-    glVertexAttribPointer(1, floatsPerNormals, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1); // enables the vertex attribute array numbered 0
-    // texture coordinate attribute -- instructs GPU how to handle texture coordinates
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormals)));
-    glEnableVertexAttribArray(2); // enables the vertex attribute array numbered 2
+/* ------------------- Destroy the instanced path buffers -------------------*/
+void UDestroyInstancedDraws()
+{
+    glDeleteBuffers(1, &gInstanceBuffer);
+    glDeleteBuffers(1, &gInstanceMaterialBuffer);
 }
 
 
-/* ------------------- Set up GPU buffers for tea cylinder -------------------*/
-void setupTeaBuffers(GLMesh& mesh)
+
+/* ------------------- Submit the visible objects one draw each, in state order -------------------*/
+// Every visible object is queued under a key of the program, vertex array,
+// texture set and material it needs and its view depth. Once sorted, a draw only
+// sets the state that differs from the draw before it, and objects sharing state
+// are drawn front to back so the depth test rejects hidden fragments early
+void URenderForward(const glm::mat4& view)
 {
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormals = 3;
-    const GLuint floatsPerUV = 2;
-    const GLuint floatsInEachStride = 8;
+    {
+        PROFILE_ZONE("queue");
+        gRenderQueue.clear();
+        for (size_t i = 0; i < gSceneObjects.size(); ++i)
+        {
+            if (!gVisible[i])
+                continue;
+            const SceneObject& object = gSceneObjects[i];
+            float depth = -(view * object.model[3]).z;
+            gRenderQueue.push(URenderKey(FORWARD_PROGRAM_KEY, ARENA_VERTEX_ARRAY_KEY, object.textureSet, object.material, depth), (int)i);
+        }
+        gRenderQueue.sort();
+    }
+
+    gFrameStateChanges = 0;
+    gFrameStatesAvoided = 0;
+    uint64_t boundKey = 0;
+    for (int q = 0; q < gRenderQueue.size(); ++q)
+    {
+        // URender has bound the arena's vertex array; nothing else is known at the first draw
+        uint64_t key = gRenderQueue.getKey(q);
+        unsigned int changes = q == 0 ? RENDER_STATE_ALL & ~RENDER_STATE_VERTEX_ARRAY : URenderKeyChanges(boundKey, key);
+        boundKey = key;
+
+        if (changes & RENDER_STATE_PROGRAM)
+            glUseProgram(gProgramId);
+        if (changes & RENDER_STATE_VERTEX_ARRAY)
+            gGeometry.bind();
+        if (changes & RENDER_STATE_TEXTURE_SET)
+            UBindTextureSet(URenderKeyTextureSet(key));
+        if (changes & RENDER_STATE_MATERIAL)
+            UBindDrawUniforms(URenderKeyMaterial(key));
+        for (int state = 0; state < RENDER_STATE_COUNT; ++state)
+        {
+            if (changes & (1u << state))
+                ++gFrameStateChanges;
+            else
+                ++gFrameStatesAvoided;
+        }
 
-    glBindVertexArray(mesh.vao[3]); // activate vertex array object
+        int item = gRenderQueue.getItem(q);
+        const SceneObject& object = gSceneObjects[item];
+        PROFILE_ZONE(object.name);
+        GPU_TIMER_BEGIN_PASS(object.gpuTimerPass);
 
-    // Activates the first buffer
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[4]);
-    // Sends vertex data to the GPU
-    glBufferData(GL_ARRAY_BUFFER, cylinder2.getInterleavedVertexSize(), cylinder2.getInterleavedVertices(), GL_STATIC_DRAW);
+        // Point at this object's transforms and set its cylinder taper
+        glUniform1i(gTransformLoc, item);
+        USetRadiusScale(object.radiusScale);
 
-    // activate second buffer for index array
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[5]);
-    // stores indices[] array on GPU
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinder2.getIndexSize(), cylinder2.getIndices(), GL_STATIC_DRAW);
+        // one mesh, or the two levels of a LOD blend
+        int meshes[2];
+        float fades[2];
+        int drawCount = UGetObjectDraws(object, meshes, fades);
+        for (int d = 0; d < drawCount; ++d)
+        {
+            const MeshRange& range = gGeometry.getMesh(meshes[d]);
+            USetPositionDecode(range.decode);
+            USetLodFade(fades[d]);
+            gGeometry.draw(meshes[d]);
+            gFrameTriangles += range.triangleCount;
+        }
+        GPU_TIMER_END();
+    }
+}
 
-    // The number of floats that make up a block of vertex data. Should be 32 bytes
-    GLint stride = cylinder2.getInterleavedStride();
 
-    // Create Vertex Attribute Pointers
-    // position attribute -- instructs GPU how to handle vertex position data
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0); // enables the vertex attribute array numbered 0
-    // normals attribute -- instructs GPU how to handle normals data
-    glVertexAttribPointer(1, floatsPerNormals, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1); // enables the vertex attribute array numbered 0
-    // texture coordinate attribute -- instructs GPU how to handle texture coordinates
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2); // enables the vertex attribute array numbered 0
 
+/* ------------------- Bind a texture set on units 0 and 1 -------------------*/
+void UBindTextureSet(int textureSet)
+{
+    const TextureSet& textures = gTextureSets[textureSet];
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textures.texture);
+    // single texture materials never sample unit 1, so whatever it holds stays
+    if (textures.extraTexture != 0)
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, textures.extraTexture);
+    }
 }
 
 
-/* ------------------- Set up GPU buffers for orange sphere -------------------*/
-void setupSphereBuffers(GLMesh& mesh)
+
+/* ------------------- Fill a cafe with copies of the tableware -------------------*/
+// settings copies of every object standing on the table (not the table and
+// cloth planes), laid out on a square grid around the original one, each
+// turned and nudged by a fixed-seed generator so that every run draws the
+// same scene
+void UCreateStressScene(int settings)
 {
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormals = 3;
-    const GLuint floatsPerUV = 2;
-    const GLuint floatsInEachStride = 8;
+    PROFILE_ZONE("UCreateStressScene");
 
-    glBindVertexArray(mesh.vao[4]); // activate vertex array object
+    size_t templateCount = gSceneObjects.size();
+    gSceneObjects.reserve(templateCount + (size_t)settings * templateCount);
 
-    // Activates the first buffer
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[6]);
-    // Sends vertex data to the GPU
-    glBufferData(GL_ARRAY_BUFFER, sphere1.getInterleavedVertexSize(), sphere1.getInterleavedVertices(), GL_STATIC_DRAW);
+    // mt19937 output is specified by the standard, unlike its distributions
+    std::mt19937 random(2024);
+    auto unit = [&random]() { return (random() >> 8) * (1.0f / 16777216.0f); };
 
-    // activate second buffer for index array
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[7]);
-    // stores indices[] array on GPU
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphere1.getIndexSize(), sphere1.getIndices(), GL_STATIC_DRAW);
+    int side = (int)ceil(sqrt((double)settings + 1.0));
+    int placed = 0;
+    for (int cell = 0; cell < side * side && placed < settings; ++cell)
+    {
+        int row = cell / side - side / 2;
+        int column = cell % side - side / 2;
+        if (row == 0 && column == 0)
+            continue;   // the original setting
 
-    // Strides between vertex coordinates
-    GLint stride = sphere1.getInterleavedStride();
+        glm::vec3 offset(column * STRESS_SPACING + (unit() - 0.5f), 0.0f, row * STRESS_SPACING + (unit() - 0.5f));
+        glm::mat4 setting = glm::translate(glm::mat4(1.0f), offset);
+        setting = glm::rotate(setting, unit() * 6.2831853f, glm::vec3(0.0f, 1.0f, 0.0f));
 
-    // Create Vertex Attribute Pointers
-    // position attribute -- instructs GPU how to handle vertex position data
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0); // enables the vertex attribute array numbered 0
-    // normals attribute -- instructs GPU how to handle normals data
-    glVertexAttribPointer(1, floatsPerNormals, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1); // enables the vertex attribute array numbered 0
-    // texture coordinate attribute -- instructs GPU how to handle texture coordinates
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2); // enables the vertex attribute array numbered 0
+        for (size_t i = 0; i < templateCount; ++i)
+        {
+            if (gSceneObjects[i].mesh == gPlaneMesh)
+                continue;
+            SceneObject copy = gSceneObjects[i];
+            copy.model = setting * copy.model;
+            gSceneObjects.push_back(copy);
+        }
+        ++placed;
+    }
+    cout << "INFO: Stress scene: " << placed << " place settings, " << gSceneObjects.size() << " objects" << endl;
 }
 
 
-/* ------------------- Set up GPU buffers for plate cylinder -------------------*/
-void setupPlateBuffers(GLMesh& mesh)
-{
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormals = 3;
-    const GLuint floatsPerUV = 2;
-    const GLuint floatsInEachStride = 8;
 
-    glBindVertexArray(mesh.vao[5]); // activate vertex array object
+/* ------------------- World bounds of every scene object -------------------*/
+// Every model matrix is baked into the bounds here; UMoveObject bakes it again
+void UCreateCullBounds()
+{
+    PROFILE_ZONE("UCreateCullBounds");
 
-    // Activates the first buffer
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[8]);
-    // Sends vertex data to the GPU
-    glBufferData(GL_ARRAY_BUFFER, cylinder3.getInterleavedVertexSize(), cylinder3.getInterleavedVertices(), GL_STATIC_DRAW);
+    gCullBounds.clear();
+    gSceneBvh.clear();
+    for (size_t i = 0; i < gSceneObjects.size(); ++i)
+    {
+        // every LOD level lies within the bounds of the shape's own mesh
+        const SceneObject& object = gSceneObjects[i];
+        const MeshRange& range = gGeometry.getMesh(object.mesh);
+        gCullBounds.add(range.boundsMin, range.boundsMax, range.boundsRadius, object.model);
+
+        // picks hit the analytic shape the mesh approximates; cubes and planes are their box
+        PickVolume volume;
+        volume.shape = object.pickShape;
+        memcpy(volume.boundsMin, range.boundsMin, sizeof(volume.boundsMin));
+        memcpy(volume.boundsMax, range.boundsMax, sizeof(volume.boundsMax));
+        volume.boundsRadius = range.boundsRadius;
+        volume.radiusScale = object.radiusScale;
+        gSceneBvh.add(volume, object.model);
+    }
+    gVisible.assign(gSceneObjects.size(), 1);
+    gFrameVisible = (int)gSceneObjects.size();
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    gSceneBvh.build();
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    cout << "INFO: Scene BVH: " << gSceneBvh.size() << " objects, " << gSceneBvh.getNodeCount() << " nodes, depth "
+        << gSceneBvh.getDepth() << ", built in " << buildMs << " ms" << endl;
+}
 
-    // activate second buffer for index array
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[9]);
-    // stores indices[] array on GPU
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinder3.getIndexSize(), cylinder3.getIndices(), GL_STATIC_DRAW);
 
-    // The number of floats that make up a block of vertex data. Should be 32 bytes
-    GLint stride = cylinder3.getInterleavedStride();
 
-    // Create Vertex Attribute Pointers
-    // position attribute -- instructs GPU how to handle vertex position data
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0); // enables the vertex attribute array numbered 0
-    // normals attribute -- instructs GPU how to handle normals data
-    glVertexAttribPointer(1, floatsPerNormals, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1); // enables the vertex attribute array numbered 0
-    // texture coordinate attribute -- instructs GPU how to handle texture coordinates
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2); // enables the vertex attribute array numbered 0
+/* ------------------- Drop the objects outside the view frustum -------------------*/
+// Returns true when the set of visible objects changed since the last frame
+bool UCullObjects(const glm::mat4& viewProjection)
+{
+    PROFILE_ZONE("UCullObjects");
 
-}
+    if (!gCullEnabled)
+        return false;
 
+    // batches of 4 or 8 objects per plane test, or whole subtrees of the
+    // hierarchy at once, before anything reaches GL
+    static vector<unsigned char> visible;
+    visible.resize(gVisible.size());
+    if (gCullWithBvh)
+        gFrameVisible = gSceneBvh.cull(viewProjection, visible.data());
+    else
+        gFrameVisible = gCullBounds.cull(viewProjection, visible.data());
 
+    if (visible == gVisible)
+        return false;
+    gVisible.swap(visible);
+    return true;
+}
 
-/* ------------------- Create plane mesh -------------------*/
-void createPlaneMesh() {
-    // Position data  for plane
-    vector<float> verts = {
 
-        // position           // normal           // tex coordinate
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
-    };
 
-    // populate plane1 struct with this mesh data
-    verts.swap(plane1.verts);
+/* ------------------- Transform storage of every scene object -------------------*/
+void UCreateTransforms()
+{
+    gTransformBatch.clear();
+    for (size_t i = 0; i < gSceneObjects.size(); ++i)
+        gTransformBatch.add(gSceneObjects[i].model);
+
+    // only this pipeline uses the binding, so it is bound once
+    glGenBuffers(1, &gTransformBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gTransformBuffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, (gSceneObjects.empty() ? 1 : gSceneObjects.size()) * sizeof(ObjectTransform), NULL, GL_DYNAMIC_STORAGE_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRANSFORM_STORAGE_BINDING, gTransformBuffer);
+
+    // the whole static scene, the only time it is computed
+    int count = gTransformBatch.size();
+    UUpdateTransforms();
+    cout << "INFO: Transforms: " << count << " objects, " << count * sizeof(ObjectTransform) / 1024.0f << " KB uploaded once" << endl;
 }
 
 
 
-/* ------------------- Create cube mesh -------------------*/
-void createCubeMesh() {
-
-    vector<float> verts = {
+/* ------------------- Recompute and upload the transforms of moved objects -------------------*/
+// Nothing to do for a static scene; the camera only reaches the vertex
+// shaders through the frame block's viewProjection
+void UUpdateTransforms()
+{
+    gFrameTransformUpdates = gTransformBatch.update();
+    if (gFrameTransformUpdates == 0)
+        return;
+
+    PROFILE_ZONE("UUpdateTransforms");
+    // one upload per run of moved objects; the static ones between them stay
+    const vector<TransformBatch::Range>& ranges = gTransformBatch.getChangedRanges();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gTransformBuffer);
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        int first = ranges[i].first;
+        int count = ranges[i].end - first;
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(ObjectTransform), count * sizeof(ObjectTransform),
+            gTransformBatch.getTransforms() + first);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
 
-        // positions          // normals           // texture coords
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
 
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
 
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
+/* ------------------- Move one scene object -------------------*/
+// Everything that holds the object's model matrix: the object itself (sort
+// depth, LOD), its cached transform, its cull bounds and its BVH leaf. The
+// tree is refit once per frame in URender, however many objects moved
+void UMoveObject(int index, const glm::mat4& model)
+{
+    SceneObject& object = gSceneObjects[index];
+    const MeshRange& range = gGeometry.getMesh(object.mesh);
+    object.model = model;
+    gTransformBatch.setModel(index, model);
+    gCullBounds.set(index, range.boundsMin, range.boundsMax, range.boundsRadius, model);
+    gSceneBvh.setTransform(index, model);
+}
 
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
 
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
 
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
-    };
+/* ------------------- Turn the first --spin objects in place -------------------*/
+// A steady stream of moving objects: each turns about the vertical axis
+// through its origin at a radian per second
+void USpinObjects(float deltaTime)
+{
+    int count = min(gSpinningObjects, (int)gSceneObjects.size());
+    if (count <= 0)
+        return;
 
-    // populate cube1 struct with this mesh data
-    verts.swap(cube1.verts);
+    PROFILE_ZONE("USpinObjects");
+    glm::mat4 turn = glm::rotate(glm::mat4(1.0f), deltaTime, glm::vec3(0.0f, 1.0f, 0.0f));
+    for (int i = 0; i < count; ++i)
+    {
+        const glm::mat4& model = gSceneObjects[i].model;
+        glm::vec3 origin(model[3]);
+        UMoveObject(i, glm::translate(glm::mat4(1.0f), origin) * turn * glm::translate(glm::mat4(1.0f), -origin) * model);
+    }
 }
 
 
 
-/* ------------------- Destroy VAOs and VBOs -------------------*/
-void UDestroyMesh(GLMesh& mesh)
+/* ------------------- Destroy the transform storage -------------------*/
+void UDestroyTransforms()
 {
-    // delete the VAOs
-    glDeleteVertexArrays(6, mesh.vao);
-    // delete the VBOs
-    glDeleteBuffers(8, mesh.vbos);
+    glDeleteBuffers(1, &gTransformBuffer);
 }
 
 
 
-/* ------------------- Generate and load the texture -------------------*/
-bool UCreateTexture(const char* filename, GLuint& textureId, int textureUnit)
+/* ------------------- Upload every light: the scene's, then extra ones -------------------*/
+// The extra lights are seeded, small and warm, like candles and lamps.
+// They keep one light per EXTRA_LIGHT_AREA square units, like the tables of
+// a cafe, so adding lights widens the lit area instead of piling them up
+// over the table; at least the table or the stress scene is covered. The
+// light sweep calls this again for each count
+void UCreateLights(int extra)
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
+    gLightClusters.clear();
+    const SceneLightDesc* lights = gScene.getLights();
+    for (int i = 0; i < gScene.getLightCount(); ++i)
     {
-        flipImageVertically(image, width, height, channels);
+        ClusterLight light;
+        light.positionRange = glm::vec4(glm::make_vec3(lights[i].position), lights[i].range);
+        light.colorStrength = glm::vec4(glm::make_vec3(lights[i].color), lights[i].strength);
+        gLightClusters.add(light);
+    }
 
-        switch (textureUnit)
-        {
-        case 0:
-        {
-            glActiveTexture(GL_TEXTURE0);
-        }
-        break;
+    // mt19937 output is specified by the standard, unlike its distributions
+    std::mt19937 random(1701);
+    auto unit = [&random]() { return (random() >> 8) * (1.0f / 16777216.0f); };
+    const float EXTRA_LIGHT_AREA = 4.0f;
+    float extent = (float)ceil(sqrt((double)gStressSettings + 1.0)) * STRESS_SPACING * 0.5f;
+    extent = max(max(extent, 8.0f), sqrt(extra * EXTRA_LIGHT_AREA) * 0.5f);
+    for (int i = 0; i < extra; ++i)
+    {
+        glm::vec3 position((unit() * 2.0f - 1.0f) * extent, -0.3f + unit() * 2.5f, (unit() * 2.0f - 1.0f) * extent);
+        ClusterLight light;
+        light.positionRange = glm::vec4(position, 1.5f + unit() * 2.5f);
+        light.colorStrength = glm::vec4(1.0f, 0.55f + unit() * 0.3f, 0.2f + unit() * 0.3f, 1.0f + unit() * 2.0f);
+        gLightClusters.add(light);
+    }
 
-        case 1:
-        {
-            glActiveTexture(GL_TEXTURE1);
-        }
-        break;
+    // the lights are written only here; the cluster lists every frame
+    if (gLightBuffer == 0)
+    {
+        glGenBuffers(1, &gLightBuffer);
+        glGenBuffers(1, &gClusterBuffer);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gLightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (gLightClusters.size() > 0 ? gLightClusters.size() : 1) * sizeof(ClusterLight),
+        gLightClusters.size() > 0 ? gLightClusters.getLights() : NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_STORAGE_BINDING, gLightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_STORAGE_BINDING, gClusterBuffer);
+
+    cout << "INFO: Lights: " << gScene.getLightCount() << " from the scene, " << extra << " extra, "
+        << (gLightClusters.isClustered() ? "clustered " : "clusters off, ") << LIGHT_CLUSTERS_X << "x" << LIGHT_CLUSTERS_Y << "x" << LIGHT_CLUSTERS_Z << endl;
+}
 
-        default:
-            glActiveTexture(GL_TEXTURE0);
-            break;
-        }
 
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
 
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+/* ------------------- List the lights of every cluster of this view -------------------*/
+// The lists change length every frame, so the buffer is orphaned and refilled
+void UAssignLights(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    PROFILE_ZONE("UAssignLights");
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    gLightClusters.assign(view, projection, nearPlane, farPlane);
+    const vector<unsigned int>& data = gLightClusters.getData();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gClusterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(unsigned int), data.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    gFrameClusterMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
 
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
 
-        glGenerateMipmap(GL_TEXTURE_2D);
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+/* ------------------- Destroy the light and cluster storage -------------------*/
+void UDestroyLights()
+{
+    glDeleteBuffers(1, &gLightBuffer);
+    glDeleteBuffers(1, &gClusterBuffer);
+}
+
+
 
-        return true;
-    }
+/* ------------------- Build the lighting pass of the deferred path -------------------*/
+// The G-buffer itself is created by the first geometry pass, at the viewport's size
+bool UCreateDeferredShading()
+{
+    if (!UCreateShaderProgram(deferredVertexShaderSource, deferredFragmentShaderSource, gDeferredProgramId, lightingShaderSource))
+        return false;
+
+    // the targets sit on the units after the scene textures, in GBufferTarget order
+    const char* samplers[GBUFFER_TARGET_COUNT] = { "gbufferAlbedo", "gbufferNormal", "gbufferMaterial", "gbufferDepth" };
+    glUseProgram(gDeferredProgramId);
+    for (int i = 0; i < GBUFFER_TARGET_COUNT; ++i)
+        glUniform1i(glGetUniformLocation(gDeferredProgramId, samplers[i]), GBUFFER_FIRST_UNIT + i);
+    gInverseViewProjectionLoc = glGetUniformLocation(gDeferredProgramId, "inverseViewProjection");
+    glUseProgram(gProgramId);
 
-    // Error loading the image
-    return false;
+    // core profile needs a vertex array bound to draw, even without attributes
+    glGenVertexArrays(1, &gDeferredVao);
+    return true;
 }
 
 
-/* ------------------- Deletes a texture -------------------*/
-void UDestroyTexture(GLuint textureId)
+
+/* ------------------- Pick forward or deferred shading -------------------*/
+// Every object program has both outputs; geometryPass picks one
+void USetShading(ShadingMode shading)
 {
-    glGenTextures(1, &textureId);
+    gShading = shading;
+    GLint geometryPass = shading == SHADING_DEFERRED;
+    glProgramUniform1i(gProgramId, glGetUniformLocation(gProgramId, "geometryPass"), geometryPass);
+    if (gIndirectProgramId != 0)
+        glProgramUniform1i(gIndirectProgramId, glGetUniformLocation(gIndirectProgramId, "geometryPass"), geometryPass);
+    if (gInstancedProgramId != 0)
+        glProgramUniform1i(gInstancedProgramId, glGetUniformLocation(gInstancedProgramId, "geometryPass"), geometryPass);
 }
 
 
-/* ------------------- Flip image vertically -------------------*/
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
+
+/* ------------------- Start the geometry pass -------------------*/
+// (Re)creates the G-buffer when the viewport changed size. Returns false, and
+// goes back to forward shading, when it cannot be created
+bool UBeginGeometryPass()
 {
-    for (int j = 0; j < height / 2; ++j)
+    if (gGBuffer.getWidth() != gViewportWidth || gGBuffer.getHeight() != gViewportHeight)
     {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-
-        for (int i = width * channels; i > 0; --i)
+        gGBuffer.destroy();
+        if (!gGBuffer.create(gViewportWidth, gViewportHeight))
         {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
+            cout << "Deferred shading unavailable, using forward shading" << endl;
+            USetShading(SHADING_FORWARD);
+            return false;
         }
     }
+    gGBuffer.beginGeometry();
+    return true;
 }
 
 
-/* ------------------- Create the shader program from the vertex and fragment shader sources -------------------*/
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+
+/* ------------------- Light the G-buffer in one fullscreen pass -------------------*/
+void URenderDeferredLighting(const glm::mat4& viewProjection)
 {
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512]; // create character string of length 512 for the error log
+    gGBuffer.beginLighting(GBUFFER_FIRST_UNIT);
+
+    // every pixel is written once, so the output's depth is not needed
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(gDeferredProgramId);
+    glUniformMatrix4fv(gInverseViewProjectionLoc, 1, GL_FALSE, glm::value_ptr(glm::inverse(viewProjection)));
+    glBindVertexArray(gDeferredVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+    glUseProgram(gProgramId);
+}
 
-    // Create a Shader program object.
-    programId = glCreateProgram();
 
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
 
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+/* ------------------- Destroy the G-buffer and the lighting pass -------------------*/
+void UDestroyDeferredShading()
+{
+    gGBuffer.destroy();
+    glDeleteVertexArrays(1, &gDeferredVao);
+}
 
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 
-        return false;
-    }
 
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+/* ------------------- Pick the object under a window position -------------------*/
+// Casts a ray through the last frame's view and prints what it hits first.
+// Returns the scene object's index, -1 for none
+int UPickObject(float x, float y, float width, float height)
+{
+    PROFILE_ZONE("UPickObject");
+
+    glm::vec3 origin, direction;
+    UCursorRay(gViewProjection, x, y, width, height, origin, direction);
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    float distance = 0.0f;
+    int object = gSceneBvh.pick(origin, direction, 1.0f, &distance);
+    double pickUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (object < 0)
+        cout << "Picked nothing (" << pickUs << " us)" << endl;
+    else
+        cout << "Picked " << gSceneObjects[object].name << " (object " << object << ") at "
+            << distance * glm::length(direction) << " units in " << pickUs << " us" << endl;
+    return object;
+}
 
-        return false;
-    }
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+/* ------------------- Destroy uniform buffers -------------------*/
+void UDestroyUniformBuffers()
+{
+    glDeleteBuffers(1, &gFrameUbo);
+    glDeleteBuffers(1, &gDrawUbo);
+}
 
-        return false;
-    }
 
-    glUseProgram(programId);    // Uses the shader program
 
-    return true;
+/* ------------------- Point the forward program at a LOD blend mask -------------------*/
+void USetLodFade(float fade)
+{
+    // 1 outside of blends, so almost never changes
+    if (fade == gBoundLodFade)
+        return;
+
+    glUniform1f(gLodFadeLoc, fade);
+    gBoundLodFade = fade;
 }
 
 
 
-/* ------------------- Destroy shader program -------------------*/
-void UDestroyShaderProgram(GLuint programId)
+/* ------------------- Point the forward program at a cylinder taper -------------------*/
+void USetRadiusScale(const glm::vec2& radiusScale)
 {
-    glDeleteProgram(programId); // delete the shader program
+    if (radiusScale == gBoundRadiusScale)
+        return;
+
+    glUniform2fv(gRadiusScaleLoc, 1, glm::value_ptr(radiusScale));
+    gBoundRadiusScale = radiusScale;
 }
 
 
 
-// FOR DEBUGGING
-void APIENTRY glDebugOutput(GLenum source,
-    GLenum type,
-    unsigned int id,
-    GLenum severity,
-    GLsizei length,
-    const char* message,
-    const void* userParam)
+/* ------------------- Pick the level of detail of every object -------------------*/
+// Returns true when any object's draws changed since the last frame
+bool UUpdateLods(const glm::mat4& view, const glm::mat4& projection)
 {
-    // ignore non-significant error/warning codes
-    if (id == 131169 || id == 131185 || id == 131218 || id == 131204) return;
-
-    std::cout << "---------------" << std::endl;
-    std::cout << "Debug message (" << id << "): " << message << std::endl;
+    PROFILE_ZONE("UUpdateLods");
 
-    switch (source)
+    bool changed = false;
+    for (size_t i = 0; i < gSceneObjects.size(); ++i)
     {
-    case GL_DEBUG_SOURCE_API:             std::cout << "Source: API"; break;
-    case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   std::cout << "Source: Window System"; break;
-    case GL_DEBUG_SOURCE_SHADER_COMPILER: std::cout << "Source: Shader Compiler"; break;
-    case GL_DEBUG_SOURCE_THIRD_PARTY:     std::cout << "Source: Third Party"; break;
-    case GL_DEBUG_SOURCE_APPLICATION:     std::cout << "Source: Application"; break;
-    case GL_DEBUG_SOURCE_OTHER:           std::cout << "Source: Other"; break;
-    } std::cout << std::endl;
+        SceneObject& object = gSceneObjects[i];
+        if (object.lod < 0)
+            continue;
+        // off-screen: forget the level, so the object snaps to the right one
+        // instead of blending when it comes back into view
+        if (!gVisible[i])
+        {
+            object.lodState.level = -1;
+            continue;
+        }
 
-    switch (type)
-    {
-    case GL_DEBUG_TYPE_ERROR:               std::cout << "Type: Error"; break;
-    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: std::cout << "Type: Deprecated Behaviour"; break;
-    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  std::cout << "Type: Undefined Behaviour"; break;
-    case GL_DEBUG_TYPE_PORTABILITY:         std::cout << "Type: Portability"; break;
-    case GL_DEBUG_TYPE_PERFORMANCE:         std::cout << "Type: Performance"; break;
-    case GL_DEBUG_TYPE_MARKER:              std::cout << "Type: Marker"; break;
-    case GL_DEBUG_TYPE_PUSH_GROUP:          std::cout << "Type: Push Group"; break;
-    case GL_DEBUG_TYPE_POP_GROUP:           std::cout << "Type: Pop Group"; break;
-    case GL_DEBUG_TYPE_OTHER:               std::cout << "Type: Other"; break;
-    } std::cout << std::endl;
+        // every level shares the bounds of the shape, so the base mesh stands for all
+        const MeshRange& range = gGeometry.getMesh(object.mesh);
+        float pixelRadius = UProjectedRadius(range.boundsMin, range.boundsMax, object.model, view, projection, (float)gViewportHeight);
+        if (gLodChains[object.lod].update(pixelRadius, gDeltaTime, object.lodState))
+            changed = true;
+    }
+    return changed;
+}
 
-    switch (severity)
-    {
-    case GL_DEBUG_SEVERITY_HIGH:         std::cout << "Severity: high"; break;
-    case GL_DEBUG_SEVERITY_MEDIUM:       std::cout << "Severity: medium"; break;
-    case GL_DEBUG_SEVERITY_LOW:          std::cout << "Severity: low"; break;
-    case GL_DEBUG_SEVERITY_NOTIFICATION: std::cout << "Severity: notification"; break;
-    } std::cout << std::endl;
-    std::cout << std::endl;
-}
\ No newline at end of file
+
+
+/* ------------------- The meshes an object draws this frame -------------------*/
+// One mesh with fade 1, or the incoming and outgoing levels of a LOD blend with
+// complementary fades. Returns the number of draws
+int UGetObjectDraws(const SceneObject& object, int meshes[2], float fades[2])
+{
+    meshes[0] = object.mesh;
+    fades[0] = 1.0f;
+    if (object.lod < 0 || object.lodState.level < 0)
+        return 1;
+
+    const LodChain& chain = gLodChains[object.lod];
+    const LodState& state = object.lodState;
+    meshes[0] = chain.getLevel(state.level).mesh;
+    if (state.fromLevel < 0)
+        return 1;
+
+    fades[0] = state.fade;
+    meshes[1] = chain.getLevel(state.fromLevel).mesh;
+    fades[1] = state.fade - 1.0f;
+    return 2;
+}
@@ -0,0 +1,134 @@
+// Author: Joshua Gauthier
+// Scoped CPU profiling zones with Chrome Trace Event export
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>         // cout
+
+#include "CpuProfiler.h"
+
+namespace
+{
+    // every ring ever created; pushed lock-free, never removed
+    std::atomic<ProfileRing*> gRings(nullptr);
+    std::atomic<uint32_t> gNextThreadId(1);
+
+    thread_local ProfileRing* tRing = nullptr;
+
+    const uint64_t gClockStart = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // a JSON string: zone names can come from the scene file, so quotes,
+    // backslashes and control characters are escaped
+    void UWriteJsonString(FILE* file, const char* text)
+    {
+        fputc('"', file);
+        for (const unsigned char* c = (const unsigned char*)text; *c != 0; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+                fprintf(file, "\\%c", *c);
+            else if (*c < 0x20)
+                fprintf(file, "\\u%04x", *c);
+            else
+                fputc(*c, file);
+        }
+        fputc('"', file);
+    }
+}
+
+
+/* ------------------- Monotonic time -------------------*/
+uint64_t CpuProfiler::now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() - gClockStart;
+}
+
+
+/* ------------------- The calling thread's ring -------------------*/
+ProfileRing* CpuProfiler::threadRing()
+{
+    if (tRing != nullptr)
+        return tRing;
+
+    // first zone on this thread: allocate and publish its ring
+    ProfileRing* ring = new ProfileRing;
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->threadName = nullptr;
+    ring->threadId = gNextThreadId.fetch_add(1, std::memory_order_relaxed);
+    ring->next = gRings.load(std::memory_order_relaxed);
+    while (!gRings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed))
+        ;
+
+    tRing = ring;
+    return ring;
+}
+
+
+/* ------------------- Append a zone -------------------*/
+void CpuProfiler::record(const char* name, uint64_t startNs, uint64_t endNs)
+{
+    ProfileRing* ring = threadRing();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+    ProfileEvent& event = ring->events[head & (ProfileRing::CAPACITY - 1)];
+    event.name = name;
+    event.startNs = startNs;
+    event.endNs = endNs;
+
+    // publish after the event is written
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+
+/* ------------------- Name the calling thread -------------------*/
+void CpuProfiler::setThreadName(const char* name)
+{
+    threadRing()->threadName = name;
+}
+
+
+/* ------------------- Export -------------------*/
+bool CpuProfiler::writeChromeTrace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        std::cout << "Failed to open " << path << " for the trace" << std::endl;
+        return false;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+
+    for (ProfileRing* ring = gRings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+    {
+        if (ring->threadName != nullptr)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                first ? "" : ",\n", ring->threadId);
+            UWriteJsonString(file, ring->threadName);
+            fprintf(file, "}}");
+            first = false;
+        }
+
+        // only the last CAPACITY events survive
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = head > ProfileRing::CAPACITY ? head - ProfileRing::CAPACITY : 0;
+
+        for (uint64_t i = begin; i < head; ++i)
+        {
+            const ProfileEvent& event = ring->events[i & (ProfileRing::CAPACITY - 1)];
+            // complete events, timestamps in microseconds
+            fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+            UWriteJsonString(file, event.name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                ring->threadId, event.startNs / 1000.0, (event.endNs - event.startNs) / 1000.0);
+            first = false;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
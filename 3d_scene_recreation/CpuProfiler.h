@@ -0,0 +1,76 @@
+// Author: Joshua Gauthier
+// Scoped CPU profiling zones with Chrome Trace Event export
+
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+
+// One closed zone
+struct ProfileEvent
+{
+    const char* name;       // must outlive the profiler (string literals, static names)
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+// Fixed-size ring owned by one thread. Only that thread writes; the exporter
+// reads up to the published head, so recording needs no lock. When the ring
+// is full the oldest events are overwritten
+struct ProfileRing
+{
+    static const uint32_t CAPACITY = 1 << 16;   // power of two
+
+    ProfileEvent events[CAPACITY];
+    std::atomic<uint64_t> head;     // events written so far
+    const char* threadName;
+    uint32_t threadId;
+    ProfileRing* next;              // registry of every thread's ring
+};
+
+// Static front end. Recording is a clock read on zone entry, a clock read and
+// one store on exit, cheap enough to stay on in release builds
+class CpuProfiler
+{
+public:
+    // nanoseconds on a monotonic clock
+    static uint64_t now();
+    // appends a zone to the calling thread's ring
+    static void record(const char* name, uint64_t startNs, uint64_t endNs);
+    // names the calling thread in the trace
+    static void setThreadName(const char* name);
+    // writes every ring in Chrome Trace Event format (chrome://tracing, Perfetto)
+    static bool writeChromeTrace(const char* path);
+
+private:
+    static ProfileRing* threadRing();
+};
+
+// Records the time between construction and destruction (or end())
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name) : name(name), startNs(CpuProfiler::now()), open(true) {}
+    ~ProfileZone() { end(); }
+
+    void end()
+    {
+        if (!open)
+            return;
+        CpuProfiler::record(name, startNs, CpuProfiler::now());
+        open = false;
+    }
+
+private:
+    const char* name;
+    uint64_t startNs;
+    bool open;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// profiles the rest of the enclosing scope
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+#endif
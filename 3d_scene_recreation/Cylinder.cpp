@@ -15,6 +15,7 @@
 #include <iomanip>
 #include <cmath>
 #include "Cylinder.h"
+#include "MeshKernels.h"
 
 
 
@@ -27,8 +28,10 @@ const int MIN_STACK_COUNT = 1;
 ///////////////////////////////////////////////////////////////////////////////
 // ctor
 ///////////////////////////////////////////////////////////////////////////////
-Cylinder::Cylinder(float baseRadius, float topRadius, float height, int sectors,
-    int stacks, bool smooth) : interleavedStride(32)
+template <class Format>
+BasicCylinder<Format>::BasicCylinder(float baseRadius, float topRadius, float height, int sectors,
+    int stacks, bool smooth, std::pmr::memory_resource* resource)
+    : strips(false), unitCircleVertices(resource), interleavedVertices(resource), indices(resource), lineIndices(resource)
 {
     set(baseRadius, topRadius, height, sectors, stacks, smooth);
 }
@@ -38,7 +41,8 @@ Cylinder::Cylinder(float baseRadius, float topRadius, float height, int sectors,
 ///////////////////////////////////////////////////////////////////////////////
 // setters
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::set(float baseRadius, float topRadius, float height, int sectors,
+template <class Format>
+void BasicCylinder<Format>::set(float baseRadius, float topRadius, float height, int sectors,
     int stacks, bool smooth)
 {
     this->baseRadius = baseRadius;
@@ -52,6 +56,12 @@ void Cylinder::set(float baseRadius, float topRadius, float height, int sectors,
         this->stackCount = MIN_STACK_COUNT;
     this->smooth = smooth;
 
+    // quantized formats store positions relative to the bounds
+    float maxRadius = this->baseRadius > this->topRadius ? this->baseRadius : this->topRadius;
+    float boundsMin[3] = { -maxRadius, -maxRadius, -this->height * 0.5f };
+    float boundsMax[3] = { maxRadius, maxRadius, this->height * 0.5f };
+    decode = Format::positionDecode(boundsMin, boundsMax);
+
     // generate unit circle vertices first
     buildUnitCircleVertices();
 
@@ -61,37 +71,43 @@ void Cylinder::set(float baseRadius, float topRadius, float height, int sectors,
         buildVerticesFlat();
 }
 
-void Cylinder::setBaseRadius(float radius)
+template <class Format>
+void BasicCylinder<Format>::setBaseRadius(float radius)
 {
     if (this->baseRadius != radius)
         set(radius, topRadius, height, sectorCount, stackCount, smooth);
 }
 
-void Cylinder::setTopRadius(float radius)
+template <class Format>
+void BasicCylinder<Format>::setTopRadius(float radius)
 {
     if (this->topRadius != radius)
         set(baseRadius, radius, height, sectorCount, stackCount, smooth);
 }
 
-void Cylinder::setHeight(float height)
+template <class Format>
+void BasicCylinder<Format>::setHeight(float height)
 {
     if (this->height != height)
         set(baseRadius, topRadius, height, sectorCount, stackCount, smooth);
 }
 
-void Cylinder::setSectorCount(int sectors)
+template <class Format>
+void BasicCylinder<Format>::setSectorCount(int sectors)
 {
     if (this->sectorCount != sectors)
         set(baseRadius, topRadius, height, sectors, stackCount, smooth);
 }
 
-void Cylinder::setStackCount(int stacks)
+template <class Format>
+void BasicCylinder<Format>::setStackCount(int stacks)
 {
     if (this->stackCount != stacks)
         set(baseRadius, topRadius, height, sectorCount, stacks, smooth);
 }
 
-void Cylinder::setSmooth(bool smooth)
+template <class Format>
+void BasicCylinder<Format>::setSmooth(bool smooth)
 {
     if (this->smooth == smooth)
         return;
@@ -103,12 +119,26 @@ void Cylinder::setSmooth(bool smooth)
         buildVerticesFlat();
 }
 
+template <class Format>
+void BasicCylinder<Format>::setStrips(bool strips)
+{
+    if (this->strips == strips)
+        return;
+
+    this->strips = strips;
+    if (smooth)
+        buildVerticesSmooth();
+    else
+        buildVerticesFlat();
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // print itself
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::printSelf() const
+template <class Format>
+void BasicCylinder<Format>::printSelf() const
 {
     std::cout << "===== Cylinder =====\n"
         << "   Base Radius: " << baseRadius << "\n"
@@ -118,10 +148,10 @@ void Cylinder::printSelf() const
         << "   Stack Count: " << stackCount << "\n"
         << "Smooth Shading: " << (smooth ? "true" : "false") << "\n"
         << "Triangle Count: " << getTriangleCount() << "\n"
-        << "   Index Count: " << getIndexCount() << "\n"
+        << "   Index Count: " << getIndexCount() << " (" << getIndexWidth() * 8 << "-bit"
+        << (strips ? ", strips" : "") << ")\n"
         << "  Vertex Count: " << getVertexCount() << "\n"
-        << "  Normal Count: " << getNormalCount() << "\n"
-        << "TexCoord Count: " << getTexCoordCount() << std::endl;
+        << "        Stride: " << getInterleavedStride() << " bytes" << std::endl;
 }
 
 
@@ -130,17 +160,25 @@ void Cylinder::printSelf() const
 // draw a cylinder in VertexArray mode
 // OpenGL RC must be set before calling it
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::draw() const
+template <class Format>
+void BasicCylinder<Format>::draw() const
 {
+    // the fixed-function arrays only read unnormalized floats, and there is
+    // no fixed restart index before GL 4.3
+    if (Format::attributes[0].type != ATTRIBUTE_FLOAT || strips)
+        return;
+
     // interleaved array
+    const char* base = (const char*)interleavedVertices.data();
+    const int stride = getInterleavedStride();
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    glVertexPointer(3, GL_FLOAT, stride, base + Format::attributes[0].offset);
+    glNormalPointer(GL_FLOAT, stride, base + Format::attributes[1].offset);
+    glTexCoordPointer(2, GL_FLOAT, stride, base + Format::attributes[2].offset);
 
-    glDrawElements(GL_TRIANGLES, (unsigned int)indices.size(), GL_UNSIGNED_INT, indices.data());
+    glDrawElements(GL_TRIANGLES, indices.size(), indices.width() == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, indices.data());
 
     glDisableClientState(GL_VERTEX_ARRAY);
     glDisableClientState(GL_NORMAL_ARRAY);
@@ -152,17 +190,25 @@ void Cylinder::draw() const
 ///////////////////////////////////////////////////////////////////////////////
 // draw side of cylinder only
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::drawSide() const
+template <class Format>
+void BasicCylinder<Format>::drawSide() const
 {
+    // the fixed-function arrays only read unnormalized floats, and there is
+    // no fixed restart index before GL 4.3
+    if (Format::attributes[0].type != ATTRIBUTE_FLOAT || strips)
+        return;
+
     // interleaved array
+    const char* base = (const char*)interleavedVertices.data();
+    const int stride = getInterleavedStride();
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    glVertexPointer(3, GL_FLOAT, stride, base + Format::attributes[0].offset);
+    glNormalPointer(GL_FLOAT, stride, base + Format::attributes[1].offset);
+    glTexCoordPointer(2, GL_FLOAT, stride, base + Format::attributes[2].offset);
 
-    glDrawElements(GL_TRIANGLES, baseIndex, GL_UNSIGNED_INT, indices.data());
+    glDrawElements(GL_TRIANGLES, getSideIndexCount(), indices.width() == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, indices.data());
 
     glDisableClientState(GL_VERTEX_ARRAY);
     glDisableClientState(GL_NORMAL_ARRAY);
@@ -174,36 +220,52 @@ void Cylinder::drawSide() const
 ///////////////////////////////////////////////////////////////////////////////
 // draw base and top only
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::drawBase() const
+template <class Format>
+void BasicCylinder<Format>::drawBase() const
 {
+    // the fixed-function arrays only read unnormalized floats, and there is
+    // no fixed restart index before GL 4.3
+    if (Format::attributes[0].type != ATTRIBUTE_FLOAT || strips)
+        return;
+
     // interleaved array
+    const char* base = (const char*)interleavedVertices.data();
+    const int stride = getInterleavedStride();
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    glVertexPointer(3, GL_FLOAT, stride, base + Format::attributes[0].offset);
+    glNormalPointer(GL_FLOAT, stride, base + Format::attributes[1].offset);
+    glTexCoordPointer(2, GL_FLOAT, stride, base + Format::attributes[2].offset);
 
-    unsigned int indexCount = ((unsigned int)indices.size() - baseIndex) / 2;
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, &indices[baseIndex]);
+    const char* first = (const char*)indices.data() + baseIndex * indices.width();
+    glDrawElements(GL_TRIANGLES, getBaseIndexCount(), indices.width() == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, first);
 
     glDisableClientState(GL_VERTEX_ARRAY);
     glDisableClientState(GL_NORMAL_ARRAY);
     glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 }
 
-void Cylinder::drawTop() const
+template <class Format>
+void BasicCylinder<Format>::drawTop() const
 {
+    // the fixed-function arrays only read unnormalized floats, and there is
+    // no fixed restart index before GL 4.3
+    if (Format::attributes[0].type != ATTRIBUTE_FLOAT || strips)
+        return;
+
     // interleaved array
+    const char* base = (const char*)interleavedVertices.data();
+    const int stride = getInterleavedStride();
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    glVertexPointer(3, GL_FLOAT, stride, base + Format::attributes[0].offset);
+    glNormalPointer(GL_FLOAT, stride, base + Format::attributes[1].offset);
+    glTexCoordPointer(2, GL_FLOAT, stride, base + Format::attributes[2].offset);
 
-    unsigned int indexCount = ((unsigned int)indices.size() - baseIndex) / 2;
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, &indices[topIndex]);
+    const char* first = (const char*)indices.data() + topIndex * indices.width();
+    glDrawElements(GL_TRIANGLES, getTopIndexCount(), indices.width() == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, first);
 
     glDisableClientState(GL_VERTEX_ARRAY);
     glDisableClientState(GL_NORMAL_ARRAY);
@@ -216,8 +278,12 @@ void Cylinder::drawTop() const
 // draw lines only
 // the caller must set the line width before call this
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::drawLines(const float lineColor[4]) const
+template <class Format>
+void BasicCylinder<Format>::drawLines(const float lineColor[4]) const
 {
+    if (Format::attributes[0].type != ATTRIBUTE_FLOAT)
+        return;
+
     // set line colour
     glColor4fv(lineColor);
     glMaterialfv(GL_FRONT, GL_DIFFUSE, lineColor);
@@ -226,9 +292,9 @@ void Cylinder::drawLines(const float lineColor[4]) const
     glDisable(GL_LIGHTING);
     glDisable(GL_TEXTURE_2D);
     glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, 0, vertices.data());
+    glVertexPointer(3, GL_FLOAT, getInterleavedStride(), (const char*)interleavedVertices.data() + Format::attributes[0].offset);
 
-    glDrawElements(GL_LINES, (unsigned int)lineIndices.size(), GL_UNSIGNED_INT, lineIndices.data());
+    glDrawElements(GL_LINES, (unsigned int)lineIndices.size(), lineIndices.width() == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, lineIndices.data());
 
     glDisableClientState(GL_VERTEX_ARRAY);
     glEnable(GL_LIGHTING);
@@ -241,7 +307,8 @@ void Cylinder::drawLines(const float lineColor[4]) const
 // draw a cylinder surfaces and lines on top of it
 // the caller must set the line width before call this
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::drawWithLines(const float lineColor[4]) const
+template <class Format>
+void BasicCylinder<Format>::drawWithLines(const float lineColor[4]) const
 {
     glEnable(GL_POLYGON_OFFSET_FILL);
     glPolygonOffset(1.0, 1.0f); // move polygon backward
@@ -257,13 +324,28 @@ void Cylinder::drawWithLines(const float lineColor[4]) const
 ///////////////////////////////////////////////////////////////////////////////
 // dealloc vectors
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::clearArrays()
+template <class Format>
+void BasicCylinder<Format>::clearArrays()
+{
+    std::pmr::memory_resource* resource = interleavedVertices.get_allocator().resource();
+    std::pmr::vector<Vertex>(resource).swap(interleavedVertices);
+    indices.release();
+    lineIndices.release();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// allocate every array once at its exact final size
+// the add* functions below then never reallocate
+// the vertex count also picks the index width (16-bit up to 65535 vertices)
+///////////////////////////////////////////////////////////////////////////////
+template <class Format>
+void BasicCylinder<Format>::reserveArrays(unsigned int vertexCount, unsigned int indexCount, unsigned int lineIndexCount)
 {
-    std::vector<float>().swap(vertices);
-    std::vector<float>().swap(normals);
-    std::vector<float>().swap(texCoords);
-    std::vector<unsigned int>().swap(indices);
-    std::vector<unsigned int>().swap(lineIndices);
+    interleavedVertices.reserve(vertexCount);
+    indices.reset(vertexCount, indexCount);
+    lineIndices.reset(vertexCount, lineIndexCount);
 }
 
 
@@ -272,7 +354,8 @@ void Cylinder::clearArrays()
 // build vertices of cylinder with smooth shading
 // where v: sector angle (0 <= v <= 360)
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::buildVerticesSmooth()
+template <class Format>
+void BasicCylinder<Format>::buildVerticesSmooth()
 {
     // clear memory of prev arrays
     clearArrays();
@@ -281,8 +364,19 @@ void Cylinder::buildVerticesSmooth()
     //float s, t;                                     // texCoord
     float radius;                                   // radius for each stack
 
+    // side: (sectorCount+1) vertices per stack, 2 triangles per sector
+    //       or a strip of 2 indices per column plus a leading one per stack,
+    //       2 lines per sector plus the bottom edge of the first stack
+    // base and top: a center and sectorCount rim vertices, a triangle fan
+    //       or a strip of 2 indices per sector plus 1 or 2
+    // strips are separated by restart indices
+    reserveArrays((stackCount + 1) * (sectorCount + 1) + 2 * (sectorCount + 1),
+        strips ? stackCount * (2 * sectorCount + 4) + 4 * sectorCount + 4
+               : stackCount * sectorCount * 6 + 2 * sectorCount * 3,
+        stackCount * sectorCount * 4 + sectorCount * 2);
+
     // get normals for cylinder sides
-    std::vector<float> sideNormals = getSideNormals();
+    std::pmr::vector<float> sideNormals = getSideNormals();
 
     // put vertices of side cylinder to array by scaling unit circle
     for (int i = 0; i <= stackCount; ++i)
@@ -295,44 +389,38 @@ void Cylinder::buildVerticesSmooth()
         {
             x = unitCircleVertices[k];
             y = unitCircleVertices[k + 1];
-            addVertex(x * radius, y * radius, z);   // position
-            addNormal(sideNormals[k], sideNormals[k + 1], sideNormals[k + 2]); // normal
-            addTexCoord((float)j / sectorCount, t); // tex coord
+            addVertex(x * radius, y * radius, z,                                // position
+                sideNormals[k], sideNormals[k + 1], sideNormals[k + 2],         // normal
+                (float)j / sectorCount, t);                                     // tex coord
         }
     }
 
     // remember where the base.top vertices start
-    unsigned int baseVertexIndex = (unsigned int)vertices.size() / 3;
+    unsigned int baseVertexIndex = (unsigned int)interleavedVertices.size();
 
     // put vertices of base of cylinder
     z = -height * 0.5f;
-    addVertex(0, 0, z);
-    addNormal(0, 0, -1);
-    addTexCoord(0.5f, 0.5f);
+    addVertex(0, 0, z, 0, 0, -1, 0.5f, 0.5f);
     for (int i = 0, j = 0; i < sectorCount; ++i, j += 3)
     {
         x = unitCircleVertices[j];
         y = unitCircleVertices[j + 1];
-        addVertex(x * baseRadius, y * baseRadius, z);
-        addNormal(0, 0, -1);
-        addTexCoord(-x * 0.5f + 0.5f, -y * 0.5f + 0.5f);    // flip horizontal
+        addVertex(x * baseRadius, y * baseRadius, z, 0, 0, -1,
+            -x * 0.5f + 0.5f, -y * 0.5f + 0.5f);    // flip horizontal
     }
 
     // remember where the base vertices start
-    unsigned int topVertexIndex = (unsigned int)vertices.size() / 3;
+    unsigned int topVertexIndex = (unsigned int)interleavedVertices.size();
 
     // put vertices of top of cylinder
     z = height * 0.5f;
-    addVertex(0, 0, z);
-    addNormal(0, 0, 1);
-    addTexCoord(0.5f, 0.5f);
+    addVertex(0, 0, z, 0, 0, 1, 0.5f, 0.5f);
     for (int i = 0, j = 0; i < sectorCount; ++i, j += 3)
     {
         x = unitCircleVertices[j];
         y = unitCircleVertices[j + 1];
-        addVertex(x * topRadius, y * topRadius, z);
-        addNormal(0, 0, 1);
-        addTexCoord(x * 0.5f + 0.5f, -y * 0.5f + 0.5f);
+        addVertex(x * topRadius, y * topRadius, z, 0, 0, 1,
+            x * 0.5f + 0.5f, -y * 0.5f + 0.5f);
     }
 
     // put indices for sides
@@ -342,51 +430,56 @@ void Cylinder::buildVerticesSmooth()
         k1 = i * (sectorCount + 1);     // bebinning of current stack
         k2 = k1 + sectorCount + 1;      // beginning of next stack
 
+        // one strip per stack: k1, k1, k2, k1+1, k2+1, ... the doubled first
+        // index keeps the winding of the list's k1-k1+1-k2 triangles
+        if (strips)
+        {
+            indices.beginStrip();
+            indices.push(k1);
+            for (int j = 0; j <= sectorCount; ++j)
+            {
+                indices.push(k1 + j);
+                indices.push(k2 + j);
+            }
+        }
+
         for (int j = 0; j < sectorCount; ++j, ++k1, ++k2)
         {
             // 2 trianles per sector
-            addIndices(k1, k1 + 1, k2);
-            addIndices(k2, k1 + 1, k2 + 1);
+            if (!strips)
+            {
+                addIndices(k1, k1 + 1, k2);
+                addIndices(k2, k1 + 1, k2 + 1);
+            }
 
             // vertical lines for all stacks
-            lineIndices.push_back(k1);
-            lineIndices.push_back(k2);
+            lineIndices.push(k1);
+            lineIndices.push(k2);
             // horizontal lines
-            lineIndices.push_back(k2);
-            lineIndices.push_back(k2 + 1);
+            lineIndices.push(k2);
+            lineIndices.push(k2 + 1);
             if (i == 0)
             {
-                lineIndices.push_back(k1);
-                lineIndices.push_back(k1 + 1);
+                lineIndices.push(k1);
+                lineIndices.push(k1 + 1);
             }
         }
     }
 
     // remember where the base indices start
+    if (strips)
+        indices.beginStrip();
     baseIndex = (unsigned int)indices.size();
 
     // put indices for base
-    for (int i = 0, k = baseVertexIndex + 1; i < sectorCount; ++i, ++k)
-    {
-        if (i < (sectorCount - 1))
-            addIndices(baseVertexIndex, k + 1, k);
-        else    // last triangle
-            addIndices(baseVertexIndex, baseVertexIndex + 1, k);
-    }
+    addCapIndices(baseVertexIndex, false);
 
     // remember where the base indices start
+    if (strips)
+        indices.beginStrip();
     topIndex = (unsigned int)indices.size();
 
-    for (int i = 0, k = topVertexIndex + 1; i < sectorCount; ++i, ++k)
-    {
-        if (i < (sectorCount - 1))
-            addIndices(topVertexIndex, k, k + 1);
-        else
-            addIndices(topVertexIndex, k, topVertexIndex + 1);
-    }
-
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
+    addCapIndices(topVertexIndex, true);
 }
 
 
@@ -395,14 +488,16 @@ void Cylinder::buildVerticesSmooth()
 // generate vertices with flat shading
 // each triangle is independent (no shared vertices)
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::buildVerticesFlat()
+template <class Format>
+void BasicCylinder<Format>::buildVerticesFlat()
 {
     // tmp vertex definition (x,y,z,s,t)
-    struct Vertex
+    struct GridVertex
     {
         float x, y, z, s, t;
     };
-    std::vector<Vertex> tmpVertices;
+    std::pmr::vector<GridVertex> tmpVertices(interleavedVertices.get_allocator().resource());
+    tmpVertices.reserve((stackCount + 1) * (sectorCount + 1));
 
     int i, j, k;    // indices
     float x, y, z, s, t, radius;
@@ -422,7 +517,7 @@ void Cylinder::buildVerticesFlat()
             y = unitCircleVertices[k + 1];
             s = (float)j / sectorCount;
 
-            Vertex vertex;
+            GridVertex vertex;
             vertex.x = x * radius;
             vertex.y = y * radius;
             vertex.z = z;
@@ -435,8 +530,18 @@ void Cylinder::buildVerticesFlat()
     // clear memory of prev arrays
     clearArrays();
 
-    Vertex v1, v2, v3, v4;      // 4 vertex positions v1, v2, v3, v4
-    std::vector<float> n;       // 1 face normal
+    // side: a quad (4 vertices, 6 indices or a 4 index strip) per sector,
+    //       2 lines per quad plus the bottom edge of the first stack
+    // base and top: a center and sectorCount rim vertices, a triangle fan
+    //       or a strip of 2 indices per sector plus 1 or 2
+    // strips are separated by restart indices
+    reserveArrays(stackCount * sectorCount * 4 + 2 * (sectorCount + 1),
+        strips ? stackCount * sectorCount * 5 + 4 * sectorCount + 4
+               : stackCount * sectorCount * 6 + 2 * sectorCount * 3,
+        stackCount * sectorCount * 4 + sectorCount * 2);
+
+    GridVertex v1, v2, v3, v4;  // 4 vertex positions v1, v2, v3, v4
+    std::array<float, 3> n;     // 1 face normal
     int vi1, vi2;               // indices
     int index = 0;
 
@@ -458,38 +563,37 @@ void Cylinder::buildVerticesFlat()
             // compute a face normal of v1-v3-v2
             n = computeFaceNormal(v1.x, v1.y, v1.z, v3.x, v3.y, v3.z, v2.x, v2.y, v2.z);
 
-            // put quad vertices: v1-v2-v3-v4
-            addVertex(v1.x, v1.y, v1.z);
-            addVertex(v2.x, v2.y, v2.z);
-            addVertex(v3.x, v3.y, v3.z);
-            addVertex(v4.x, v4.y, v4.z);
+            // put quad vertices: v1-v2-v3-v4, same normal for all 4 vertices
+            addVertex(v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+            addVertex(v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+            addVertex(v3.x, v3.y, v3.z, n[0], n[1], n[2], v3.s, v3.t);
+            addVertex(v4.x, v4.y, v4.z, n[0], n[1], n[2], v4.s, v4.t);
 
-            // put tex coords of quad
-            addTexCoord(v1.s, v1.t);
-            addTexCoord(v2.s, v2.t);
-            addTexCoord(v3.s, v3.t);
-            addTexCoord(v4.s, v4.t);
-
-            // put normal
-            for (k = 0; k < 4; ++k)  // same normals for all 4 vertices
+            // put indices of a quad
+            if (strips)
             {
-                addNormal(n[0], n[1], n[2]);
+                indices.beginStrip();                   // v1-v3-v2, v2-v3-v4
+                indices.push(index);
+                indices.push(index + 2);
+                indices.push(index + 1);
+                indices.push(index + 3);
+            }
+            else
+            {
+                addIndices(index, index + 2, index + 1);    // v1-v3-v2
+                addIndices(index + 1, index + 2, index + 3);    // v2-v3-v4
             }
-
-            // put indices of a quad
-            addIndices(index, index + 2, index + 1);    // v1-v3-v2
-            addIndices(index + 1, index + 2, index + 3);    // v2-v3-v4
 
             // vertical line per quad: v1-v2
-            lineIndices.push_back(index);
-            lineIndices.push_back(index + 1);
+            lineIndices.push(index);
+            lineIndices.push(index + 1);
             // horizontal line per quad: v2-v4
-            lineIndices.push_back(index + 1);
-            lineIndices.push_back(index + 3);
+            lineIndices.push(index + 1);
+            lineIndices.push(index + 3);
             if (i == 0)
             {
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 2);
+                lineIndices.push(index);
+                lineIndices.push(index + 2);
             }
 
             index += 4;     // for next
@@ -497,90 +601,43 @@ void Cylinder::buildVerticesFlat()
     }
 
     // remember where the base index starts
+    if (strips)
+        indices.beginStrip();
     baseIndex = (unsigned int)indices.size();
-    unsigned int baseVertexIndex = (unsigned int)vertices.size() / 3;
+    unsigned int baseVertexIndex = (unsigned int)interleavedVertices.size();
 
     // put vertices of base of cylinder
     z = -height * 0.5f;
-    addVertex(0, 0, z);
-    addNormal(0, 0, -1);
-    addTexCoord(0.5f, 0.5f);
+    addVertex(0, 0, z, 0, 0, -1, 0.5f, 0.5f);
     for (i = 0, j = 0; i < sectorCount; ++i, j += 3)
     {
         x = unitCircleVertices[j];
         y = unitCircleVertices[j + 1];
-        addVertex(x * baseRadius, y * baseRadius, z);
-        addNormal(0, 0, -1);
-        addTexCoord(-x * 0.5f + 0.5f, -y * 0.5f + 0.5f); // flip horizontal
+        addVertex(x * baseRadius, y * baseRadius, z, 0, 0, -1,
+            -x * 0.5f + 0.5f, -y * 0.5f + 0.5f);    // flip horizontal
     }
 
     // put indices for base
-    for (i = 0, k = baseVertexIndex + 1; i < sectorCount; ++i, ++k)
-    {
-        if (i < sectorCount - 1)
-            addIndices(baseVertexIndex, k + 1, k);
-        else
-            addIndices(baseVertexIndex, baseVertexIndex + 1, k);
-    }
+    addCapIndices(baseVertexIndex, false);
 
     // remember where the top index starts
+    if (strips)
+        indices.beginStrip();
     topIndex = (unsigned int)indices.size();
-    unsigned int topVertexIndex = (unsigned int)vertices.size() / 3;
+    unsigned int topVertexIndex = (unsigned int)interleavedVertices.size();
 
     // put vertices of top of cylinder
     z = height * 0.5f;
-    addVertex(0, 0, z);
-    addNormal(0, 0, 1);
-    addTexCoord(0.5f, 0.5f);
+    addVertex(0, 0, z, 0, 0, 1, 0.5f, 0.5f);
     for (i = 0, j = 0; i < sectorCount; ++i, j += 3)
     {
         x = unitCircleVertices[j];
         y = unitCircleVertices[j + 1];
-        addVertex(x * topRadius, y * topRadius, z);
-        addNormal(0, 0, 1);
-        addTexCoord(x * 0.5f + 0.5f, -y * 0.5f + 0.5f);
-    }
-
-    for (i = 0, k = topVertexIndex + 1; i < sectorCount; ++i, ++k)
-    {
-        if (i < sectorCount - 1)
-            addIndices(topVertexIndex, k, k + 1);
-        else
-            addIndices(topVertexIndex, k, topVertexIndex + 1);
+        addVertex(x * topRadius, y * topRadius, z, 0, 0, 1,
+            x * 0.5f + 0.5f, -y * 0.5f + 0.5f);
     }
 
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// generate interleaved vertices: V/N/T
-// stride must be 32 bytes
-///////////////////////////////////////////////////////////////////////////////
-void Cylinder::buildInterleavedVertices()
-{
-    std::vector<float>().swap(interleavedVertices);
-
-    std::size_t i, j;
-    std::size_t count = vertices.size();
-    for (i = 0, j = 0; i < count; i += 3, j += 2)
-    {
-        //interleavedVertices.push_back(vertices[i]);
-        //interleavedVertices.push_back(vertices[i+1]);
-        //interleavedVertices.push_back(vertices[i+2]);
-        interleavedVertices.insert(interleavedVertices.end(), &vertices[i], &vertices[i] + 3);
-
-        //interleavedVertices.push_back(normals[i]);
-        //interleavedVertices.push_back(normals[i+1]);
-        //interleavedVertices.push_back(normals[i+2]);
-        interleavedVertices.insert(interleavedVertices.end(), &normals[i], &normals[i] + 3);
-
-        //interleavedVertices.push_back(texCoords[j]);
-        //interleavedVertices.push_back(texCoords[j+1]);
-        interleavedVertices.insert(interleavedVertices.end(), &texCoords[j], &texCoords[j] + 2);
-    }
+    addCapIndices(topVertexIndex, true);
 }
 
 
@@ -588,67 +645,97 @@ void Cylinder::buildInterleavedVertices()
 ///////////////////////////////////////////////////////////////////////////////
 // generate 3D vertices of a unit circle on XY plance
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::buildUnitCircleVertices()
+template <class Format>
+void BasicCylinder<Format>::buildUnitCircleVertices()
 {
     const float PI = acos(-1);
     float sectorStep = 2 * PI / sectorCount;
-    float sectorAngle;  // radian
 
-    std::vector<float>().swap(unitCircleVertices);
-    for (int i = 0; i <= sectorCount; ++i)
+    // every sector angle in one batch
+    std::pmr::memory_resource* resource = unitCircleVertices.get_allocator().resource();
+    std::pmr::vector<float> sines(sectorCount + 1, resource), cosines(sectorCount + 1, resource);
+    USinCosRamp(0.0f, sectorStep, sectorCount + 1, sines.data(), cosines.data());
+
+    unitCircleVertices.resize((sectorCount + 1) * 3);
+    for (int i = 0, k = 0; i <= sectorCount; ++i, k += 3)
     {
-        sectorAngle = i * sectorStep;
-        unitCircleVertices.push_back(cos(sectorAngle)); // x
-        unitCircleVertices.push_back(sin(sectorAngle)); // y
-        unitCircleVertices.push_back(0);                // z
+        unitCircleVertices[k] = cosines[i];     // x
+        unitCircleVertices[k + 1] = sines[i];   // y
+        unitCircleVertices[k + 2] = 0;          // z
     }
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// add single vertex to array
+// encode a single vertex straight into the interleaved array
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::addVertex(float x, float y, float z)
+template <class Format>
+void BasicCylinder<Format>::addVertex(float x, float y, float z, float nx, float ny, float nz, float s, float t)
 {
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z);
+    interleavedVertices.emplace_back();
+    Format::write(interleavedVertices.back(), decode, x, y, z, nx, ny, nz, s, t);
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// add single normal to array
+// add 3 indices to array
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::addNormal(float nx, float ny, float nz)
+template <class Format>
+void BasicCylinder<Format>::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
 {
-    normals.push_back(nx);
-    normals.push_back(ny);
-    normals.push_back(nz);
+    indices.push(i1);
+    indices.push(i2);
+    indices.push(i3);
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// add single texture coord to array
+// add the triangle fan of a cap around its center vertex, followed by its
+// sectorCount rim vertices; the base faces -Z, the top +Z
+// as a strip the fan zigzags through the center: r0,c,r1,c,r2,... for the base
+// and c,r0,c,r1,c,... for the top, every other triangle being degenerate
 ///////////////////////////////////////////////////////////////////////////////
-void Cylinder::addTexCoord(float s, float t)
+template <class Format>
+void BasicCylinder<Format>::addCapIndices(unsigned int centerIndex, bool top)
 {
-    texCoords.push_back(s);
-    texCoords.push_back(t);
-}
-
-
+    unsigned int rim = centerIndex + 1;
+    if (strips)
+    {
+        if (top)
+            indices.push(centerIndex);
+        else
+            indices.push(rim);
+        for (int i = top ? 0 : 1; i <= sectorCount; ++i)
+        {
+            if (!top)
+                indices.push(centerIndex);
+            indices.push(rim + i % sectorCount);
+            if (top && i < sectorCount)
+                indices.push(centerIndex);
+        }
+        return;
+    }
 
-///////////////////////////////////////////////////////////////////////////////
-// add 3 indices to array
-///////////////////////////////////////////////////////////////////////////////
-void Cylinder::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
-{
-    indices.push_back(i1);
-    indices.push_back(i2);
-    indices.push_back(i3);
+    for (int i = 0, k = rim; i < sectorCount; ++i, ++k)
+    {
+        if (i < sectorCount - 1)
+        {
+            if (top)
+                addIndices(centerIndex, k, k + 1);
+            else
+                addIndices(centerIndex, k + 1, k);
+        }
+        else    // last triangle
+        {
+            if (top)
+                addIndices(centerIndex, k, rim);
+            else
+                addIndices(centerIndex, rim, k);
+        }
+    }
 }
 
 
@@ -656,12 +743,9 @@ void Cylinder::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
 ///////////////////////////////////////////////////////////////////////////////
 // generate shared normal vectors of the side of cylinder
 ///////////////////////////////////////////////////////////////////////////////
-std::vector<float> Cylinder::getSideNormals()
+template <class Format>
+std::pmr::vector<float> BasicCylinder<Format>::getSideNormals()
 {
-    const float PI = acos(-1);
-    float sectorStep = 2 * PI / sectorCount;
-    float sectorAngle;  // radian
-
     // compute the normal vector at 0 degree first
     // tanA = (baseRadius-topRadius) / height
     float zAngle = atan2(baseRadius - topRadius, height);
@@ -670,13 +754,15 @@ std::vector<float> Cylinder::getSideNormals()
     float z0 = sin(zAngle);     // nz
 
     // rotate (x0,y0,z0) per sector angle
-    std::vector<float> normals;
-    for (int i = 0; i <= sectorCount; ++i)
+    // the sector cos/sin are already in unitCircleVertices
+    std::pmr::vector<float> normals((sectorCount + 1) * 3, unitCircleVertices.get_allocator().resource());
+    for (int i = 0, k = 0; i <= sectorCount; ++i, k += 3)
     {
-        sectorAngle = i * sectorStep;
-        normals.push_back(cos(sectorAngle) * x0 - sin(sectorAngle) * y0);   // nx
-        normals.push_back(sin(sectorAngle) * x0 + cos(sectorAngle) * y0);   // ny
-        normals.push_back(z0);  // nz
+        float cosAngle = unitCircleVertices[k];
+        float sinAngle = unitCircleVertices[k + 1];
+        normals[k] = cosAngle * x0 - sinAngle * y0;     // nx
+        normals[k + 1] = sinAngle * x0 + cosAngle * y0; // ny
+        normals[k + 2] = z0;    // nz
         /*
         //debug
         float nx = cos(sectorAngle)*x0 - sin(sectorAngle)*y0;
@@ -695,13 +781,14 @@ std::vector<float> Cylinder::getSideNormals()
 // return face normal of a triangle v1-v2-v3
 // if a triangle has no surface (normal length = 0), then return a zero vector
 ///////////////////////////////////////////////////////////////////////////////
-std::vector<float> Cylinder::computeFaceNormal(float x1, float y1, float z1,  // v1
+template <class Format>
+std::array<float, 3> BasicCylinder<Format>::computeFaceNormal(float x1, float y1, float z1,  // v1
     float x2, float y2, float z2,  // v2
     float x3, float y3, float z3)  // v3
 {
     const float EPSILON = 0.000001f;
 
-    std::vector<float> normal(3, 0.0f);     // default return value (0,0,0)
+    std::array<float, 3> normal = { 0.0f, 0.0f, 0.0f };    // default return value (0,0,0)
     float nx, ny, nz;
 
     // find 2 edge vectors: v1-v2, v1-v3
@@ -730,3 +817,10 @@ std::vector<float> Cylinder::computeFaceNormal(float x1, float y1, float z1,  //
 
     return normal;
 }
+
+
+
+// formats the cylinder is built in ////////////////////////////////////////////
+template class BasicCylinder<VertexP3N3T2>;
+template class BasicCylinder<VertexUnorm16Oct>;
+template class BasicCylinder<VertexHalfOct>;
@@ -0,0 +1,181 @@
+// Author: Joshua Gauthier
+// GL debug output, configured once at startup, with deduplicated and rate-limited messages
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "DebugOutput.h"
+
+using namespace std;
+
+namespace
+{
+    const char* const MODE_NAMES[DEBUG_OUTPUT_MODE_COUNT] = { "off", "async", "sync" };
+
+    const char* USourceName(GLenum source)
+    {
+        switch (source)
+        {
+        case GL_DEBUG_SOURCE_API:             return "api";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY:     return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION:     return "application";
+        default:                              return "other";
+        }
+    }
+
+    const char* UTypeName(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_DEBUG_TYPE_ERROR:               return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behaviour";
+        case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+        case GL_DEBUG_TYPE_MARKER:              return "marker";
+        case GL_DEBUG_TYPE_PUSH_GROUP:          return "push group";
+        case GL_DEBUG_TYPE_POP_GROUP:           return "pop group";
+        default:                                return "other";
+        }
+    }
+
+    const char* USeverityName(GLenum severity)
+    {
+        switch (severity)
+        {
+        case GL_DEBUG_SEVERITY_HIGH:   return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+        case GL_DEBUG_SEVERITY_LOW:    return "low";
+        default:                       return "notification";
+        }
+    }
+
+    unsigned long long UNowMs()
+    {
+        return (unsigned long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+
+const char* UDebugOutputModeName(DebugOutputMode mode)
+{
+    return MODE_NAMES[mode];
+}
+
+
+DebugOutputMode DebugOutput::create(DebugOutputMode requested)
+{
+    GLint flags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+
+    mode = requested;
+    if (mode != DEBUG_OUTPUT_OFF && !(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+    {
+        cout << "GL debug output " << UDebugOutputModeName(mode) << " unavailable: the context has no debug bit" << endl;
+        mode = DEBUG_OUTPUT_OFF;
+    }
+
+    if (mode != DEBUG_OUTPUT_OFF)
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        if (mode == DEBUG_OUTPUT_SYNC)
+            glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        else
+            glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageCallback(callback, this);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+    }
+
+    const char* context = (flags & GL_CONTEXT_FLAG_DEBUG_BIT) ? "debug"
+        : (flags & GL_CONTEXT_FLAG_NO_ERROR_BIT_KHR) ? "no-error" : "regular";
+    cout << "INFO: GL debug output: " << UDebugOutputModeName(mode) << " (" << context << " context)" << endl;
+    return mode;
+}
+
+
+void DebugOutput::report()
+{
+    lock_guard<std::mutex> lock(mutex);
+    if (messageCount == 0)
+        return;
+
+    vector<pair<MessageKey, MessageCount> > sorted(messages.begin(), messages.end());
+    std::sort(sorted.begin(), sorted.end(),
+        [](const pair<MessageKey, MessageCount>& a, const pair<MessageKey, MessageCount>& b) { return a.second.count > b.second.count; });
+
+    cout << "GL debug messages: " << messageCount << " (" << sorted.size() << " distinct, " << suppressed << " lines suppressed)" << endl;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        const MessageKey& key = sorted[i].first;
+        const MessageCount& entry = sorted[i].second;
+        cout << "  " << entry.count << "x " << USeverityName(entry.severity) << " " << UTypeName(key.type) << " "
+            << USourceName(key.source) << " (" << key.id << "): " << entry.text << endl;
+    }
+}
+
+
+void APIENTRY DebugOutput::callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+    GLsizei length, const GLchar* message, const void* userParam)
+{
+    // non-significant notifications some drivers raise for every buffer and texture
+    if (id == 131169 || id == 131185 || id == 131218 || id == 131204)
+        return;
+
+    MessageKey key = { source, type, id };
+    ((DebugOutput*)userParam)->receive(key, severity, message, length);
+}
+
+
+void DebugOutput::receive(const MessageKey& key, GLenum severity, const GLchar* message, GLsizei length)
+{
+    lock_guard<std::mutex> lock(mutex);
+    ++messageCount;
+
+    std::map<MessageKey, MessageCount>::iterator found = messages.find(key);
+    if (found == messages.end())
+    {
+        MessageCount entry;
+        entry.severity = severity;
+        entry.count = 1;
+        entry.text = length < 0 ? string(message) : string(message, length);
+        while (!entry.text.empty() && (entry.text.back() == '\n' || entry.text.back() == '\r'))
+            entry.text.pop_back();
+        found = messages.insert(make_pair(key, entry)).first;
+
+        if (takeLine())
+            cout << "GL debug " << USeverityName(severity) << " " << UTypeName(key.type) << " " << USourceName(key.source)
+                << " (" << key.id << "): " << entry.text << endl;
+        return;
+    }
+
+    // repeats only at every power of ten
+    unsigned long long count = ++found->second.count;
+    unsigned long long power = 10;
+    while (power < count)
+        power *= 10;
+    if (power == count && takeLine())
+        cout << "GL debug (" << key.id << ") repeated " << count << " times" << endl;
+}
+
+
+bool DebugOutput::takeLine()
+{
+    unsigned long long now = UNowMs();
+    if (now - windowStart >= 1000)
+    {
+        windowStart = now;
+        windowLines = 0;
+    }
+    if (windowLines == MAX_LINES_PER_SECOND)
+    {
+        ++suppressed;
+        return false;
+    }
+    ++windowLines;
+    return true;
+}
@@ -0,0 +1,82 @@
+// Author: Joshua Gauthier
+// GL debug output, configured once at startup, with deduplicated and rate-limited messages
+
+#ifndef DEBUG_OUTPUT_H
+#define DEBUG_OUTPUT_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include "GLLoader.h"
+
+enum DebugOutputMode
+{
+    DEBUG_OUTPUT_OFF,       // no debug context; a no-error context where the driver offers one
+    DEBUG_OUTPUT_ASYNC,     // debug context, messages may arrive late and from a driver thread
+    DEBUG_OUTPUT_SYNC,      // debug context, each message arrives inside the call that raised it
+    DEBUG_OUTPUT_MODE_COUNT
+};
+
+// name for --gl-debug: off, async or sync
+const char* UDebugOutputModeName(DebugOutputMode mode);
+
+// Receives the messages of a debug context. Each distinct message (source,
+// type and id) is printed once as one line, then only counted; repeats are
+// announced at 10, 100, 1000... occurrences. At most MAX_LINES_PER_SECOND
+// lines are printed, the rest only counted, so a message raised every draw
+// neither floods the console nor slows the frame down further.
+//
+// usage: pick the context flags from the mode before creating the context,
+// then create() once after glewInit(), and report() at exit. Nothing is done
+// per frame
+class DebugOutput
+{
+public:
+    static const int MAX_LINES_PER_SECOND = 10;
+
+    DebugOutput() : mode(DEBUG_OUTPUT_OFF), messageCount(0), windowStart(0), windowLines(0), suppressed(0) {}
+
+    // enables debug output for mode when the context has the debug bit and
+    // prints which kind of context is current. Returns the mode in effect
+    DebugOutputMode create(DebugOutputMode requested);
+    // one line per distinct message with its count, most frequent first
+    void report();
+
+    DebugOutputMode getMode() const { return mode; }
+
+private:
+    struct MessageKey
+    {
+        GLenum source;
+        GLenum type;
+        GLuint id;
+
+        bool operator<(const MessageKey& other) const
+        {
+            if (source != other.source) return source < other.source;
+            if (type != other.type) return type < other.type;
+            return id < other.id;
+        }
+    };
+    struct MessageCount
+    {
+        GLenum severity;
+        unsigned long long count;
+        std::string text;       // the first occurrence
+    };
+
+    static void APIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+        GLsizei length, const GLchar* message, const void* userParam);
+    void receive(const MessageKey& key, GLenum severity, const GLchar* message, GLsizei length);
+    bool takeLine();
+
+    DebugOutputMode mode;
+    std::mutex mutex;                   // the async callback may run on a driver thread
+    std::map<MessageKey, MessageCount> messages;
+    unsigned long long messageCount;
+    unsigned long long windowStart;     // ms, start of the current second of printing
+    int windowLines;
+    unsigned long long suppressed;      // lines not printed because of the rate limit
+};
+
+#endif
@@ -0,0 +1,273 @@
+// Author: Joshua Gauthier
+// View frustum culling of world-space bounding spheres and boxes, 4 or 8 objects per test
+
+#include <algorithm>
+#include <cmath>
+
+#include "FrustumCulling.h"
+#include "MeshKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FRUSTUM_CULLING_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define FRUSTUM_CULLING_AVX2_TARGET
+#else
+#define FRUSTUM_CULLING_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+    // Pointers into the structure of arrays, and the planes, for one cull() call
+    struct CullInput
+    {
+        const float* centerX;
+        const float* centerY;
+        const float* centerZ;
+        const float* radius;
+        const float* extentX;
+        const float* extentY;
+        const float* extentZ;
+        const float (*planes)[4];
+    };
+
+    /* ------------------- Scalar -------------------*/
+    // An object is outside a plane when its center lies further behind it than
+    // the smaller of its sphere radius and its box's reach along the normal
+    // (|a|*ex + |b|*ey + |c|*ez). Every path evaluates the same expressions in
+    // the same order, so they agree bit for bit
+    int UCullScalar(const CullInput& in, int first, int count, unsigned char* visible)
+    {
+        int visibleCount = 0;
+        for (int i = first; i < count; ++i)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p)
+            {
+                const float* plane = in.planes[p];
+                float distance = plane[0] * in.centerX[i] + plane[1] * in.centerY[i] + plane[2] * in.centerZ[i] + plane[3];
+                float reach = fabsf(plane[0]) * in.extentX[i] + fabsf(plane[1]) * in.extentY[i] + fabsf(plane[2]) * in.extentZ[i];
+                inside = distance >= -std::min(reach, in.radius[i]);
+            }
+            visible[i] = inside ? 1 : 0;
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+
+#ifdef FRUSTUM_CULLING_X86
+    /* ------------------- SSE2: 4 objects -------------------*/
+    int UCullSSE2(const CullInput& in, int count, unsigned char* visible)
+    {
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        int visibleCount = 0;
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(in.centerX + i);
+            __m128 cy = _mm_loadu_ps(in.centerY + i);
+            __m128 cz = _mm_loadu_ps(in.centerZ + i);
+            __m128 r = _mm_loadu_ps(in.radius + i);
+            __m128 ex = _mm_loadu_ps(in.extentX + i);
+            __m128 ey = _mm_loadu_ps(in.extentY + i);
+            __m128 ez = _mm_loadu_ps(in.extentZ + i);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                const float* plane = in.planes[p];
+                __m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]);
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_mul_ps(c, cz)), _mm_set1_ps(plane[3]));
+                __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(a, absMask), ex), _mm_mul_ps(_mm_and_ps(b, absMask), ey)),
+                    _mm_mul_ps(_mm_and_ps(c, absMask), ez));
+                __m128 limit = _mm_sub_ps(_mm_setzero_ps(), _mm_min_ps(reach, r));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, limit));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            for (int k = 0; k < 4; ++k)
+            {
+                visible[i + k] = (mask >> k) & 1;
+                visibleCount += visible[i + k];
+            }
+        }
+        return visibleCount + UCullScalar(in, i, count, visible);
+    }
+
+    /* ------------------- AVX2: 8 objects -------------------*/
+    FRUSTUM_CULLING_AVX2_TARGET
+    int UCullAVX2(const CullInput& in, int count, unsigned char* visible)
+    {
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        int visibleCount = 0;
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(in.centerX + i);
+            __m256 cy = _mm256_loadu_ps(in.centerY + i);
+            __m256 cz = _mm256_loadu_ps(in.centerZ + i);
+            __m256 r = _mm256_loadu_ps(in.radius + i);
+            __m256 ex = _mm256_loadu_ps(in.extentX + i);
+            __m256 ey = _mm256_loadu_ps(in.extentY + i);
+            __m256 ez = _mm256_loadu_ps(in.extentZ + i);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                const float* plane = in.planes[p];
+                __m256 a = _mm256_set1_ps(plane[0]), b = _mm256_set1_ps(plane[1]), c = _mm256_set1_ps(plane[2]);
+                // no FMA: the same roundings as the other paths
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(b, cy)), _mm256_mul_ps(c, cz)), _mm256_set1_ps(plane[3]));
+                __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_and_ps(a, absMask), ex), _mm256_mul_ps(_mm256_and_ps(b, absMask), ey)),
+                    _mm256_mul_ps(_mm256_and_ps(c, absMask), ez));
+                __m256 limit = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_min_ps(reach, r));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, limit, _CMP_GE_OQ));
+            }
+
+            int mask = _mm256_movemask_ps(inside);
+            for (int k = 0; k < 8; ++k)
+            {
+                visible[i + k] = (mask >> k) & 1;
+                visibleCount += visible[i + k];
+            }
+        }
+        return visibleCount + UCullScalar(in, i, count, visible);
+    }
+#endif
+
+    CullPath UDetectCullPath()
+    {
+#ifdef FRUSTUM_CULLING_X86
+        if (UCpuSupportsAVX2())
+            return CULL_AVX2;
+        return CULL_SSE2;       // baseline on every x86-64 CPU
+#else
+        return CULL_SCALAR;
+#endif
+    }
+
+    const CullPath gSupportedPath = UDetectCullPath();
+    CullPath gCullPath = gSupportedPath;
+}
+
+
+/* ------------------- Dispatch -------------------*/
+CullPath UGetCullPath()
+{
+    return gCullPath;
+}
+
+void USetCullPath(CullPath path)
+{
+    gCullPath = path > gSupportedPath ? gSupportedPath : path;
+}
+
+const char* UCullPathName(CullPath path)
+{
+    switch (path)
+    {
+    case CULL_SSE2: return "sse2";
+    case CULL_AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+
+/* ------------------- Frustum planes of a view-projection matrix -------------------*/
+void UExtractFrustumPlanes(const glm::mat4& viewProjection, float planes[6][4])
+{
+    // Gribb and Hartmann: each plane is the last row of the matrix plus or
+    // minus one of the others (glm is column-major, so row r is m[c][r])
+    for (int i = 0; i < 6; ++i)
+    {
+        int row = i / 2;
+        float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        for (int c = 0; c < 4; ++c)
+            planes[i][c] = viewProjection[c][3] + sign * viewProjection[c][row];
+
+        float length = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+        for (int c = 0; c < 4; ++c)
+            planes[i][c] /= length;
+    }
+}
+
+
+/* ------------------- Forget every object -------------------*/
+void CullBounds::clear()
+{
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radius.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+    count = 0;
+}
+
+
+/* ------------------- Add one object's world bounds -------------------*/
+int CullBounds::add(const float boundsMin[3], const float boundsMax[3], float boundsRadius, const glm::mat4& model)
+{
+    centerX.push_back(0.0f);
+    centerY.push_back(0.0f);
+    centerZ.push_back(0.0f);
+    radius.push_back(0.0f);
+    extentX.push_back(0.0f);
+    extentY.push_back(0.0f);
+    extentZ.push_back(0.0f);
+    set(count, boundsMin, boundsMax, boundsRadius, model);
+    return count++;
+}
+
+
+/* ------------------- Bake one object's model matrix into its world bounds -------------------*/
+void CullBounds::set(int index, const float boundsMin[3], const float boundsMax[3], float boundsRadius, const glm::mat4& model)
+{
+    glm::vec3 low(boundsMin[0], boundsMin[1], boundsMin[2]);
+    glm::vec3 high(boundsMax[0], boundsMax[1], boundsMax[2]);
+    glm::vec3 center = (low + high) * 0.5f;
+    glm::vec3 halfSize = (high - low) * 0.5f;
+    glm::vec3 world = glm::vec3(model * glm::vec4(center, 1.0f));
+
+    // Arvo: the box of a transformed box reaches |m| * halfSize along each axis
+    glm::vec3 extent(0.0f);
+    for (int axis = 0; axis < 3; ++axis)
+        for (int k = 0; k < 3; ++k)
+            extent[axis] += fabsf(model[k][axis]) * halfSize[k];
+
+    // the largest axis scale bounds how far the sphere can stretch
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+        std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+    centerX[index] = world.x;
+    centerY[index] = world.y;
+    centerZ[index] = world.z;
+    radius[index] = boundsRadius * scale;
+    extentX[index] = extent.x;
+    extentY[index] = extent.y;
+    extentZ[index] = extent.z;
+}
+
+
+/* ------------------- Test every object against the frustum -------------------*/
+int CullBounds::cull(const glm::mat4& viewProjection, unsigned char* visible) const
+{
+    float planes[6][4];
+    UExtractFrustumPlanes(viewProjection, planes);
+
+    CullInput in = { centerX.data(), centerY.data(), centerZ.data(), radius.data(),
+        extentX.data(), extentY.data(), extentZ.data(), planes };
+    switch (gCullPath)
+    {
+#ifdef FRUSTUM_CULLING_X86
+    case CULL_AVX2:
+        return UCullAVX2(in, count, visible);
+    case CULL_SSE2:
+        return UCullSSE2(in, count, visible);
+#endif
+    default:
+        return UCullScalar(in, 0, count, visible);
+    }
+}
@@ -0,0 +1,61 @@
+// Author: Joshua Gauthier
+// View frustum culling of world-space bounding spheres and boxes, 4 or 8 objects per test
+
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Instruction set used by CullBounds::cull, picked once from the CPU at startup
+enum CullPath
+{
+    CULL_SCALAR,        // one object per iteration
+    CULL_SSE2,          // 4 objects per iteration
+    CULL_AVX2,          // 8 objects per iteration
+    CULL_PATH_COUNT
+};
+
+// path in use; USetCullPath clamps to what the CPU supports (benchmarks, debugging)
+CullPath UGetCullPath();
+void USetCullPath(CullPath path);
+const char* UCullPathName(CullPath path);
+
+// the six planes (left, right, bottom, top, near, far) of the clip volume of
+// viewProjection as a, b, c, d with a point inside when a*x + b*y + c*z + d >= 0;
+// normalized, so the value is a distance
+void UExtractFrustumPlanes(const glm::mat4& viewProjection, float planes[6][4]);
+
+// World-space bounds of every object, as a structure of arrays so that the
+// kernels load 4 or 8 objects per instruction. Each object keeps both a
+// bounding sphere and an axis-aligned box: it is culled when either lies
+// entirely outside one plane, so long thin objects get the box and rotated
+// round ones the sphere.
+//
+// usage: add() every object once (its model matrix is baked in), set() it
+// again when it moves, then cull() every frame
+class CullBounds
+{
+public:
+    CullBounds() : count(0) {}
+
+    void clear();
+    // the model-space box boundsMin..boundsMax and a sphere of boundsRadius
+    // around its center, transformed by model. Returns the object's index
+    int add(const float boundsMin[3], const float boundsMax[3], float boundsRadius, const glm::mat4& model);
+    // the bounds of object index under a new model matrix
+    void set(int index, const float boundsMin[3], const float boundsMax[3], float boundsRadius, const glm::mat4& model);
+    int size() const { return count; }
+
+    // visible[i] = 1 when object i may be inside the frustum of viewProjection,
+    // 0 when it is certainly outside. Returns the number of visible objects
+    int cull(const glm::mat4& viewProjection, unsigned char* visible) const;
+
+private:
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> radius;
+    std::vector<float> extentX, extentY, extentZ;     // box half sizes
+    int count;
+};
+
+#endif
@@ -0,0 +1,80 @@
+// Author: Joshua Gauthier
+// Geometry buffer of the deferred shading path
+
+#include <iostream>
+
+#include "GBuffer.h"
+
+namespace
+{
+    const GLenum INTERNAL_FORMATS[GBUFFER_TARGET_COUNT] = { GL_RGBA8, GL_RGBA16F, GL_RGBA16F, GL_DEPTH_COMPONENT32F };
+}
+
+
+/* ------------------- Create the targets and their framebuffer -------------------*/
+bool GBuffer::create(int targetWidth, int targetHeight)
+{
+    width = targetWidth;
+    height = targetHeight;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputFbo);
+
+    // sampled with texelFetch only, so no filtering and a single level
+    glGenTextures(GBUFFER_TARGET_COUNT, textures);
+    for (int i = 0; i < GBUFFER_TARGET_COUNT; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, INTERNAL_FORMATS[i], width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    const GLenum drawBuffers[GBUFFER_DEPTH] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    for (int i = 0; i < GBUFFER_DEPTH; ++i)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[i], GL_TEXTURE_2D, textures[i], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[GBUFFER_DEPTH], 0);
+    glDrawBuffers(GBUFFER_DEPTH, drawBuffers);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+    if (!complete)
+    {
+        std::cout << "G-buffer framebuffer is incomplete" << std::endl;
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+
+/* ------------------- Release the targets -------------------*/
+void GBuffer::destroy()
+{
+    if (fbo == 0)
+        return;
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(GBUFFER_TARGET_COUNT, textures);
+    fbo = 0;
+    for (int i = 0; i < GBUFFER_TARGET_COUNT; ++i)
+        textures[i] = 0;
+    width = height = 0;
+}
+
+
+/* ------------------- Geometry pass: write the nearest surfaces -------------------*/
+void GBuffer::beginGeometry()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+
+/* ------------------- Lighting pass: read them back in the output -------------------*/
+void GBuffer::beginLighting(GLuint firstUnit)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+    glBindTextures(firstUnit, GBUFFER_TARGET_COUNT, textures);
+}
@@ -0,0 +1,54 @@
+// Author: Joshua Gauthier
+// Geometry buffer of the deferred shading path
+
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include "GLLoader.h"
+
+// Targets the geometry pass writes, in the order of the fragment outputs
+enum GBufferTarget
+{
+    GBUFFER_ALBEDO,         // RGBA8: texture color
+    GBUFFER_NORMAL,         // RGBA16F: world normal
+    GBUFFER_MATERIAL,       // RGBA16F: ambient strength, specular intensity
+    GBUFFER_DEPTH,          // DEPTH_COMPONENT32F
+    GBUFFER_TARGET_COUNT
+};
+
+// The nearest surface of every pixel: what the lighting pass needs to shade
+// it, so that lights are evaluated once per pixel however many objects
+// overlap there. 24 bytes per pixel.
+//
+// usage: create() while the framebuffer the frame ends up in is bound, then
+// every frame beginGeometry(), draw the objects with their geometry-pass
+// outputs, beginLighting() and draw one fullscreen pass
+class GBuffer
+{
+public:
+    GBuffer() : width(0), height(0), fbo(0), outputFbo(0) { for (int i = 0; i < GBUFFER_TARGET_COUNT; ++i) textures[i] = 0; }
+    ~GBuffer() { destroy(); }
+
+    // creates the targets; the framebuffer bound now is the one beginLighting() returns to
+    bool create(int width, int height);
+    void destroy();
+
+    // binds the targets and clears them
+    void beginGeometry();
+    // binds the output framebuffer again and the targets to texture units
+    // firstUnit and up, in GBufferTarget order
+    void beginLighting(GLuint firstUnit);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    size_t getByteCount() const { return (size_t)width * height * 24; }
+
+private:
+    int width;
+    int height;
+    GLuint fbo;
+    GLint outputFbo;
+    GLuint textures[GBUFFER_TARGET_COUNT];
+};
+
+#endif
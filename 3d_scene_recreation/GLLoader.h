@@ -0,0 +1,18 @@
+// Author: Joshua Gauthier
+// Single include point for GLEW
+
+#ifndef GL_LOADER_H
+#define GL_LOADER_H
+
+#ifdef BREAKFAST_HEADLESS
+// Count every GL entry point GLEW dispatches (GL 1.2 and up; the GL 1.1
+// exports such as glDrawElements and glBindTexture are not included) so the
+// benchmark can report driver calls per frame
+extern unsigned long long gGLCallCount;
+inline void UCountGLCall() { ++gGLCallCount; }
+#define GLEW_GET_FUN(x) (UCountGLCall(), x)
+#endif
+
+#include <GL/glew.h>
+
+#endif
@@ -0,0 +1,291 @@
+// Author: Joshua Gauthier
+// All scene meshes packed into one vertex buffer and one index buffer
+
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "GeometryArena.h"
+
+namespace
+{
+    // every stored format the arena can pick at runtime
+    // constant-initialized, so globals constructed before main can use it
+    constexpr VertexCodec VERTEX_CODECS[] = {
+        UGetVertexCodec<VertexP3N3T2>("float"),
+        UGetVertexCodec<VertexUnorm16Oct>("unorm16"),
+        UGetVertexCodec<VertexHalfOct>("half"),
+    };
+
+    GLenum UGetAttributeType(VertexAttributeType type)
+    {
+        switch (type)
+        {
+        case ATTRIBUTE_HALF_FLOAT: return GL_HALF_FLOAT;
+        case ATTRIBUTE_UNORM16: return GL_UNSIGNED_SHORT;
+        case ATTRIBUTE_SNORM16: return GL_SHORT;
+        default: return GL_FLOAT;
+        }
+    }
+
+    const unsigned int RESTART_INDEX = 0xffffffff;
+}
+
+
+/* ------------------- Construct with the full-precision format -------------------*/
+GeometryArena::GeometryArena()
+    : vertexCount(0), indexCount(0), maxMeshVertexCount(0), indexWidth(4), topology(INDEX_TRIANGLES),
+      codec(VERTEX_CODECS[0]), error(), vao(0), vbo(0), ibo(0)
+{
+}
+
+
+/* ------------------- Pick the stored vertex format -------------------*/
+bool GeometryArena::setVertexFormat(const char* name)
+{
+    for (const VertexCodec& candidate : VERTEX_CODECS)
+    {
+        if (strcmp(candidate.name, name) == 0)
+        {
+            codec = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* ------------------- Register an indexed mesh -------------------*/
+int GeometryArena::addMesh(const float* interleavedVertices, unsigned int vertexCount,
+    const void* meshIndices, unsigned int indexCount, unsigned int meshIndexWidth, IndexTopology meshTopology)
+{
+    // bounds of the mesh: quantized formats store positions relative to them
+    float boundsMin[3] = { INFINITY, INFINITY, INFINITY };
+    float boundsMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (unsigned int i = 0; i < vertexCount; ++i)
+    {
+        const float* position = interleavedVertices + i * FLOATS_PER_VERTEX;
+        for (int k = 0; k < 3; ++k)
+        {
+            boundsMin[k] = fminf(boundsMin[k], position[k]);
+            boundsMax[k] = fmaxf(boundsMax[k], position[k]);
+        }
+    }
+
+    // bounding sphere around the center of the bounds: exact for a sphere,
+    // much tighter than the box diagonal for a cylinder
+    float radiusSquared = 0.0f;
+    for (unsigned int i = 0; i < vertexCount; ++i)
+    {
+        const float* position = interleavedVertices + i * FLOATS_PER_VERTEX;
+        float distanceSquared = 0.0f;
+        for (int k = 0; k < 3; ++k)
+        {
+            float d = position[k] - (boundsMin[k] + boundsMax[k]) * 0.5f;
+            distanceSquared += d * d;
+        }
+        radiusSquared = fmaxf(radiusSquared, distanceSquared);
+    }
+
+    MeshRange range;
+    range.baseVertex = (GLint)this->vertexCount;
+    range.firstIndex = (GLuint)indices.size();
+    range.decode = codec.positionDecode(boundsMin, boundsMax);
+    memcpy(range.boundsMin, boundsMin, sizeof(boundsMin));
+    memcpy(range.boundsMax, boundsMax, sizeof(boundsMax));
+    range.boundsRadius = sqrtf(radiusSquared);
+
+    // encode every vertex once, and decode it again to track the worst error
+    size_t first = vertices.size();
+    vertices.resize(first + (size_t)vertexCount * codec.stride);
+    for (unsigned int i = 0; i < vertexCount; ++i)
+    {
+        const float* source = interleavedVertices + i * FLOATS_PER_VERTEX;
+        unsigned char* stored = &vertices[first + (size_t)i * codec.stride];
+        codec.encode(stored, range.decode, source);
+
+        float decoded[FLOATS_PER_VERTEX];
+        codec.decode(stored, range.decode, decoded);
+        for (int k = 0; k < 3; ++k)
+            error.position = fmaxf(error.position, fabsf(decoded[k] - source[k]));
+        if (source[3] != 0.0f || source[4] != 0.0f || source[5] != 0.0f)   // degenerate faces carry a zero normal
+        {
+            // atan2 of |cross| and dot stays accurate for tiny angles, acos does not
+            double cx = (double)decoded[4] * source[5] - (double)decoded[5] * source[4];
+            double cy = (double)decoded[5] * source[3] - (double)decoded[3] * source[5];
+            double cz = (double)decoded[3] * source[4] - (double)decoded[4] * source[3];
+            double dot = (double)decoded[3] * source[3] + (double)decoded[4] * source[4] + (double)decoded[5] * source[5];
+            float degrees = (float)(atan2(sqrt(cx * cx + cy * cy + cz * cz), dot) * 57.29577951308232);
+            error.normalDegrees = fmaxf(error.normalDegrees, degrees);
+        }
+        for (int k = 6; k < 8; ++k)
+            error.texCoord = fmaxf(error.texCoord, fabsf(decoded[k] - source[k]));
+    }
+    this->vertexCount += vertexCount;
+    if (vertexCount > maxMeshVertexCount)
+        maxMeshVertexCount = vertexCount;
+
+    // indices stay relative to the mesh; baseVertex moves them at draw time
+    // widened to 32 bits until upload(), with the restart index widened too
+    std::vector<unsigned int> source(indexCount);
+    for (unsigned int i = 0; i < indexCount; ++i)
+    {
+        source[i] = meshIndexWidth == 2 ? ((const unsigned short*)meshIndices)[i] : ((const unsigned int*)meshIndices)[i];
+        if (meshIndexWidth == 2 && source[i] == 0xffff)
+            source[i] = RESTART_INDEX;
+    }
+
+    if (meshTopology == topology)
+    {
+        indices.insert(indices.end(), source.begin(), source.end());
+    }
+    else if (topology == INDEX_TRIANGLE_STRIP)
+    {
+        // a list becomes one 3-index strip per triangle
+        for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+        {
+            if (i > 0)
+                indices.push_back(RESTART_INDEX);
+            indices.insert(indices.end(), &source[i], &source[i] + 3);
+        }
+    }
+    else
+    {
+        // strips are unrolled into their triangles, odd ones swapped to keep
+        // the winding, degenerate ones dropped
+        unsigned int stripStart = 0;
+        for (unsigned int i = 0; i < indexCount; ++i)
+        {
+            if (source[i] == RESTART_INDEX)
+            {
+                stripStart = i + 1;
+                continue;
+            }
+            if (i < stripStart + 2)
+                continue;
+
+            unsigned int a = source[i - 2], b = source[i - 1], c = source[i];
+            if (a == b || b == c || a == c)
+                continue;
+            if ((i - stripStart) % 2 == 1)
+                std::swap(a, b);
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+    }
+    range.indexCount = (GLsizei)(indices.size() - range.firstIndex);
+    range.triangleCount = range.indexCount / 3;
+    if (topology == INDEX_TRIANGLE_STRIP)
+    {
+        // every strip of n indices submits n - 2 triangles
+        range.triangleCount = 0;
+        GLsizei stripLength = 0;
+        for (size_t i = range.firstIndex; i <= indices.size(); ++i)
+        {
+            if (i == indices.size() || indices[i] == RESTART_INDEX)
+            {
+                range.triangleCount += stripLength > 2 ? stripLength - 2 : 0;
+                stripLength = 0;
+            }
+            else
+            {
+                ++stripLength;
+            }
+        }
+    }
+    this->indexCount = (unsigned int)indices.size();
+
+    meshes.push_back(range);
+    return (int)meshes.size() - 1;
+}
+
+
+/* ------------------- Register a non-indexed mesh -------------------*/
+int GeometryArena::addMesh(const float* interleavedVertices, unsigned int vertexCount)
+{
+    // a plain triangle list is drawn through the sequential indices 0..n-1
+    std::vector<unsigned int> sequential(vertexCount);
+    for (unsigned int i = 0; i < vertexCount; ++i)
+        sequential[i] = i;
+
+    return addMesh(interleavedVertices, vertexCount, sequential.data(), vertexCount);
+}
+
+
+/* ------------------- Create the immutable GPU buffers -------------------*/
+void GeometryArena::upload()
+{
+    const GLint stride = (GLint)codec.stride;
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
+
+    glBindVertexArray(vao);
+
+    // immutable storage: written once here, never re-specified
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferStorage(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), 0);
+
+    // 16-bit indices whenever every mesh can address its vertices with them,
+    // keeping 0xffff free as the restart index
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    indexWidth = maxMeshVertexCount <= MeshIndices::MAX_16BIT_VERTICES ? 2 : 4;
+    if (indexWidth == 2)
+    {
+        std::vector<unsigned short> narrow(indices.begin(), indices.end());     // restart truncates to 0xffff
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, narrow.size() * sizeof(unsigned short), narrow.data(), 0);
+    }
+    else
+    {
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), 0);
+    }
+
+    // strips restart on the all-ones index of whichever width was picked
+    if (topology == INDEX_TRIANGLE_STRIP)
+        glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+
+    // position, normal and texture coordinate attributes, as the format lays them out
+    for (int i = 0; i < codec.attributeCount; ++i)
+    {
+        const VertexAttribute& attribute = codec.attributes[i];
+        glVertexAttribPointer(attribute.location, attribute.components, UGetAttributeType(attribute.type),
+            attribute.normalized ? GL_TRUE : GL_FALSE, stride, (void*)(size_t)attribute.offset);
+        glEnableVertexAttribArray(attribute.location);
+    }
+
+    glBindVertexArray(0);
+
+    // the GPU has its own copy now
+    std::vector<unsigned char>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
+}
+
+
+/* ------------------- Draw one registered mesh -------------------*/
+void GeometryArena::draw(int mesh) const
+{
+    const MeshRange& range = meshes[mesh];
+    glDrawElementsBaseVertex(getPrimitiveMode(), range.indexCount, getIndexType(),
+        (void*)((size_t)range.firstIndex * indexWidth), range.baseVertex);
+}
+
+
+/* ------------------- Draw many copies of one registered mesh -------------------*/
+void GeometryArena::drawInstanced(int mesh, GLsizei instanceCount) const
+{
+    const MeshRange& range = meshes[mesh];
+    glDrawElementsInstancedBaseVertex(getPrimitiveMode(), range.indexCount, getIndexType(),
+        (void*)((size_t)range.firstIndex * indexWidth), instanceCount, range.baseVertex);
+}
+
+
+/* ------------------- Release the GPU buffers -------------------*/
+void GeometryArena::destroy()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ibo);
+    vao = vbo = ibo = 0;
+}
@@ -0,0 +1,123 @@
+// Author: Joshua Gauthier
+// All scene meshes packed into one vertex buffer and one index buffer
+
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <type_traits>
+#include <vector>
+#include "GLLoader.h"
+#include "MeshIndices.h"
+#include "VertexFormat.h"
+
+// Where a registered mesh lives inside the arena's buffers
+struct MeshRange
+{
+    GLint baseVertex;       // added to every index of the mesh
+    GLuint firstIndex;      // offset into the index buffer, in indices
+    GLsizei indexCount;
+    GLsizei triangleCount;  // triangles submitted per draw, degenerate strip joins included
+    VertexDecode decode;    // position = decode.offset + decode.scale * stored position
+    float boundsMin[3];     // model-space bounds of the registered vertices
+    float boundsMax[3];
+    float boundsRadius;     // farthest vertex from the center of the bounds
+};
+
+// Worst difference between the registered vertices and what the GPU decodes
+struct VertexFormatError
+{
+    float position;         // model units
+    float normalDegrees;
+    float texCoord;
+};
+
+// Sub-allocates every mesh into one immutable vertex buffer and one immutable
+// index buffer, read through a single VAO. Meshes are registered as full-precision
+// VertexP3N3T2 data (8 floats, 32 bytes per vertex) and stored in the arena's
+// vertex format: "float" keeps that layout, "unorm16" and "half" quantize each
+// mesh against its own bounds into 16 bytes (see VertexFormat.h).
+// Every mesh shares one index type and one primitive mode, so that the meshes
+// can go through a single multi-draw: 16-bit indices when no mesh has more than
+// 65535 vertices (indices are relative to baseVertex), and either triangle
+// lists or restart-separated triangle strips; meshes registered in the other
+// topology are converted.
+//
+// usage: register meshes with addMesh(), then upload() once; each frame
+// bind() once and draw(mesh) per object or drawInstanced(mesh, n) per mesh
+class GeometryArena
+{
+public:
+    typedef VertexP3N3T2 SourceFormat;
+    static const int FLOATS_PER_VERTEX = sizeof(SourceFormat::Vertex) / sizeof(float);
+
+    GeometryArena();
+    ~GeometryArena() {}
+
+    // pick the stored vertex format by name ("float", "unorm16", "half") before
+    // the first addMesh. Returns false for an unknown name
+    bool setVertexFormat(const char* name);
+    const VertexCodec& getVertexFormat() const { return codec; }
+
+    // pick the primitive mode of every mesh before the first addMesh
+    void setIndexTopology(IndexTopology topology) { this->topology = topology; }
+    IndexTopology getIndexTopology() const { return topology; }
+
+    // register indexed interleaved data, 8 floats per vertex, with meshIndexWidth
+    // bytes per index (strips restart on the all-ones index). Returns the mesh handle
+    int addMesh(const float* interleavedVertices, unsigned int vertexCount,
+        const void* indices, unsigned int indexCount,
+        unsigned int meshIndexWidth = 4, IndexTopology meshTopology = INDEX_TRIANGLES);
+    // register non-indexed interleaved data (plain triangle list)
+    int addMesh(const float* interleavedVertices, unsigned int vertexCount);
+
+    // register a Sphere, Cylinder or anything else with the same getters
+    template <class Shape>
+    int addShape(const Shape& shape)
+    {
+        static_assert(std::is_same<typename Shape::Vertex, SourceFormat::Vertex>::value,
+            "the arena holds VertexP3N3T2 vertices only");
+        return addMesh(&shape.getInterleavedVertices()->position[0], shape.getInterleavedVertexCount(),
+            shape.getIndices(), shape.getIndexCount(), shape.getIndexWidth(), shape.getIndexTopology());
+    }
+
+    // create the GPU buffers from everything registered so far and free the CPU copy
+    void upload();
+    void destroy();
+
+    // bind the shared VAO (once per frame)
+    void bind() const { glBindVertexArray(vao); }
+    // draw one mesh; the arena VAO must be bound
+    void draw(int mesh) const;
+    // draw instanceCount copies of one mesh in a single call (gl_InstanceID 0..n-1)
+    void drawInstanced(int mesh, GLsizei instanceCount) const;
+    // for glMultiDrawElementsIndirect and friends, valid after upload()
+    GLenum getPrimitiveMode() const { return topology == INDEX_TRIANGLE_STRIP ? GL_TRIANGLE_STRIP : GL_TRIANGLES; }
+    GLenum getIndexType() const { return indexWidth == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+    unsigned int getIndexWidth() const { return indexWidth; }   // bytes per index
+
+    const MeshRange& getMesh(int mesh) const { return meshes[mesh]; }
+    int getMeshCount() const { return (int)meshes.size(); }
+    unsigned int getVertexCount() const { return vertexCount; }
+    unsigned int getIndexCount() const { return indexCount; }
+    const VertexFormatError& getFormatError() const { return error; }
+    GLuint getVao() const { return vao; }
+    GLuint getVertexBuffer() const { return vbo; }
+    GLuint getIndexBuffer() const { return ibo; }
+
+private:
+    std::vector<MeshRange> meshes;
+    std::vector<unsigned char> vertices;    // staging in the stored format until upload()
+    std::vector<unsigned int> indices;      // staging until upload(), restart = 0xffffffff
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    unsigned int maxMeshVertexCount;        // picks the index width at upload()
+    unsigned int indexWidth;
+    IndexTopology topology;
+    VertexCodec codec;
+    VertexFormatError error;
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+};
+
+#endif
@@ -0,0 +1,111 @@
+// Author: Joshua Gauthier
+// Shared unit meshes of the procedural primitives, keyed by their tessellation
+
+#include <algorithm>
+
+#include "Cylinder.h"
+#include "GeometryCache.h"
+#include "Sphere.h"
+
+
+/* ------------------- Describe a sphere instance -------------------*/
+PrimitiveShape USpherePrimitive(float radius, int sectorCount, int stackCount, bool smooth)
+{
+    PrimitiveShape shape;
+    shape.key.type = PRIMITIVE_SPHERE;
+    shape.key.sectorCount = sectorCount;
+    shape.key.stackCount = stackCount;
+    shape.key.smooth = smooth;
+    shape.scale = glm::vec3(radius);
+    shape.radiusScale = glm::vec2(1.0f);
+    return shape;
+}
+
+
+/* ------------------- Describe a cylinder instance -------------------*/
+PrimitiveShape UCylinderPrimitive(float baseRadius, float topRadius, float height,
+    int sectorCount, int stackCount, bool smooth)
+{
+    PrimitiveShape shape;
+    shape.key.type = PRIMITIVE_CYLINDER;
+    shape.key.sectorCount = sectorCount;
+    shape.key.stackCount = stackCount;
+    shape.key.smooth = smooth;
+
+    // the model matrix carries the larger radius, the uniform scales each end
+    // down to its own; a straight cylinder is a pure scale
+    float maxRadius = std::max(baseRadius, topRadius);
+    shape.scale = glm::vec3(maxRadius, maxRadius, height);
+    shape.radiusScale = glm::vec2(1.0f);
+    if (maxRadius > 0.0f)
+        shape.radiusScale = glm::vec2(baseRadius / maxRadius, topRadius / maxRadius);
+    return shape;
+}
+
+
+/* ------------------- Look up or build the unit mesh of a key -------------------*/
+int GeometryCache::get(const PrimitiveKey& key)
+{
+    std::promise<int> built;
+    std::shared_future<int> mesh;
+    bool builder = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = meshes.find(key);
+        if (found != meshes.end())
+        {
+            ++hits;
+            mesh = found->second;
+        }
+        else
+        {
+            ++misses;
+            mesh = built.get_future().share();
+            meshes[key] = mesh;
+            builder = true;
+        }
+    }
+
+    // tessellate without holding the map, so other keys proceed; callers of
+    // the same key wait on the future instead
+    if (builder)
+    {
+        try
+        {
+            built.set_value(build(key));
+        }
+        catch (...)
+        {
+            // the waiters get the exception; the key is forgotten, so a later
+            // request builds it again instead of inheriting a broken future
+            built.set_exception(std::current_exception());
+            std::lock_guard<std::mutex> lock(mutex);
+            meshes.erase(key);
+        }
+    }
+    return mesh.get();
+}
+
+
+/* ------------------- Tessellate a unit primitive into the arena -------------------*/
+int GeometryCache::build(const PrimitiveKey& key)
+{
+    // generated in the arena's topology, so nothing is converted. The shapes
+    // start at their smallest tessellation (the counts clamp up) and are only
+    // built at full size by set(), once the topology is chosen
+    bool strips = arena.getIndexTopology() == INDEX_TRIANGLE_STRIP;
+    if (key.type == PRIMITIVE_SPHERE)
+    {
+        Sphere sphere(1.0f, 0, 0, key.smooth);
+        sphere.setStrips(strips);
+        sphere.set(1.0f, key.sectorCount, key.stackCount, key.smooth);
+        std::lock_guard<std::mutex> lock(arenaMutex);
+        return arena.addShape(sphere);
+    }
+
+    Cylinder cylinder(1.0f, 1.0f, 1.0f, 0, 0, key.smooth);
+    cylinder.setStrips(strips);
+    cylinder.set(1.0f, 1.0f, 1.0f, key.sectorCount, key.stackCount, key.smooth);
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    return arena.addShape(cylinder);
+}
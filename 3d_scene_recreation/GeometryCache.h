@@ -0,0 +1,81 @@
+// Author: Joshua Gauthier
+// Shared unit meshes of the procedural primitives, keyed by their tessellation
+
+#ifndef GEOMETRY_CACHE_H
+#define GEOMETRY_CACHE_H
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <mutex>
+#include <glm/glm.hpp>
+#include "GeometryArena.h"
+
+enum PrimitiveType
+{
+    PRIMITIVE_SPHERE,       // radius 1
+    PRIMITIVE_CYLINDER      // base and top radius 1, height 1
+};
+
+// Everything that changes the vertices and indices of a unit primitive
+struct PrimitiveKey
+{
+    PrimitiveType type;
+    int sectorCount;
+    int stackCount;
+    bool smooth;
+
+    bool operator<(const PrimitiveKey& other) const
+    {
+        if (type != other.type) return type < other.type;
+        if (sectorCount != other.sectorCount) return sectorCount < other.sectorCount;
+        if (stackCount != other.stackCount) return stackCount < other.stackCount;
+        return smooth < other.smooth;
+    }
+};
+
+// One sphere or cylinder of the scene: the unit mesh it shares and how this
+// instance stretches it. scale goes into the model matrix; radiusScale is the
+// per-instance uniform of the vertex shaders, the base and top radius of a
+// tapered cylinder over scale.x (1, 1 for everything else)
+struct PrimitiveShape
+{
+    PrimitiveKey key;
+    glm::vec3 scale;
+    glm::vec2 radiusScale;
+};
+
+PrimitiveShape USpherePrimitive(float radius, int sectorCount, int stackCount, bool smooth = true);
+PrimitiveShape UCylinderPrimitive(float baseRadius, float topRadius, float height,
+    int sectorCount, int stackCount, bool smooth = true);
+
+// Registers each unique primitive tessellation in the geometry arena once.
+// Shapes only differ by their model matrix and radiusScale, so every cup,
+// plate or orange with the same sector/stack counts draws the same mesh.
+// get() may be called from any thread before the arena is uploaded: the
+// first caller of a key builds it while later callers of that key wait for
+// its handle; different keys build concurrently, and only the registration
+// in the arena is serialized.
+class GeometryCache
+{
+public:
+    explicit GeometryCache(GeometryArena& arena) : arena(arena), hits(0), misses(0) {}
+
+    // arena handle of the unit mesh of key, built on the first request
+    int get(const PrimitiveKey& key);
+
+    unsigned long long getHits() const { return hits; }
+    unsigned long long getMisses() const { return misses; }     // = unique meshes built
+
+private:
+    int build(const PrimitiveKey& key);
+
+    GeometryArena& arena;
+    std::mutex mutex;                   // guards meshes
+    std::mutex arenaMutex;              // serializes addShape
+    std::map<PrimitiveKey, std::shared_future<int>> meshes;
+    std::atomic<unsigned long long> hits;
+    std::atomic<unsigned long long> misses;
+};
+
+#endif
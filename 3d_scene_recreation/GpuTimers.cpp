@@ -0,0 +1,189 @@
+// Author: Joshua Gauthier
+// Per-pass GPU timing with GL_TIME_ELAPSED queries (BREAKFAST_GPU_TIMERS builds)
+
+#include <cstring>          // strcmp
+#include <iostream>         // cout
+
+#include "GpuTimers.h"
+
+
+/* ------------------- Open the CSV output -------------------*/
+void GpuTimers::create(const char* csvPath)
+{
+    if (csvPath == NULL)
+        return;
+
+    csv = fopen(csvPath, "w");
+    if (csv == NULL)
+    {
+        std::cout << "Failed to open " << csvPath << " for GPU timings" << std::endl;
+        return;
+    }
+    fprintf(csv, "frame,pass,gpu_ms,rolling_avg_ms\n");
+}
+
+
+/* ------------------- Start a frame -------------------*/
+void GpuTimers::beginFrame()
+{
+    ++frame;
+
+    // this slot was last used FRAME_DEPTH frames ago: its results should be ready
+    FrameQueries& slot = frames[frame % FRAME_DEPTH];
+    resolve(slot, false);
+    slot.frame = frame;
+
+    if (frame % REPORT_INTERVAL == 0)
+        report();
+}
+
+
+/* ------------------- Open a pass -------------------*/
+void GpuTimers::begin(int pass)
+{
+    FrameQueries& slot = frames[frame % FRAME_DEPTH];
+
+    // grow the pool the first time a frame has this many passes
+    if (slot.pending.size() == slot.pool.size())
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        slot.pool.push_back(query);
+    }
+
+    PendingQuery pending;
+    pending.query = slot.pool[slot.pending.size()];
+    pending.pass = pass;
+    slot.pending.push_back(pending);
+
+    glBeginQuery(GL_TIME_ELAPSED, pending.query);
+    active = true;
+}
+
+
+/* ------------------- Close the open pass -------------------*/
+void GpuTimers::end()
+{
+    if (!active)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    active = false;
+}
+
+
+/* ------------------- Release the queries -------------------*/
+void GpuTimers::destroy()
+{
+    if (frame == 0 && csv == NULL)
+        return;
+
+    end();
+
+    // shutting down: waiting on the last frames is fine here
+    for (unsigned long long f = frame + 1; f <= frame + FRAME_DEPTH; ++f)
+        resolve(frames[f % FRAME_DEPTH], true);
+    report();
+
+    for (int i = 0; i < FRAME_DEPTH; ++i)
+    {
+        if (!frames[i].pool.empty())
+            glDeleteQueries((GLsizei)frames[i].pool.size(), frames[i].pool.data());
+        frames[i].pool.clear();
+    }
+
+    if (csv != NULL)
+        fclose(csv);
+    csv = NULL;
+    frame = 0;
+}
+
+
+/* ------------------- Pass index by name -------------------*/
+int GpuTimers::getPass(const char* name)
+{
+    for (size_t i = 0; i < passes.size(); ++i)
+    {
+        if (passes[i].name == name || strcmp(passes[i].name, name) == 0)
+            return (int)i;
+    }
+
+    Pass pass;
+    pass.name = name;
+    pass.sum = 0.0;
+    pass.sampleCount = 0;
+    pass.next = 0;
+    passes.push_back(pass);
+    return (int)passes.size() - 1;
+}
+
+
+/* ------------------- Read back one frame's queries -------------------*/
+void GpuTimers::resolve(FrameQueries& slot, bool wait)
+{
+    // never block the render loop: a frame that is not done yet is dropped
+    // whole, so no pass reports part of its total
+    for (size_t i = 0; i < slot.pending.size() && !wait; ++i)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(slot.pending[i].query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            dropped += slot.pending.size();
+            slot.pending.clear();
+            return;
+        }
+    }
+
+    // add up every run of each pass in this frame
+    frameTotals.assign(passes.size(), -1.0);
+    for (size_t i = 0; i < slot.pending.size(); ++i)
+    {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(slot.pending[i].query, GL_QUERY_RESULT, &ns);
+        double& total = frameTotals[slot.pending[i].pass];
+        total = (total < 0.0 ? 0.0 : total) + ns / 1000000.0;
+    }
+
+    for (size_t p = 0; p < passes.size(); ++p)
+    {
+        double ms = frameTotals[p];
+        if (ms < 0.0)
+            continue;
+
+        Pass& pass = passes[p];
+        if (pass.sampleCount == AVERAGE_WINDOW)
+            pass.sum -= pass.samples[pass.next];
+        else
+            ++pass.sampleCount;
+        pass.samples[pass.next] = ms;
+        pass.sum += ms;
+        pass.next = (pass.next + 1) % AVERAGE_WINDOW;
+
+        if (csv != NULL)
+            fprintf(csv, "%llu,%s,%.4f,%.4f\n", slot.frame, pass.name, ms, pass.sum / pass.sampleCount);
+    }
+
+    slot.pending.clear();
+}
+
+
+/* ------------------- Print the rolling averages -------------------*/
+void GpuTimers::report() const
+{
+    double total = 0.0;
+
+    std::cout << "GPU ms (avg of last " << AVERAGE_WINDOW << " frames):";
+    for (size_t i = 0; i < passes.size(); ++i)
+    {
+        if (passes[i].sampleCount == 0)
+            continue;
+        double avg = passes[i].sum / passes[i].sampleCount;
+        total += avg;
+        std::cout << " " << passes[i].name << " " << avg << ",";
+    }
+    std::cout << " total " << total;
+    if (dropped > 0)
+        std::cout << " (" << dropped << " samples dropped)";
+    std::cout << std::endl;
+}
@@ -0,0 +1,77 @@
+// Author: Joshua Gauthier
+// Per-pass GPU timing with GL_TIME_ELAPSED queries (BREAKFAST_GPU_TIMERS builds)
+
+#ifndef GPU_TIMERS_H
+#define GPU_TIMERS_H
+
+#include <cstdio>
+#include <vector>
+#include "GLLoader.h"
+
+// Times named passes of every frame on the GPU. The queries of a frame are
+// read back FRAME_DEPTH frames later, when the GPU has long finished them, so
+// timing never stalls the pipeline. A pass may be timed many times a frame
+// (every object with that name); its sample is the frame's total. Each pass
+// keeps a rolling average of those totals over the last AVERAGE_WINDOW
+// resolved frames, printed every REPORT_INTERVAL frames; every frame's total
+// is also appended to a CSV file.
+//
+// usage: beginFrame() once per frame, then begin()/end() around each pass.
+// Passes timed every frame look their index up once with getPass() and pass
+// it to begin(). Passes may not nest (GL allows one active GL_TIME_ELAPSED query)
+class GpuTimers
+{
+public:
+    static const int FRAME_DEPTH = 4;
+    static const int AVERAGE_WINDOW = 60;
+    static const int REPORT_INTERVAL = 120;
+
+    GpuTimers() : frame(0), active(false), csv(NULL), dropped(0) {}
+    ~GpuTimers() { destroy(); }
+
+    // opens the CSV file (NULL for stdout only)
+    void create(const char* csvPath);
+    // reads back the frame that is about to reuse its queries
+    void beginFrame();
+    // index of the pass called name, added on first use; name must outlive the timers
+    int getPass(const char* name);
+    void begin(int pass);
+    void begin(const char* name) { begin(getPass(name)); }
+    void end();
+    // reads back everything still in flight, prints the final averages and closes the CSV
+    void destroy();
+
+private:
+    struct Pass
+    {
+        const char* name;
+        double samples[AVERAGE_WINDOW];     // ms, ring
+        double sum;
+        int sampleCount;
+        int next;
+    };
+    struct PendingQuery
+    {
+        GLuint query;
+        int pass;
+    };
+    struct FrameQueries
+    {
+        unsigned long long frame;
+        std::vector<GLuint> pool;           // reused frame after frame
+        std::vector<PendingQuery> pending;
+    };
+
+    void resolve(FrameQueries& slot, bool wait);
+    void report() const;
+
+    FrameQueries frames[FRAME_DEPTH];
+    std::vector<Pass> passes;
+    std::vector<double> frameTotals;    // per pass while a frame resolves, -1 when it did not run
+    unsigned long long frame;
+    bool active;
+    FILE* csv;
+    unsigned long long dropped;     // samples lost because the GPU was more than FRAME_DEPTH frames behind
+};
+
+#endif
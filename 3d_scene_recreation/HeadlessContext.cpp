@@ -0,0 +1,136 @@
+// Author: Joshua Gauthier
+// Offscreen EGL context used by the Linux benchmark build (BREAKFAST_HEADLESS)
+
+#include <cstring>          // strstr
+#include <iostream>         // cout, cerr
+
+#include "HeadlessContext.h"
+#include <EGL/eglext.h>
+
+// GL calls dispatched through GLEW since startup
+unsigned long long gGLCallCount = 0;
+
+
+/* ------------------- Create a surfaceless EGL context -------------------*/
+bool HeadlessContext::create(int glMajor, int glMinor, bool debug)
+{
+    // prefer the surfaceless platform so no X server or GPU device is needed
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    {
+        std::cerr << "Failed to initialize EGL display (error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = NULL;
+    EGLint numConfigs = 0;
+    eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cerr << "EGL does not support desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    // same version, profile and debug or no-error flag the GLFW window asks for
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    bool noError = !debug && extensions != NULL && strstr(extensions, "EGL_KHR_create_context_no_error") != NULL;
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, glMajor,
+        EGL_CONTEXT_MINOR_VERSION, glMinor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE, EGL_NONE,
+        EGL_NONE
+    };
+    // drivers without the extension reject the attribute outright, so the
+    // pair is only there when it is asked for
+    if (debug)
+    {
+        contextAttribs[6] = EGL_CONTEXT_OPENGL_DEBUG;
+        contextAttribs[7] = EGL_TRUE;
+    }
+    else if (noError)
+    {
+        contextAttribs[6] = EGL_CONTEXT_OPENGL_NO_ERROR_KHR;
+        contextAttribs[7] = EGL_TRUE;
+    }
+    context = eglCreateContext(display, numConfigs > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cerr << "Failed to create EGL context (error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        return false;
+    }
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cerr << "Failed to make EGL context current" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+/* ------------------- Create the offscreen framebuffer -------------------*/
+bool HeadlessContext::createFramebuffer(int width, int height)
+{
+    glGenRenderbuffers(1, &colorRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &depthRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRbo);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+        return false;
+    }
+
+    // the framebuffer stays bound for the whole run, just like the window's back buffer
+    glViewport(0, 0, width, height);
+
+    return true;
+}
+
+
+/* ------------------- End of frame -------------------*/
+void HeadlessContext::present() const
+{
+    glFinish();
+}
+
+
+/* ------------------- Release the framebuffer and context -------------------*/
+void HeadlessContext::destroy()
+{
+    if (context == EGL_NO_CONTEXT)
+        return;
+
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &colorRbo);
+    glDeleteRenderbuffers(1, &depthRbo);
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    context = EGL_NO_CONTEXT;
+}
@@ -0,0 +1,37 @@
+// Author: Joshua Gauthier
+// Offscreen EGL context used by the Linux benchmark build (BREAKFAST_HEADLESS)
+
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include "GLLoader.h"
+
+#define EGL_NO_X11          // keep Xlib macros (None, Status, ...) out of the scene code
+#include <EGL/egl.h>
+
+// Creates a surfaceless EGL context (Mesa llvmpipe works) and an offscreen
+// framebuffer that stands in for the GLFW window's back buffer
+class HeadlessContext
+{
+public:
+    HeadlessContext() : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), fbo(0), colorRbo(0), depthRbo(0) {}
+    ~HeadlessContext() { destroy(); }
+
+    // creates the EGL context and makes it current. Call before glewInit().
+    // Without debug, asks for a no-error context when EGL offers one
+    bool create(int glMajor, int glMinor, bool debug);
+    // creates and binds the offscreen color/depth framebuffer. Call after glewInit()
+    bool createFramebuffer(int width, int height);
+    // waits for the frame to finish so that the frame's GPU work lands in its timing
+    void present() const;
+    void destroy();
+
+private:
+    EGLDisplay display;
+    EGLContext context;
+    GLuint fbo;
+    GLuint colorRbo;
+    GLuint depthRbo;
+};
+
+#endif
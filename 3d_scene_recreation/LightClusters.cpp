@@ -0,0 +1,171 @@
+// Author: Joshua Gauthier
+// Point lights of the scene and their assignment to the clusters of the view frustum
+
+#include <algorithm>
+#include <cmath>
+
+#include "LightClusters.h"
+
+namespace
+{
+    int UClamp(int value, int low, int high)
+    {
+        return value < low ? low : (value > high ? high : value);
+    }
+
+    int UClusterIndex(int x, int y, int z)
+    {
+        return (z * LIGHT_CLUSTERS_Y + y) * LIGHT_CLUSTERS_X + x;
+    }
+}
+
+
+int LightClusters::add(const ClusterLight& light)
+{
+    lights.push_back(light);
+    return (int)lights.size() - 1;
+}
+
+
+int LightClusters::getSlice(float depth) const
+{
+    return UClamp((int)floor(log(depth) * sliceScale + sliceBias), 0, LIGHT_CLUSTERS_Z - 1);
+}
+
+
+float LightClusters::getSliceDepth(int slice) const
+{
+    return exp((slice - sliceBias) / sliceScale);
+}
+
+
+void LightClusters::addSpans(int index, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    const ClusterLight& light = lights[index];
+    ClusterSpan span = { index, 0, 0, LIGHT_CLUSTERS_X - 1, 0, LIGHT_CLUSTERS_Y - 1 };
+    float range = light.positionRange.w;
+    if (range <= 0.0f)
+    {
+        for (span.slice = 0; span.slice < LIGHT_CLUSTERS_Z; ++span.slice)
+            spans.push_back(span);
+        return;
+    }
+
+    // depth slices the sphere spans
+    glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(light.positionRange), 1.0f));
+    float depth = -center.z;
+    if (depth + range < nearPlane || depth - range > farPlane)
+        return;
+    int firstSlice = getSlice(std::max(depth - range, nearPlane));
+    int lastSlice = getSlice(std::min(depth + range, farPlane));
+
+    for (int slice = firstSlice; slice <= lastSlice; ++slice)
+    {
+        // the part of the sphere in this slice: its widest circle within the slice's depths
+        float sliceNear = std::max(getSliceDepth(slice), std::max(depth - range, nearPlane));
+        float sliceFar = std::min(getSliceDepth(slice + 1), std::min(depth + range, farPlane));
+        float closest = std::min(std::max(depth, sliceNear), sliceFar) - depth;
+        float radius = sqrt(std::max(range * range - closest * closest, 0.0f));
+
+        // tiles the projection of the box around it covers
+        glm::vec2 low(1.0f), high(-1.0f);
+        bool behind = false;
+        for (int corner = 0; corner < 8 && !behind; ++corner)
+        {
+            glm::vec4 point((corner & 1) ? center.x + radius : center.x - radius, (corner & 2) ? center.y + radius : center.y - radius,
+                (corner & 4) ? -sliceFar : -sliceNear, 1.0f);
+            glm::vec4 clip = projection * point;
+            behind = clip.w <= 1e-6f;
+            glm::vec2 ndc = glm::vec2(clip) / clip.w;
+            low = glm::min(low, ndc);
+            high = glm::max(high, ndc);
+        }
+
+        span.slice = slice;
+        if (behind)
+        {
+            span.firstX = span.firstY = 0;
+            span.lastX = LIGHT_CLUSTERS_X - 1;
+            span.lastY = LIGHT_CLUSTERS_Y - 1;
+        }
+        else
+        {
+            if (high.x < -1.0f || low.x > 1.0f || high.y < -1.0f || low.y > 1.0f)
+                continue;
+            span.firstX = UClamp((int)floor((low.x * 0.5f + 0.5f) * LIGHT_CLUSTERS_X), 0, LIGHT_CLUSTERS_X - 1);
+            span.lastX = UClamp((int)floor((high.x * 0.5f + 0.5f) * LIGHT_CLUSTERS_X), 0, LIGHT_CLUSTERS_X - 1);
+            span.firstY = UClamp((int)floor((low.y * 0.5f + 0.5f) * LIGHT_CLUSTERS_Y), 0, LIGHT_CLUSTERS_Y - 1);
+            span.lastY = UClamp((int)floor((high.y * 0.5f + 0.5f) * LIGHT_CLUSTERS_Y), 0, LIGHT_CLUSTERS_Y - 1);
+        }
+        spans.push_back(span);
+    }
+}
+
+
+void LightClusters::assign(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    sliceScale = LIGHT_CLUSTERS_Z / log(farPlane / nearPlane);
+    sliceBias = -log(nearPlane) * sliceScale;
+
+    const unsigned int listStart = 2 * LIGHT_CLUSTER_COUNT;
+    int lightCount = (int)lights.size();
+
+    // without clusters every cluster shares one list of all the lights
+    if (!clustered)
+    {
+        data.resize(listStart + lightCount);
+        for (int c = 0; c < LIGHT_CLUSTER_COUNT; ++c)
+        {
+            data[2 * c] = listStart;
+            data[2 * c + 1] = lightCount;
+        }
+        for (int i = 0; i < lightCount; ++i)
+            data[listStart + i] = i;
+        litClusters = lightCount > 0 ? LIGHT_CLUSTER_COUNT : 0;
+        maxClusterLights = lightCount;
+        clusterLights = (long long)lightCount * LIGHT_CLUSTER_COUNT;
+        return;
+    }
+
+    // count the lights of every cluster, keeping the spans for the second pass
+    data.assign(listStart, 0);
+    spans.clear();
+    for (int i = 0; i < lightCount; ++i)
+        addSpans(i, view, projection, nearPlane, farPlane);
+    for (size_t s = 0; s < spans.size(); ++s)
+    {
+        const ClusterSpan& span = spans[s];
+        for (int y = span.firstY; y <= span.lastY; ++y)
+            for (int x = span.firstX; x <= span.lastX; ++x)
+                ++data[2 * UClusterIndex(x, y, span.slice) + 1];
+    }
+
+    // list starts, then the lists themselves
+    unsigned int offset = listStart;
+    litClusters = 0;
+    maxClusterLights = 0;
+    for (int c = 0; c < LIGHT_CLUSTER_COUNT; ++c)
+    {
+        unsigned int count = data[2 * c + 1];
+        data[2 * c] = offset;
+        data[2 * c + 1] = 0;
+        offset += count;
+        if (count > 0)
+            ++litClusters;
+        maxClusterLights = std::max(maxClusterLights, (int)count);
+    }
+    data.resize(offset);
+    clusterLights = offset - listStart;
+
+    // spans are in light order, so every list comes out sorted by light
+    for (size_t s = 0; s < spans.size(); ++s)
+    {
+        const ClusterSpan& span = spans[s];
+        for (int y = span.firstY; y <= span.lastY; ++y)
+            for (int x = span.firstX; x <= span.lastX; ++x)
+            {
+                int c = UClusterIndex(x, y, span.slice);
+                data[data[2 * c] + data[2 * c + 1]++] = span.light;
+            }
+    }
+}
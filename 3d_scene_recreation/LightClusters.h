@@ -0,0 +1,91 @@
+// Author: Joshua Gauthier
+// Point lights of the scene and their assignment to the clusters of the view frustum
+
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Froxel grid: screen tiles times exponential depth slices
+const int LIGHT_CLUSTERS_X = 16;
+const int LIGHT_CLUSTERS_Y = 9;
+const int LIGHT_CLUSTERS_Z = 24;
+const int LIGHT_CLUSTER_COUNT = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+
+// One entry of the LightBuffer storage block (std430)
+struct ClusterLight
+{
+    glm::vec4 positionRange;    // world position; range 0 reaches everywhere with no falloff
+    glm::vec4 colorStrength;    // rgb, strength
+};
+
+// Every light of the scene and, each frame, the lights that can reach each
+// cluster of the view frustum. A cluster is one of 16x9 screen tiles at one
+// of 24 depth slices, spaced exponentially between the near and far planes
+// so that they stay roughly cubic. assign() finds the slices each light's
+// sphere spans in view space and, per slice, projects the box around the
+// part of the sphere inside it to a range of tiles; the light is listed in
+// every cluster of those ranges. Lights without a range are listed in every
+// cluster.
+//
+// The result is the layout of the ClusterBuffer storage block: per cluster
+// the start and length of its list, then the lists back to back (starts
+// count from the beginning of the block). A fragment finds its cluster from
+// gl_FragCoord and its view depth and loops over that list only, so its
+// cost follows the lights around it rather than the lights in the scene.
+//
+// usage: add() the lights, then every frame assign() and upload getData()
+class LightClusters
+{
+public:
+    LightClusters() : clustered(true), sliceScale(0.0f), sliceBias(0.0f), litClusters(0), maxClusterLights(0), clusterLights(0) {}
+
+    void clear() { lights.clear(); }
+    int add(const ClusterLight& light);
+    int size() const { return (int)lights.size(); }
+    const ClusterLight* getLights() const { return lights.data(); }
+
+    // false lists every light in every cluster: the cost of lighting without clusters
+    void setClustered(bool enabled) { clustered = enabled; }
+    bool isClustered() const { return clustered; }
+
+    void assign(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+
+    // ClusterBuffer contents of the last assign()
+    const std::vector<unsigned int>& getData() const { return data; }
+    // view depth to slice: int(log(depth) * scale + bias), as the shaders compute it
+    float getSliceScale() const { return sliceScale; }
+    float getSliceBias() const { return sliceBias; }
+    // clusters with at least one light, the longest list, and the lengths of all of them
+    int getLitClusterCount() const { return litClusters; }
+    int getMaxClusterLights() const { return maxClusterLights; }
+    long long getClusterLightCount() const { return clusterLights; }
+
+private:
+    // tiles of one slice a light reaches
+    struct ClusterSpan
+    {
+        int light;
+        int slice;
+        int firstX, lastX;
+        int firstY, lastY;
+    };
+
+    // appends the spans of one light; none when it is outside the frustum
+    void addSpans(int index, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    int getSlice(float depth) const;
+    float getSliceDepth(int slice) const;
+
+    std::vector<ClusterLight> lights;
+    bool clustered;
+    float sliceScale;
+    float sliceBias;
+    std::vector<unsigned int> data;
+    std::vector<ClusterSpan> spans;
+    int litClusters;
+    int maxClusterLights;
+    long long clusterLights;
+};
+
+#endif
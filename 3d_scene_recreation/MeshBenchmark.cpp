@@ -0,0 +1,344 @@
+// Author: Joshua Gauthier
+// Microbenchmark of the sphere and cylinder builders (Linux build: mesh_bench)
+//
+// For 36x18, 512x256 and 4096x2048 grids it reports vertices per second of
+//   legacy   - the per-vertex cosf/sinf loop Sphere::buildVerticesSmooth used to run
+//   rings    - USphereRings with each sin/cos path the CPU supports
+//   Sphere   - a whole smooth Sphere (rings and indices)
+// plus the throughput and worst error of each USinCosRamp path.
+//
+// It also builds every shape at each size through a counting memory resource,
+// reports the peak and resident bytes per vertex of each build, and fails
+// (exit code 1) when the number of allocations depends on the size. Then it
+// builds both shapes in each quantized vertex format and reports the worst
+// error against the float build. Last, it compares the triangle list and the
+// triangle strip index arrays of both shapes: index count, bytes against the
+// old 32-bit list, and vertex shader runs per triangle through a simulated
+// post-transform cache.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory_resource>
+#include <vector>
+
+#include "Cylinder.h"
+#include "MeshKernels.h"
+#include "Sphere.h"
+
+using namespace std;
+
+namespace
+{
+    typedef chrono::high_resolution_clock Clock;
+
+    // keeps the optimizer from dropping the work
+    volatile float gSink;
+
+    // Forwards to new/delete and counts the allocations and live bytes
+    class CountingResource : public std::pmr::memory_resource
+    {
+    public:
+        CountingResource() : allocations(0), bytes(0), peakBytes(0) {}
+        int allocations;
+        size_t bytes;           // live right now
+        size_t peakBytes;       // most ever live at once
+
+    private:
+        void* do_allocate(size_t size, size_t alignment) override
+        {
+            ++allocations;
+            bytes += size;
+            peakBytes = max(peakBytes, bytes);
+            return std::pmr::new_delete_resource()->allocate(size, alignment);
+        }
+        void do_deallocate(void* p, size_t size, size_t alignment) override
+        {
+            bytes -= size;
+            std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    // allocations and memory of one Sphere or Cylinder build at the given size
+    struct BuildCost
+    {
+        int allocations;
+        double peakBytesPerVertex;      // everything live at once during the build
+        double residentBytesPerVertex;  // what the finished shape keeps
+    };
+
+    template <class Shape>
+    BuildCost UMeasureBuild(CountingResource& counter, const Shape& shape)
+    {
+        gSink = shape.getInterleavedVertices()[0].position[0];
+        BuildCost cost;
+        cost.allocations = counter.allocations;
+        cost.peakBytesPerVertex = (double)counter.peakBytes / shape.getVertexCount();
+        cost.residentBytesPerVertex = (double)counter.bytes / shape.getVertexCount();
+        return cost;
+    }
+
+    // strips are measured as a rebuild of the list shape, counting from the rebuild only
+    template <class Shape>
+    BuildCost UMeasureBuild(CountingResource& counter, Shape& shape, bool strips)
+    {
+        if (strips)
+        {
+            counter.allocations = 0;
+            counter.peakBytes = counter.bytes;
+            shape.setStrips(true);
+        }
+        return UMeasureBuild(counter, shape);
+    }
+
+    BuildCost UMeasureBuild(bool sphere, bool smooth, bool strips, int sectors, int stacks)
+    {
+        CountingResource counter;
+        if (sphere)
+        {
+            Sphere shape(1.0f, sectors, stacks, smooth, &counter);
+            return UMeasureBuild(counter, shape, strips);
+        }
+        Cylinder shape(1.0f, 0.5f, 2.0f, sectors, stacks, smooth, &counter);
+        return UMeasureBuild(counter, shape, strips);
+    }
+
+    // The ring loop Sphere::buildVerticesSmooth ran before the batched kernels
+    void ULegacySphereRings(float radius, int sectorCount, int stackCount,
+        vector<float>& vertices, vector<float>& normals, vector<float>& texCoords)
+    {
+        const float PI = acos(-1);
+
+        vector<float>().swap(vertices);
+        vector<float>().swap(normals);
+        vector<float>().swap(texCoords);
+
+        float x, y, z, xy;
+        float lengthInv = 1.0f / radius;
+        float sectorStep = 2 * PI / sectorCount;
+        float stackStep = PI / stackCount;
+        float sectorAngle, stackAngle;
+
+        for (int i = 0; i <= stackCount; ++i)
+        {
+            stackAngle = PI / 2 - i * stackStep;
+            xy = radius * cosf(stackAngle);
+            z = radius * sinf(stackAngle);
+
+            for (int j = 0; j <= sectorCount; ++j)
+            {
+                sectorAngle = j * sectorStep;
+                x = xy * cosf(sectorAngle);
+                y = xy * sinf(sectorAngle);
+                vertices.push_back(x);
+                vertices.push_back(y);
+                vertices.push_back(z);
+                normals.push_back(x * lengthInv);
+                normals.push_back(y * lengthInv);
+                normals.push_back(z * lengthInv);
+                texCoords.push_back((float)j / sectorCount);
+                texCoords.push_back((float)i / stackCount);
+            }
+        }
+    }
+
+    // runs body enough times to fill ~0.2 s and returns seconds per run
+    template <class Body>
+    double UTime(Body body)
+    {
+        int runs = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed = 0.0;
+        do
+        {
+            body();
+            ++runs;
+            elapsed = chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < 0.2);
+        return elapsed / runs;
+    }
+
+    void UReport(const char* name, double vertices, double seconds)
+    {
+        cout << "  " << name << ": " << vertices / seconds / 1e6 << " M vertices/s" << endl;
+    }
+
+    // angle between two normals; atan2 stays accurate where acos of a dot product does not
+    float UAngleDegrees(const float a[3], const float b[3])
+    {
+        double cx = (double)a[1] * b[2] - (double)a[2] * b[1];
+        double cy = (double)a[2] * b[0] - (double)a[0] * b[2];
+        double cz = (double)a[0] * b[1] - (double)a[1] * b[0];
+        double dot = (double)a[0] * b[0] + (double)a[1] * b[1] + (double)a[2] * b[2];
+        return (float)(atan2(sqrt(cx * cx + cy * cy + cz * cz), dot) * 57.29577951308232);
+    }
+
+    // worst error of a shape built in Format against the same shape built in floats
+    template <class Format, class Shape, class Reference>
+    void UReportFormatError(const char* name, const Shape& shape, const Reference& reference)
+    {
+        float position = 0.0f, normal = 0.0f, texCoord = 0.0f;
+        for (unsigned int i = 0; i < shape.getVertexCount(); ++i)
+        {
+            float decoded[8];
+            Format::read(shape.getInterleavedVertices()[i], shape.getPositionDecode(), decoded);
+            const float* exact = &reference.getInterleavedVertices()[i].position[0];
+            for (int k = 0; k < 3; ++k)
+                position = max(position, fabsf(decoded[k] - exact[k]));
+            normal = max(normal, UAngleDegrees(decoded + 3, exact + 3));
+            for (int k = 6; k < 8; ++k)
+                texCoord = max(texCoord, fabsf(decoded[k] - exact[k]));
+        }
+        cout << "  " << name << ": " << shape.getInterleavedStride() << " bytes/vertex, max error position "
+            << position << ", normal " << normal << " deg, uv " << texCoord << endl;
+    }
+
+    // vertex shader runs per triangle with a FIFO post-transform cache of
+    // cacheSize vertices; restart indices do not flush it
+    template <class Shape>
+    double UTransformsPerTriangle(const Shape& shape, int cacheSize)
+    {
+        const unsigned int width = shape.getIndexWidth();
+        const unsigned int restart = width == 2 ? 0xffff : 0xffffffff;
+        vector<unsigned int> cache(cacheSize, 0xffffffff);
+        int next = 0, misses = 0;
+        for (unsigned int i = 0; i < shape.getIndexCount(); ++i)
+        {
+            unsigned int index = width == 2 ? ((const uint16_t*)shape.getIndices())[i] : ((const uint32_t*)shape.getIndices())[i];
+            if (index == restart || find(cache.begin(), cache.end(), index) != cache.end())
+                continue;
+            cache[next] = index;
+            next = (next + 1) % cacheSize;
+            ++misses;
+        }
+        return (double)misses / shape.getTriangleCount();
+    }
+
+    template <class Shape>
+    void UReportIndices(const char* name, const Shape& shape)
+    {
+        cout << "  " << name << ": " << shape.getIndexCount() << " " << shape.getIndexWidth() * 8 << "-bit indices, "
+            << shape.getIndexSize() / 1024.0 << " KB (" << shape.getIndexSize() * 100.0 / (shape.getTriangleCount() * 3 * sizeof(uint32_t))
+            << "% of a 32-bit list), " << UTransformsPerTriangle(shape, 32) << " vertex shader runs/triangle" << endl;
+    }
+
+    template <class Shape>
+    void UCompareIndices(const char* name, Shape shape)
+    {
+        cout << name << ", " << shape.getVertexCount() << " vertices, " << shape.getTriangleCount() << " triangles" << endl;
+        UReportIndices("list", shape);
+        shape.setStrips(true);
+        UReportIndices("strip", shape);
+    }
+}
+
+
+int main()
+{
+    const SinCosPath best = UGetSupportedSinCosPath();
+    cout << "sin/cos paths available up to " << USinCosPathName(best) << endl;
+
+    // kernel accuracy and throughput over the angles the builders use
+    const int angleCount = 1 << 16;
+    vector<float> sines(angleCount), cosines(angleCount);
+    const float step = 8.0f * acos(-1.0f) / angleCount;     // -2pi to 6pi
+    for (int path = SINCOS_SCALAR; path <= best; ++path)
+    {
+        USetSinCosPath((SinCosPath)path);
+        double seconds = UTime([&]() { USinCosRamp(-2.0f * acos(-1.0f), step, angleCount, sines.data(), cosines.data()); gSink = sines[angleCount / 3]; });
+
+        double maxError = 0.0;
+        for (int i = 0; i < angleCount; ++i)
+        {
+            double angle = (double)(-2.0f * acos(-1.0f)) + i * (double)step;
+            maxError = fmax(maxError, fabs(sines[i] - sin(angle)));
+            maxError = fmax(maxError, fabs(cosines[i] - cos(angle)));
+        }
+        cout << "USinCosRamp " << USinCosPathName((SinCosPath)path) << ": "
+            << angleCount / seconds / 1e6 << " M angles/s, max error " << maxError << endl;
+    }
+
+    const int sizes[3][2] = { { 36, 18 }, { 512, 256 }, { 4096, 2048 } };
+
+    // the builders must allocate the same number of times at every size
+    bool constant = true;
+    const char* shapeNames[4] = { "Cylinder flat", "Cylinder smooth", "Sphere flat", "Sphere smooth" };
+    for (int shape = 0; shape < 8; ++shape)
+    {
+        BuildCost costs[3];
+        for (int s = 0; s < 3; ++s)
+        {
+            costs[s] = UMeasureBuild((shape & 2) != 0, (shape & 1) != 0, shape >= 4, sizes[s][0], sizes[s][1]);
+            if (costs[s].allocations != costs[0].allocations)
+                constant = false;
+        }
+        cout << shapeNames[shape & 3] << (shape >= 4 ? " strips" : "") << " allocations: " << costs[0].allocations << " " << costs[1].allocations
+            << " " << costs[2].allocations << ", bytes/vertex (indices included) at " << sizes[2][0] << "x" << sizes[2][1]
+            << ": peak " << costs[2].peakBytesPerVertex << " resident " << costs[2].residentBytesPerVertex << endl;
+    }
+    if (!constant)
+    {
+        cout << "FAILED: allocation count depends on the mesh size" << endl;
+        return 1;
+    }
+    for (int s = 0; s < 3; ++s)
+    {
+        int sectors = sizes[s][0], stacks = sizes[s][1];
+        double vertexCount = (double)(sectors + 1) * (stacks + 1);
+        cout << sectors << "x" << stacks << " (" << vertexCount << " vertices)" << endl;
+
+        vector<float> vertices, normals, texCoords;
+        UReport("legacy", vertexCount, UTime([&]() {
+            ULegacySphereRings(1.0f, sectors, stacks, vertices, normals, texCoords);
+            gSink = vertices[vertices.size() / 2];
+        }));
+
+        vector<VertexP3N3T2::Vertex> interleaved((size_t)vertexCount);
+        const VertexDecode identity = VertexP3N3T2::positionDecode(nullptr, nullptr);
+        for (int path = SINCOS_SCALAR; path <= best; ++path)
+        {
+            USetSinCosPath((SinCosPath)path);
+            string name = string("rings ") + USinCosPathName((SinCosPath)path);
+            UReport(name.c_str(), vertexCount, UTime([&]() {
+                USphereRings<VertexP3N3T2>(1.0f, sectors, stacks, interleaved.data(), identity);
+                gSink = interleaved[interleaved.size() / 2].position[0];
+            }));
+        }
+
+        USetSinCosPath(best);
+        UReport("Sphere", vertexCount, UTime([&]() {
+            Sphere sphere(1.0f, sectors, stacks, true);
+            gSink = sphere.getInterleavedVertices()[0].position[0];
+        }));
+        UReport("Cylinder", (double)(sectors + 1) * (stacks + 1), UTime([&]() {
+            Cylinder cylinder(1.0f, 0.5f, 2.0f, sectors, stacks, true);
+            gSink = cylinder.getInterleavedVertices()[0].position[0];
+        }));
+    }
+
+    // quantized formats at the scene's sphere and cup sizes
+    Sphere sphere(0.9f, 36, 18, true);
+    Cylinder cylinder(1.0f, 1.5f, 2.0f, 25, 8, true);
+    cout << "Sphere 36x18, radius 0.9" << endl;
+    UReportFormatError<VertexP3N3T2>("float", sphere, sphere);
+    UReportFormatError<VertexUnorm16Oct>("unorm16", BasicSphere<VertexUnorm16Oct>(0.9f, 36, 18, true), sphere);
+    UReportFormatError<VertexHalfOct>("half", BasicSphere<VertexHalfOct>(0.9f, 36, 18, true), sphere);
+    cout << "Cylinder 25x8, radius 1 to 1.5, height 2" << endl;
+    UReportFormatError<VertexP3N3T2>("float", cylinder, cylinder);
+    UReportFormatError<VertexUnorm16Oct>("unorm16", BasicCylinder<VertexUnorm16Oct>(1.0f, 1.5f, 2.0f, 25, 8, true), cylinder);
+    UReportFormatError<VertexHalfOct>("half", BasicCylinder<VertexHalfOct>(1.0f, 1.5f, 2.0f, 25, 8, true), cylinder);
+
+    // index arrays: the scene sizes, a large 16-bit mesh and one past 65535 vertices
+    UCompareIndices("Sphere 36x18", Sphere(0.9f, 36, 18, true));
+    UCompareIndices("Cylinder 25x8", Cylinder(1.0f, 1.5f, 2.0f, 25, 8, true));
+    UCompareIndices("Sphere 36x18 flat", Sphere(0.9f, 36, 18, false));
+    UCompareIndices("Sphere 250x250", Sphere(1.0f, 250, 250, true));
+    UCompareIndices("Sphere 512x256", Sphere(1.0f, 512, 256, true));
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Author: Joshua Gauthier
+// Index array of a generated mesh: 16-bit whenever the vertex count allows
+
+#ifndef MESH_INDICES_H
+#define MESH_INDICES_H
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// How the indices of a mesh form triangles
+enum IndexTopology
+{
+    INDEX_TRIANGLES,        // 3 indices per triangle
+    INDEX_TRIANGLE_STRIP,   // strips separated by the restart index (all bits set)
+};
+
+// Holds 16-bit indices when every vertex index and the restart index fit in
+// 16 bits (at most 65535 vertices), 32-bit ones otherwise. The width is picked
+// by reset() from the vertex count, so the builders push plain unsigned ints.
+// The restart index is the all-ones value of the width, which is what
+// GL_PRIMITIVE_RESTART_FIXED_INDEX uses
+class MeshIndices
+{
+public:
+    static const unsigned int MAX_16BIT_VERTICES = 0xffff;
+
+    explicit MeshIndices(std::pmr::memory_resource* resource)
+        : indices16(resource), indices32(resource), wide(false) {}
+
+    // empty the array, pick the width for vertexCount vertices and reserve count indices
+    void reset(unsigned int vertexCount, unsigned int count)
+    {
+        indices16.clear();
+        indices32.clear();
+        wide = vertexCount > MAX_16BIT_VERTICES;
+        if (wide)
+            indices32.reserve(count);
+        else
+            indices16.reserve(count);
+    }
+
+    // free the memory
+    void release()
+    {
+        std::pmr::vector<uint16_t>(indices16.get_allocator().resource()).swap(indices16);
+        std::pmr::vector<uint32_t>(indices32.get_allocator().resource()).swap(indices32);
+    }
+
+    void push(unsigned int index)
+    {
+        if (wide)
+            indices32.push_back(index);
+        else
+            indices16.push_back((uint16_t)index);
+    }
+
+    // start a new strip: a restart index unless this is the first one
+    void beginStrip()
+    {
+        if (size() > 0)
+            push(wide ? 0xffffffffu : 0xffffu);
+    }
+
+    unsigned int size() const { return (unsigned int)(wide ? indices32.size() : indices16.size()); }
+    unsigned int width() const { return wide ? 4 : 2; }        // bytes per index
+    unsigned int restartIndex() const { return wide ? 0xffffffffu : 0xffffu; }
+    const void* data() const { return wide ? (const void*)indices32.data() : (const void*)indices16.data(); }
+    unsigned int operator[](unsigned int i) const { return wide ? indices32[i] : indices16[i]; }
+    std::pmr::memory_resource* resource() const { return indices16.get_allocator().resource(); }
+
+private:
+    std::pmr::vector<uint16_t> indices16;
+    std::pmr::vector<uint32_t> indices32;
+    bool wide;
+};
+
+#endif
@@ -0,0 +1,268 @@
+// Author: Joshua Gauthier
+// Batched trigonometry and ring builders shared by Sphere and Cylinder
+
+#include <cmath>
+
+#include "MeshKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MESH_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles AVX2 intrinsics without any per-function attribute
+#define MESH_KERNELS_AVX2_TARGET
+#else
+#define MESH_KERNELS_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+namespace
+{
+    // Cephes sinf/cosf constants
+    const float FOUR_OVER_PI = 1.27323954473516f;
+    const float MINUS_DP1 = -0.78515625f;           // pi/4 split in three for exact reduction
+    const float MINUS_DP2 = -2.4187564849853515625e-4f;
+    const float MINUS_DP3 = -3.77489497744594108e-8f;
+    const float SIN_P0 = -1.9515295891e-4f;
+    const float SIN_P1 = 8.3321608736e-3f;
+    const float SIN_P2 = -1.6666654611e-1f;
+    const float COS_P0 = 2.443315711809948e-5f;
+    const float COS_P1 = -1.388731625493765e-3f;
+    const float COS_P2 = 4.166664568298827e-2f;
+
+    /* ------------------- Scalar -------------------*/
+    void USinCosRampScalar(float start, float step, int count, float* sines, float* cosines)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            float angle = start + i * step;
+            sines[i] = sinf(angle);
+            cosines[i] = cosf(angle);
+        }
+    }
+
+#ifdef MESH_KERNELS_X86
+    /* ------------------- SSE2: 4 angles -------------------*/
+    inline void USinCos4(__m128 x, __m128& s, __m128& c)
+    {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+
+        // work on |x|; sin is odd so its sign follows x
+        __m128 signSin = _mm_and_ps(x, signMask);
+        x = _mm_andnot_ps(signMask, x);
+
+        // octant j (rounded up to even) and the reduced angle x - j*pi/4
+        __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOUR_OVER_PI)));
+        j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+        __m128 y = _mm_cvtepi32_ps(j);
+
+        __m128 swapSignSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+        __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(
+            _mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+        __m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+        signSin = _mm_xor_ps(signSin, swapSignSin);
+
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(MINUS_DP1)));
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(MINUS_DP2)));
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(MINUS_DP3)));
+        __m128 z = _mm_mul_ps(x, x);
+
+        // cos polynomial on [-pi/4, pi/4]
+        __m128 pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+        pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(COS_P2));
+        pc = _mm_mul_ps(_mm_mul_ps(pc, z), z);
+        pc = _mm_sub_ps(pc, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+        pc = _mm_add_ps(pc, _mm_set1_ps(1.0f));
+
+        // sin polynomial on [-pi/4, pi/4]
+        __m128 ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+        ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(SIN_P2));
+        ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), x), x);
+
+        // octants 1,2 (mod 4) swap the two polynomials
+        __m128 sinValue = _mm_or_ps(_mm_and_ps(polyMask, ps), _mm_andnot_ps(polyMask, pc));
+        __m128 cosValue = _mm_or_ps(_mm_and_ps(polyMask, pc), _mm_andnot_ps(polyMask, ps));
+        s = _mm_xor_ps(sinValue, signSin);
+        c = _mm_xor_ps(cosValue, signCos);
+    }
+
+    void USinCosRampSSE2(float start, float step, int count, float* sines, float* cosines)
+    {
+        // start + i * step, computed the same way as the scalar path
+        const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 index = _mm_add_ps(_mm_set1_ps((float)i), lane);
+            __m128 angle = _mm_add_ps(_mm_set1_ps(start), _mm_mul_ps(index, _mm_set1_ps(step)));
+            __m128 s, c;
+            USinCos4(angle, s, c);
+            _mm_storeu_ps(sines + i, s);
+            _mm_storeu_ps(cosines + i, c);
+        }
+        for (; i < count; ++i)
+        {
+            float angle = start + i * step;
+            sines[i] = sinf(angle);
+            cosines[i] = cosf(angle);
+        }
+    }
+
+    /* ------------------- AVX2 + FMA: 8 angles -------------------*/
+    MESH_KERNELS_AVX2_TARGET
+    inline void USinCos8(__m256 x, __m256& s, __m256& c)
+    {
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+        __m256 signSin = _mm256_and_ps(x, signMask);
+        x = _mm256_andnot_ps(signMask, x);
+
+        __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FOUR_OVER_PI)));
+        j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+        __m256 y = _mm256_cvtepi32_ps(j);
+
+        __m256 swapSignSin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+        __m256 signCos = _mm256_castsi256_ps(_mm256_slli_epi32(
+            _mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+        __m256 polyMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+        signSin = _mm256_xor_ps(signSin, swapSignSin);
+
+        x = _mm256_fmadd_ps(y, _mm256_set1_ps(MINUS_DP1), x);
+        x = _mm256_fmadd_ps(y, _mm256_set1_ps(MINUS_DP2), x);
+        x = _mm256_fmadd_ps(y, _mm256_set1_ps(MINUS_DP3), x);
+        __m256 z = _mm256_mul_ps(x, x);
+
+        __m256 pc = _mm256_fmadd_ps(_mm256_set1_ps(COS_P0), z, _mm256_set1_ps(COS_P1));
+        pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(COS_P2));
+        pc = _mm256_mul_ps(_mm256_mul_ps(pc, z), z);
+        pc = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), pc);
+        pc = _mm256_add_ps(pc, _mm256_set1_ps(1.0f));
+
+        __m256 ps = _mm256_fmadd_ps(_mm256_set1_ps(SIN_P0), z, _mm256_set1_ps(SIN_P1));
+        ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(SIN_P2));
+        ps = _mm256_fmadd_ps(_mm256_mul_ps(ps, z), x, x);
+
+        __m256 sinValue = _mm256_blendv_ps(pc, ps, polyMask);
+        __m256 cosValue = _mm256_blendv_ps(ps, pc, polyMask);
+        s = _mm256_xor_ps(sinValue, signSin);
+        c = _mm256_xor_ps(cosValue, signCos);
+    }
+
+    MESH_KERNELS_AVX2_TARGET
+    void USinCosRampAVX2(float start, float step, int count, float* sines, float* cosines)
+    {
+        const __m256 lane = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 index = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+            // fused, so an angle can land 1 ulp away from the other paths' start + i * step
+            __m256 angle = _mm256_fmadd_ps(index, _mm256_set1_ps(step), _mm256_set1_ps(start));
+            __m256 s, c;
+            USinCos8(angle, s, c);
+            _mm256_storeu_ps(sines + i, s);
+            _mm256_storeu_ps(cosines + i, c);
+        }
+        for (; i < count; ++i)
+        {
+            float angle = start + i * step;
+            sines[i] = sinf(angle);
+            cosines[i] = cosf(angle);
+        }
+    }
+
+    /* ------------------- CPU detection -------------------*/
+    bool UCpuHasAVX2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool fma = (info[2] & (1 << 12)) != 0;
+        if (!osxsave || !fma)
+            return false;
+        // the OS must save the YMM registers
+        if ((_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }
+#endif
+
+    SinCosPath UDetectSinCosPath()
+    {
+#ifdef MESH_KERNELS_X86
+        if (UCpuHasAVX2())
+            return SINCOS_AVX2;
+        return SINCOS_SSE2;     // baseline on every x86-64 CPU
+#else
+        return SINCOS_SCALAR;
+#endif
+    }
+
+    const SinCosPath gSupportedPath = UDetectSinCosPath();
+    SinCosPath gSinCosPath = gSupportedPath;
+}
+
+
+/* ------------------- Dispatch -------------------*/
+SinCosPath UGetSupportedSinCosPath()
+{
+    return gSupportedPath;
+}
+
+SinCosPath UGetSinCosPath()
+{
+    return gSinCosPath;
+}
+
+void USetSinCosPath(SinCosPath path)
+{
+    gSinCosPath = path > gSupportedPath ? gSupportedPath : path;
+}
+
+bool UCpuSupportsAVX2()
+{
+    // asks the CPU rather than reading gSupportedPath, so other files' globals
+    // can call it before this file's are initialized
+#ifdef MESH_KERNELS_X86
+    return UCpuHasAVX2();
+#else
+    return false;
+#endif
+}
+
+const char* USinCosPathName(SinCosPath path)
+{
+    switch (path)
+    {
+    case SINCOS_SSE2: return "sse2";
+    case SINCOS_AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+void USinCosRamp(float start, float step, int count, float* sines, float* cosines)
+{
+    switch (gSinCosPath)
+    {
+#ifdef MESH_KERNELS_X86
+    case SINCOS_AVX2:
+        USinCosRampAVX2(start, step, count, sines, cosines);
+        break;
+    case SINCOS_SSE2:
+        USinCosRampSSE2(start, step, count, sines, cosines);
+        break;
+#endif
+    default:
+        USinCosRampScalar(start, step, count, sines, cosines);
+        break;
+    }
+}
@@ -0,0 +1,79 @@
+// Author: Joshua Gauthier
+// Batched trigonometry and ring builders shared by Sphere and Cylinder
+
+#ifndef MESH_KERNELS_H
+#define MESH_KERNELS_H
+
+#include <cmath>
+#include <memory_resource>
+#include <vector>
+#include "VertexFormat.h"
+
+// Instruction set used by USinCosRamp, picked once from the CPU at startup
+enum SinCosPath
+{
+    SINCOS_SCALAR,      // std::sin / std::cos per angle
+    SINCOS_SSE2,        // 4 angles per iteration
+    SINCOS_AVX2,        // 8 angles per iteration (AVX2 + FMA)
+    SINCOS_PATH_COUNT
+};
+
+// best path the CPU supports
+SinCosPath UGetSupportedSinCosPath();
+// path in use; USetSinCosPath clamps to what the CPU supports (benchmarks, debugging)
+SinCosPath UGetSinCosPath();
+void USetSinCosPath(SinCosPath path);
+const char* USinCosPathName(SinCosPath path);
+// true when the CPU and OS support AVX2 and FMA (the culling kernels pick their path from it too)
+bool UCpuSupportsAVX2();
+
+// sines[i] = sin(start + i * step), cosines[i] = cos(start + i * step) for i < count.
+// SIMD paths use a Cephes-style polynomial, within a few ulp of std::sin/std::cos
+// for the small angles the mesh builders use
+void USinCosRamp(float start, float step, int count, float* sines, float* cosines);
+
+// Fills the (stackCount + 1) x (sectorCount + 1) smooth-sphere grid a whole
+// ring at a time from precomputed sector/stack sin-cos tables, writing each
+// vertex once in Format's interleaved layout (see VertexFormat.h), positions
+// relative to decode. vertices must hold (stackCount + 1) * (sectorCount + 1)
+// entries. The tables come from resource
+template <class Format>
+void USphereRings(float radius, int sectorCount, int stackCount,
+    typename Format::Vertex* vertices, const VertexDecode& decode,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+{
+    const float PI = acos(-1);
+    float sectorStep = 2 * PI / sectorCount;
+    float stackStep = PI / stackCount;
+    float lengthInv = 1.0f / radius;
+
+    // every ring shares the sector angles; every stack needs one angle
+    std::pmr::vector<float> table(3 * (sectorCount + 1) + 2 * (stackCount + 1), resource);
+    float* sectorSin = table.data();
+    float* sectorCos = sectorSin + (sectorCount + 1);
+    float* stackSin = sectorCos + (sectorCount + 1);
+    float* stackCos = stackSin + (stackCount + 1);
+    float* sectorS = stackCos + (stackCount + 1);
+    USinCosRamp(0.0f, sectorStep, sectorCount + 1, sectorSin, sectorCos);   // 0 to 2pi
+    USinCosRamp(PI / 2, -stackStep, stackCount + 1, stackSin, stackCos);   // pi/2 to -pi/2
+    for (int j = 0; j <= sectorCount; ++j)
+        sectorS[j] = (float)j / sectorCount;
+
+    for (int i = 0; i <= stackCount; ++i)
+    {
+        float xy = radius * stackCos[i];            // r * cos(u)
+        float z = radius * stackSin[i];             // r * sin(u)
+        float nz = z * lengthInv;
+        float t = (float)i / stackCount;
+
+        // one ring: (sectorCount+1) vertices, the seam duplicated for its tex coord
+        for (int j = 0; j <= sectorCount; ++j)
+        {
+            float x = xy * sectorCos[j];            // r * cos(u) * cos(v)
+            float y = xy * sectorSin[j];            // r * cos(u) * sin(v)
+            Format::write(*vertices++, decode, x, y, z, x * lengthInv, y * lengthInv, nz, sectorS[j], t);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,129 @@
+// Author: Joshua Gauthier
+// Screen-space level of detail: a chain of tessellations per generated primitive
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "MeshLod.h"
+
+namespace
+{
+    // how far a level's silhouette may stray from the true circle, in pixels
+    const float LOD_PIXEL_ERROR = 1.0f;
+    // a coarser level must be good enough with this much margin before the chain steps to it
+    const float LOD_HYSTERESIS = 0.2f;
+    // length of the dithered blend between two levels
+    const float LOD_FADE_SECONDS = 0.25f;
+}
+
+
+/* ------------------- Append the next coarser level -------------------*/
+void LodChain::addLevel(int mesh, int sectorCount)
+{
+    LodLevel level;
+    level.mesh = mesh;
+    level.sectorCount = sectorCount;
+    levels.push_back(level);
+}
+
+
+/* ------------------- Coarsest level whose silhouette holds up -------------------*/
+int LodChain::select(float pixelRadius, int current) const
+{
+    // segments the silhouette needs: r * (1 - cos(pi / n)) <= error
+    float needed = 3.0f;
+    if (pixelRadius > LOD_PIXEL_ERROR)
+        needed = acosf(-1.0f) / acosf(1.0f - LOD_PIXEL_ERROR / pixelRadius);
+
+    int level = 0;
+    while (level + 1 < (int)levels.size() && levels[level + 1].sectorCount >= needed)
+        ++level;
+
+    // only give up detail with a margin, so an object sitting on a threshold keeps its level
+    while (current >= 0 && level > current && levels[level].sectorCount < needed * (1.0f + LOD_HYSTERESIS))
+        --level;
+    return level;
+}
+
+
+/* ------------------- Pick this frame's level and advance the blend -------------------*/
+bool LodChain::update(float pixelRadius, float deltaTime, LodState& state) const
+{
+    // first frame: show the right level straight away
+    if (state.level < 0)
+    {
+        state.level = select(pixelRadius, -1);
+        state.fromLevel = -1;
+        state.fade = 1.0f;
+        return true;
+    }
+
+    // finish the running blend before starting another one
+    if (state.fromLevel >= 0)
+    {
+        state.fade += deltaTime / LOD_FADE_SECONDS;
+        if (state.fade >= 1.0f)
+        {
+            state.fade = 1.0f;
+            state.fromLevel = -1;
+        }
+        return true;
+    }
+
+    int level = select(pixelRadius, state.level);
+    if (level == state.level)
+        return false;
+
+    state.fromLevel = state.level;
+    state.level = level;
+    state.fade = 0.0f;
+    return true;
+}
+
+
+/* ------------------- Projected size of a mesh's bounding sphere -------------------*/
+float UProjectedRadius(const float boundsMin[3], const float boundsMax[3], const glm::mat4& model,
+    const glm::mat4& view, const glm::mat4& projection, float viewportHeight)
+{
+    glm::vec3 low(boundsMin[0], boundsMin[1], boundsMin[2]);
+    glm::vec3 high(boundsMax[0], boundsMax[1], boundsMax[2]);
+    glm::vec3 center = (low + high) * 0.5f;
+
+    // half the diagonal of the box once rotated and scaled by the model matrix
+    glm::vec3 scale(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])));
+    float radius = glm::length((high - low) * scale) * 0.5f;
+
+    // projection[1][1] maps a unit at distance 1 to half the viewport height
+    float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+    if (projection[2][3] == 0.0f)   // orthographic: no perspective divide
+        return radius * pixelsPerUnit;
+
+    // distance rather than view depth, so turning the camera does not change the level
+    float distance = glm::length(glm::vec3(view * model * glm::vec4(center, 1.0f)));
+    if (distance <= radius)
+        return FLT_MAX;
+    return radius * pixelsPerUnit / distance;
+}
+
+
+/* ------------------- Register the levels of one primitive -------------------*/
+LodChain UAddLodChain(GeometryCache& cache, const PrimitiveKey& key, int minSectors, int minStacks, int levelCount)
+{
+    LodChain chain;
+    int lastSectors = 0, lastStacks = 0;
+    for (int i = 0; i < levelCount; ++i)
+    {
+        int divisor = 1 << i;   // rounds up, so every level stays a halving
+        PrimitiveKey level = key;
+        level.sectorCount = std::max((key.sectorCount * 2 + divisor - 1) / divisor, minSectors);
+        level.stackCount = std::max((key.stackCount * 2 + divisor - 1) / divisor, minStacks);
+        if (level.sectorCount == lastSectors && level.stackCount == lastStacks)
+            break;      // clamped: nothing coarser left
+        lastSectors = level.sectorCount;
+        lastStacks = level.stackCount;
+
+        chain.addLevel(cache.get(level), level.sectorCount);
+    }
+    return chain;
+}
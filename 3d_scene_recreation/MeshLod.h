@@ -0,0 +1,62 @@
+// Author: Joshua Gauthier
+// Screen-space level of detail: a chain of tessellations per generated primitive
+
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "GeometryCache.h"
+
+// One tessellation of a primitive inside the geometry arena
+struct LodLevel
+{
+    int mesh;           // handle in the arena
+    int sectorCount;    // segments around the silhouette
+};
+
+// Where an object is in its chain: the level it shows and, while a switch
+// blends in, the level it is leaving
+struct LodState
+{
+    int level;          // -1 until the first update
+    int fromLevel;      // -1 when not blending
+    float fade;         // 0 to 1, progress of the blend towards level
+};
+
+// Levels of one primitive from finest to coarsest. A level is good enough when
+// its polygonal silhouette stays within a pixel of the true circle: a circle of
+// radius r pixels drawn with n segments is off by r * (1 - cos(pi / n)).
+// Switching levels blends over a quarter of a second (see lodFade in the
+// fragment shaders) instead of popping.
+class LodChain
+{
+public:
+    void addLevel(int mesh, int sectorCount);
+    int getLevelCount() const { return (int)levels.size(); }
+    const LodLevel& getLevel(int level) const { return levels[level]; }
+
+    // the coarsest good enough level for a bounding sphere of pixelRadius;
+    // stepping coarser than current needs a margin, so the choice does not flicker
+    int select(float pixelRadius, int current) const;
+
+    // pick this frame's level and advance the blend. Returns true when the
+    // object's draws changed (level, blend or fade)
+    bool update(float pixelRadius, float deltaTime, LodState& state) const;
+
+private:
+    std::vector<LodLevel> levels;
+};
+
+// radius in pixels of the bounding sphere of bounds once model, view and
+// projection are applied; FLT_MAX when the camera is inside it
+float UProjectedRadius(const float boundsMin[3], const float boundsMax[3], const glm::mat4& model,
+    const glm::mat4& view, const glm::mat4& projection, float viewportHeight);
+
+// register the unit mesh of key at 2x, 1x, 1/2, 1/4 ... of its sector and stack
+// counts, clamped to minSectors and minStacks, as a chain of at most levelCount
+// levels. Level 1 is key itself. Levels come from cache, so every shape with
+// the same tessellation shares them
+LodChain UAddLodChain(GeometryCache& cache, const PrimitiveKey& key, int minSectors, int minStacks, int levelCount);
+
+#endif
@@ -0,0 +1,120 @@
+// Author: Joshua Gauthier
+// Render queue sort keys and their radix sort
+
+#include <cstring>
+
+#include "RenderQueue.h"
+
+namespace
+{
+    const int DEPTH_BITS = 32;
+    const int MATERIAL_SHIFT = DEPTH_BITS;
+    const int TEXTURE_SET_SHIFT = MATERIAL_SHIFT + RENDER_KEY_MATERIAL_BITS;
+    const int VERTEX_ARRAY_SHIFT = TEXTURE_SET_SHIFT + RENDER_KEY_TEXTURE_SET_BITS;
+    const int PROGRAM_SHIFT = VERTEX_ARRAY_SHIFT + RENDER_KEY_VERTEX_ARRAY_BITS;
+
+    uint64_t UField(uint64_t value, int bits, int shift)
+    {
+        return (value & ((1ull << bits) - 1)) << shift;
+    }
+
+    int UGetField(uint64_t key, int bits, int shift)
+    {
+        return (int)((key >> shift) & ((1ull << bits) - 1));
+    }
+}
+
+
+uint64_t URenderKey(int program, int vertexArray, int textureSet, int material, float depth)
+{
+    // non-negative floats order the same as their bit patterns read as integers
+    if (!(depth > 0.0f))
+        depth = 0.0f;
+    uint32_t depthBits;
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    return UField(program, RENDER_KEY_PROGRAM_BITS, PROGRAM_SHIFT)
+        | UField(vertexArray, RENDER_KEY_VERTEX_ARRAY_BITS, VERTEX_ARRAY_SHIFT)
+        | UField(textureSet, RENDER_KEY_TEXTURE_SET_BITS, TEXTURE_SET_SHIFT)
+        | UField(material, RENDER_KEY_MATERIAL_BITS, MATERIAL_SHIFT)
+        | depthBits;
+}
+
+
+int URenderKeyProgram(uint64_t key) { return UGetField(key, RENDER_KEY_PROGRAM_BITS, PROGRAM_SHIFT); }
+int URenderKeyVertexArray(uint64_t key) { return UGetField(key, RENDER_KEY_VERTEX_ARRAY_BITS, VERTEX_ARRAY_SHIFT); }
+int URenderKeyTextureSet(uint64_t key) { return UGetField(key, RENDER_KEY_TEXTURE_SET_BITS, TEXTURE_SET_SHIFT); }
+int URenderKeyMaterial(uint64_t key) { return UGetField(key, RENDER_KEY_MATERIAL_BITS, MATERIAL_SHIFT); }
+
+
+unsigned int URenderKeyChanges(uint64_t previous, uint64_t key)
+{
+    unsigned int changes = 0;
+    if (URenderKeyProgram(previous) != URenderKeyProgram(key))
+        changes |= RENDER_STATE_PROGRAM;
+    if (URenderKeyVertexArray(previous) != URenderKeyVertexArray(key))
+        changes |= RENDER_STATE_VERTEX_ARRAY;
+    if (URenderKeyTextureSet(previous) != URenderKeyTextureSet(key))
+        changes |= RENDER_STATE_TEXTURE_SET;
+    if (URenderKeyMaterial(previous) != URenderKeyMaterial(key))
+        changes |= RENDER_STATE_MATERIAL;
+    return changes;
+}
+
+
+void RenderQueue::clear()
+{
+    keys.clear();
+    items.clear();
+}
+
+
+void RenderQueue::push(uint64_t key, int item)
+{
+    keys.push_back(key);
+    items.push_back(item);
+}
+
+
+void RenderQueue::sort()
+{
+    size_t count = keys.size();
+    if (count < 2)
+        return;
+    scratchKeys.resize(count);
+    scratchItems.resize(count);
+
+    // all eight byte histograms in one read of the keys
+    size_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (size_t i = 0; i < count; ++i)
+        for (int pass = 0; pass < 8; ++pass)
+            ++histograms[pass][(keys[i] >> (pass * 8)) & 0xff];
+
+    for (int pass = 0; pass < 8; ++pass)
+    {
+        size_t* histogram = histograms[pass];
+        int shift = pass * 8;
+        // every key has this byte: the pass would not move anything
+        if (histogram[(keys[0] >> shift) & 0xff] == count)
+            continue;
+
+        // bucket starts
+        size_t offset = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            size_t bucketCount = histogram[b];
+            histogram[b] = offset;
+            offset += bucketCount;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t target = histogram[(keys[i] >> shift) & 0xff]++;
+            scratchKeys[target] = keys[i];
+            scratchItems[target] = items[i];
+        }
+        keys.swap(scratchKeys);
+        items.swap(scratchItems);
+    }
+}
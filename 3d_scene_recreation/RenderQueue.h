@@ -0,0 +1,66 @@
+// Author: Joshua Gauthier
+// Draws ordered by packed 64-bit state keys, so consecutive draws share as much state as possible
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+// Layout of a sort key, most significant field first. Sorting the keys groups
+// draws by program, then vertex array, then texture set, then material, and
+// orders each group front to back for early depth rejection:
+//   63..60 program   59..56 vertex array   55..44 texture set   43..32 material   31..0 depth
+const int RENDER_KEY_PROGRAM_BITS = 4;
+const int RENDER_KEY_VERTEX_ARRAY_BITS = 4;
+const int RENDER_KEY_TEXTURE_SET_BITS = 12;
+const int RENDER_KEY_MATERIAL_BITS = 12;
+
+// State a key names, as bits of URenderKeyChanges()
+enum RenderState
+{
+    RENDER_STATE_PROGRAM = 1,
+    RENDER_STATE_VERTEX_ARRAY = 2,
+    RENDER_STATE_TEXTURE_SET = 4,
+    RENDER_STATE_MATERIAL = 8,
+    RENDER_STATE_ALL = 15,
+    RENDER_STATE_COUNT = 4
+};
+
+// Indices of the program, vertex array, texture set and material a draw needs,
+// each below 1 << its field's bit count, and its view depth. Depth only orders
+// the draws: any depth >= 0 keeps its exact float order
+uint64_t URenderKey(int program, int vertexArray, int textureSet, int material, float depth);
+int URenderKeyProgram(uint64_t key);
+int URenderKeyVertexArray(uint64_t key);
+int URenderKeyTextureSet(uint64_t key);
+int URenderKeyMaterial(uint64_t key);
+// RenderState bits of the state fields that differ between two keys
+unsigned int URenderKeyChanges(uint64_t previous, uint64_t key);
+
+// Keys and the items (scene objects) they stand for, rebuilt every frame.
+//
+// usage: clear(), push() every visible item, sort(), then walk getKey(i) and
+// getItem(i) in order, applying only the state URenderKeyChanges() reports
+class RenderQueue
+{
+public:
+    void clear();
+    void push(uint64_t key, int item);
+    int size() const { return (int)keys.size(); }
+
+    // least significant byte first radix sort, stable; passes in which every
+    // key has the same byte are skipped, so the unused high bits cost nothing
+    void sort();
+
+    uint64_t getKey(int index) const { return keys[index]; }
+    int getItem(int index) const { return items[index]; }
+
+private:
+    std::vector<uint64_t> keys;
+    std::vector<int> items;
+    std::vector<uint64_t> scratchKeys;
+    std::vector<int> scratchItems;
+};
+
+#endif
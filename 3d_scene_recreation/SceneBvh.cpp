@@ -0,0 +1,596 @@
+// Author: Joshua Gauthier
+// Bounding volume hierarchy over the scene objects, for ray picking and frustum queries
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <numeric>
+
+#include "FrustumCulling.h"
+#include "SceneBvh.h"
+
+namespace
+{
+    const int BVH_BINS = 16;                // candidate split planes per axis are the bin edges
+    const int BVH_LEAF_OBJECTS = 2;         // never split nodes this small
+    const int BVH_MAX_LEAF_OBJECTS = 8;     // always split nodes larger than this
+    const float BVH_TRAVERSAL_COST = 1.0f;  // visiting a node, relative to testing one object
+    const int BVH_MAX_DEPTH = 60;           // queries keep at most one pending node per level
+    const int BVH_STACK_SIZE = 64;
+
+    // centroid bins of one axis while looking for a split
+    struct Bin
+    {
+        float boundsMin[3];
+        float boundsMax[3];
+        int count;
+    };
+
+    void UEmptyBox(float boundsMin[3], float boundsMax[3])
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            boundsMin[axis] = FLT_MAX;
+            boundsMax[axis] = -FLT_MAX;
+        }
+    }
+
+    void UGrowBox(float boundsMin[3], float boundsMax[3], const float otherMin[3], const float otherMax[3])
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            boundsMin[axis] = std::min(boundsMin[axis], otherMin[axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], otherMax[axis]);
+        }
+    }
+
+    // half the surface area, all the heuristic needs
+    float UHalfArea(const float boundsMin[3], const float boundsMax[3])
+    {
+        float x = boundsMax[0] - boundsMin[0], y = boundsMax[1] - boundsMin[1], z = boundsMax[2] - boundsMin[2];
+        if (x < 0.0f)
+            return 0.0f;    // empty
+        return x * y + y * z + z * x;
+    }
+
+    // entry distance of the ray into a box, when it enters before limit.
+    // An axis the ray runs parallel to gives 0 * inf = NaN, which min and max
+    // ignore because the running value is their first argument
+    bool URayBox(const glm::vec3& origin, const glm::vec3& inverseDirection,
+        const float boundsMin[3], const float boundsMax[3], float limit, float& entry)
+    {
+        float tNear = 0.0f, tFar = limit;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float a = (boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+            float b = (boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+            if (a > b)
+                std::swap(a, b);
+            tNear = std::max(tNear, a);
+            tFar = std::min(tFar, b);
+        }
+        entry = tNear;
+        return tNear <= tFar;
+    }
+
+    /* ------------------- Exact shapes, in model space -------------------*/
+    // each returns the nearest t in [0, limit) where origin + t * direction
+    // meets the surface; direction is not normalized, so t carries over from
+    // world space unchanged
+    bool URaySphere(const glm::vec3& origin, const glm::vec3& direction, float limit, float& t)
+    {
+        float a = glm::dot(direction, direction);
+        float b = glm::dot(origin, direction);
+        float c = glm::dot(origin, origin) - 1.0f;
+        float discriminant = b * b - a * c;
+        if (a <= 0.0f || discriminant < 0.0f)
+            return false;
+
+        float root = sqrtf(discriminant);
+        float hit = (-b - root) / a;
+        if (hit < 0.0f)
+            hit = (-b + root) / a;  // starts inside
+        if (hit < 0.0f || hit >= limit)
+            return false;
+        t = hit;
+        return true;
+    }
+
+    bool URayCylinder(const glm::vec3& origin, const glm::vec3& direction, const glm::vec2& radiusScale, float limit, float& t)
+    {
+        // the side is the cone x^2 + y^2 = r(z)^2 with r(z) = middle + slope * z,
+        // which r(-0.5) = base and r(0.5) = top make a cylinder when they match
+        float middle = (radiusScale.x + radiusScale.y) * 0.5f;
+        float slope = radiusScale.y - radiusScale.x;
+        float best = limit;
+
+        auto side = [&](float hit)
+        {
+            float z = origin.z + hit * direction.z;
+            if (hit >= 0.0f && hit < best && fabsf(z) <= 0.5f && middle + slope * z >= 0.0f)
+                best = hit;
+        };
+
+        float k = middle + slope * origin.z;
+        float a = direction.x * direction.x + direction.y * direction.y - slope * slope * direction.z * direction.z;
+        float b = origin.x * direction.x + origin.y * direction.y - slope * direction.z * k;     // half of the linear term
+        float c = origin.x * origin.x + origin.y * origin.y - k * k;
+        if (fabsf(a) > 1e-7f * glm::dot(direction, direction))
+        {
+            float discriminant = b * b - a * c;
+            if (discriminant >= 0.0f)
+            {
+                float root = sqrtf(discriminant);
+                side((-b - root) / a);
+                side((-b + root) / a);
+            }
+        }
+        else if (b != 0.0f)
+            side(-c / (2.0f * b));  // parallel to the cone's slope: one crossing
+
+        // base and top caps
+        if (direction.z != 0.0f)
+        {
+            for (int end = 0; end < 2; ++end)
+            {
+                float z = end == 0 ? -0.5f : 0.5f;
+                float radius = end == 0 ? radiusScale.x : radiusScale.y;
+                float hit = (z - origin.z) / direction.z;
+                float x = origin.x + hit * direction.x, y = origin.y + hit * direction.y;
+                if (hit >= 0.0f && hit < best && x * x + y * y <= radius * radius)
+                    best = hit;
+            }
+        }
+
+        if (best >= limit)
+            return false;
+        t = best;
+        return true;
+    }
+
+    bool URayVolume(const PickVolume& volume, const glm::mat4& inverseModel,
+        const glm::vec3& worldOrigin, const glm::vec3& worldDirection, float limit, float& t)
+    {
+        glm::vec3 origin = glm::vec3(inverseModel * glm::vec4(worldOrigin, 1.0f));
+        glm::vec3 direction = glm::vec3(inverseModel * glm::vec4(worldDirection, 0.0f));
+
+        switch (volume.shape)
+        {
+        case PICK_SPHERE:
+            return URaySphere(origin, direction, limit, t);
+        case PICK_CYLINDER:
+            return URayCylinder(origin, direction, volume.radiusScale, limit, t);
+        default:
+            return URayBox(origin, glm::vec3(1.0f) / direction, volume.boundsMin, volume.boundsMax, limit, t);
+        }
+    }
+}
+
+
+/* ------------------- Ray under a window position -------------------*/
+void UCursorRay(const glm::mat4& viewProjection, float x, float y, float width, float height,
+    glm::vec3& origin, glm::vec3& direction)
+{
+    glm::mat4 inverse = glm::inverse(viewProjection);
+    float ndcX = 2.0f * x / width - 1.0f;
+    float ndcY = 1.0f - 2.0f * y / height;     // window rows grow downward
+
+    glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::vec3(farPoint) / farPoint.w - origin;
+}
+
+
+/* ------------------- Forget every object -------------------*/
+void SceneBvh::clear()
+{
+    objects.clear();
+    nodes.clear();
+    order.clear();
+    parents.clear();
+    leaves.clear();
+    moved.clear();
+    stale.clear();
+    depth = 0;
+}
+
+
+/* ------------------- World bounds and inverse transform of one object -------------------*/
+void SceneBvh::place(Object& object, const glm::mat4& model)
+{
+    const PickVolume& volume = object.volume;
+    glm::vec3 low(volume.boundsMin[0], volume.boundsMin[1], volume.boundsMin[2]);
+    glm::vec3 high(volume.boundsMax[0], volume.boundsMax[1], volume.boundsMax[2]);
+    glm::vec3 center = (low + high) * 0.5f;
+    glm::vec3 halfSize = (high - low) * 0.5f;
+
+    // the same expressions as CullBounds::add
+    object.center = glm::vec3(model * glm::vec4(center, 1.0f));
+    object.extent = glm::vec3(0.0f);
+    for (int axis = 0; axis < 3; ++axis)
+        for (int k = 0; k < 3; ++k)
+            object.extent[axis] += fabsf(model[k][axis]) * halfSize[k];
+
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+        std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    object.radius = volume.boundsRadius * scale;
+    object.inverseModel = glm::inverse(model);
+}
+
+
+/* ------------------- Add one object -------------------*/
+int SceneBvh::add(const PickVolume& volume, const glm::mat4& model)
+{
+    Object object;
+    object.volume = volume;
+    place(object, model);
+    objects.push_back(object);
+    return (int)objects.size() - 1;
+}
+
+
+/* ------------------- Bounds of a node from its children or objects -------------------*/
+void SceneBvh::fitNode(Node& node) const
+{
+    UEmptyBox(node.boundsMin, node.boundsMax);
+    if (node.child >= 0)
+    {
+        for (int side = 0; side < 2; ++side)
+            UGrowBox(node.boundsMin, node.boundsMax, nodes[node.child + side].boundsMin, nodes[node.child + side].boundsMax);
+        return;
+    }
+
+    for (int i = node.first; i < node.first + node.count; ++i)
+    {
+        const Object& object = objects[order[i]];
+        glm::vec3 low = object.center - object.extent, high = object.center + object.extent;
+        float objectMin[3] = { low.x, low.y, low.z };
+        float objectMax[3] = { high.x, high.y, high.z };
+        UGrowBox(node.boundsMin, node.boundsMax, objectMin, objectMax);
+    }
+}
+
+
+/* ------------------- Choose a split by the surface area heuristic -------------------*/
+// Reorders the node's objects so the left child's come first and returns how
+// many there are, or 0 to keep the node a leaf
+int SceneBvh::splitNode(const Node& node)
+{
+    if (node.count <= BVH_LEAF_OBJECTS)
+        return 0;
+
+    float centroidMin[3], centroidMax[3];
+    UEmptyBox(centroidMin, centroidMax);
+    for (int i = node.first; i < node.first + node.count; ++i)
+    {
+        const float* center = &objects[order[i]].center.x;
+        UGrowBox(centroidMin, centroidMax, center, center);
+    }
+
+    // cost of a split: one more node visited, then each child's objects in
+    // proportion to the chance a ray through this node also crosses the child
+    float nodeArea = std::max(UHalfArea(node.boundsMin, node.boundsMax), FLT_MIN);
+    float bestCost = (float)node.count;     // as a leaf
+    int bestAxis = -1, bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f)
+            continue;
+        float binScale = BVH_BINS / extent;
+
+        Bin bins[BVH_BINS];
+        for (int b = 0; b < BVH_BINS; ++b)
+        {
+            UEmptyBox(bins[b].boundsMin, bins[b].boundsMax);
+            bins[b].count = 0;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i)
+        {
+            const Object& object = objects[order[i]];
+            int b = std::min((int)((object.center[axis] - centroidMin[axis]) * binScale), BVH_BINS - 1);
+            glm::vec3 low = object.center - object.extent, high = object.center + object.extent;
+            float objectMin[3] = { low.x, low.y, low.z };
+            float objectMax[3] = { high.x, high.y, high.z };
+            UGrowBox(bins[b].boundsMin, bins[b].boundsMax, objectMin, objectMax);
+            ++bins[b].count;
+        }
+
+        // areas and counts right of each bin edge, then sweep from the left
+        float rightArea[BVH_BINS];
+        int rightCount[BVH_BINS];
+        float boundsMin[3], boundsMax[3];
+        UEmptyBox(boundsMin, boundsMax);
+        int count = 0;
+        for (int b = BVH_BINS - 1; b > 0; --b)
+        {
+            UGrowBox(boundsMin, boundsMax, bins[b].boundsMin, bins[b].boundsMax);
+            count += bins[b].count;
+            rightArea[b] = UHalfArea(boundsMin, boundsMax);
+            rightCount[b] = count;
+        }
+
+        UEmptyBox(boundsMin, boundsMax);
+        count = 0;
+        for (int b = 1; b < BVH_BINS; ++b)
+        {
+            UGrowBox(boundsMin, boundsMax, bins[b - 1].boundsMin, bins[b - 1].boundsMax);
+            count += bins[b - 1].count;
+            if (count == 0 || rightCount[b] == 0)
+                continue;
+            float cost = BVH_TRAVERSAL_COST + (UHalfArea(boundsMin, boundsMax) * count + rightArea[b] * rightCount[b]) / nodeArea;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    std::vector<int>::iterator first = order.begin() + node.first;
+    std::vector<int>::iterator last = first + node.count;
+    if (bestAxis < 0)
+    {
+        // a leaf is cheapest, or every centroid coincides; large nodes are
+        // still halved so leaves stay small
+        if (node.count <= BVH_MAX_LEAF_OBJECTS)
+            return 0;
+        return node.count / 2;
+    }
+
+    float binScale = BVH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    std::vector<int>::iterator middle = std::partition(first, last, [&](int index)
+        {
+            int b = std::min((int)((objects[index].center[bestAxis] - centroidMin[bestAxis]) * binScale), BVH_BINS - 1);
+            return b < bestBin;
+        });
+    return (int)(middle - first);
+}
+
+
+/* ------------------- Build the tree over every object -------------------*/
+void SceneBvh::build()
+{
+    int count = size();
+    nodes.clear();
+    parents.clear();
+    moved.clear();
+    order.resize(count);
+    std::iota(order.begin(), order.end(), 0);
+    leaves.assign(count, 0);
+    depth = 0;
+    if (count == 0)
+    {
+        stale.clear();
+        return;
+    }
+
+    nodes.reserve(2 * count);
+    parents.reserve(2 * count);
+    Node root = { { 0.0f }, { 0.0f }, 0, count, -1 };
+    nodes.push_back(root);
+    parents.push_back(-1);
+
+    // depth first, so a child always comes after its parent in nodes
+    struct Pending
+    {
+        int node;
+        int level;
+    };
+    std::vector<Pending> pending(1, Pending{ 0, 1 });
+    while (!pending.empty())
+    {
+        Pending task = pending.back();
+        pending.pop_back();
+        depth = std::max(depth, task.level);
+
+        fitNode(nodes[task.node]);
+        Node node = nodes[task.node];
+        int leftCount = task.level < BVH_MAX_DEPTH ? splitNode(node) : 0;
+        if (leftCount == 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+                leaves[order[i]] = task.node;
+            continue;
+        }
+
+        int child = (int)nodes.size();
+        nodes[task.node].child = child;
+        Node left = { { 0.0f }, { 0.0f }, node.first, leftCount, -1 };
+        Node right = { { 0.0f }, { 0.0f }, node.first + leftCount, node.count - leftCount, -1 };
+        nodes.push_back(left);
+        nodes.push_back(right);
+        parents.push_back(task.node);
+        parents.push_back(task.node);
+        pending.push_back(Pending{ child + 1, task.level + 1 });
+        pending.push_back(Pending{ child, task.level + 1 });
+    }
+
+    // fitNode ran top down; the inner boxes already enclose their objects
+    stale.assign(nodes.size(), 0);
+}
+
+
+/* ------------------- Move one object -------------------*/
+void SceneBvh::setTransform(int object, const glm::mat4& model)
+{
+    place(objects[object], model);
+    moved.push_back(object);
+}
+
+
+/* ------------------- Refit the boxes above moved objects -------------------*/
+void SceneBvh::refit()
+{
+    if (moved.empty() || nodes.empty())
+    {
+        moved.clear();
+        return;
+    }
+
+    // every node on the paths to the root, once; children have larger
+    // indices than their parents, so refitting in descending order is bottom up
+    std::vector<int> path;
+    for (size_t i = 0; i < moved.size(); ++i)
+    {
+        for (int node = leaves[moved[i]]; node >= 0 && !stale[node]; node = parents[node])
+        {
+            stale[node] = 1;
+            path.push_back(node);
+        }
+    }
+    std::sort(path.begin(), path.end(), std::greater<int>());
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        fitNode(nodes[path[i]]);
+        stale[path[i]] = 0;
+    }
+    moved.clear();
+}
+
+
+/* ------------------- Nearest object along a ray -------------------*/
+int SceneBvh::pick(const glm::vec3& origin, const glm::vec3& direction, float limit, float* distance) const
+{
+    if (nodes.empty())
+        return -1;
+
+    glm::vec3 inverseDirection = glm::vec3(1.0f) / direction;
+    float best = limit;
+    int hit = -1;
+
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node& node = nodes[stack[--top]];
+        float entry;
+        if (!URayBox(origin, inverseDirection, node.boundsMin, node.boundsMax, best, entry))
+            continue;   // missed, or only behind the nearest hit so far
+
+        if (node.child < 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+            {
+                const Object& object = objects[order[i]];
+                float t;
+                if (URayVolume(object.volume, object.inverseModel, origin, direction, best, t))
+                {
+                    best = t;
+                    hit = order[i];
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first so the farther one is often pruned
+        float entries[2];
+        bool hits[2];
+        for (int side = 0; side < 2; ++side)
+        {
+            const Node& child = nodes[node.child + side];
+            hits[side] = URayBox(origin, inverseDirection, child.boundsMin, child.boundsMax, best, entries[side]);
+        }
+        int nearSide = (hits[0] && hits[1] && entries[1] < entries[0]) ? 1 : 0;
+        if (hits[1 - nearSide])
+            stack[top++] = node.child + 1 - nearSide;
+        if (hits[nearSide])
+            stack[top++] = node.child + nearSide;
+    }
+
+    if (hit >= 0 && distance)
+        *distance = best;
+    return hit;
+}
+
+
+/* ------------------- Objects inside a view frustum -------------------*/
+int SceneBvh::cull(const glm::mat4& viewProjection, unsigned char* visible) const
+{
+    memset(visible, 0, objects.size());
+    if (nodes.empty())
+        return 0;
+
+    float planes[6][4];
+    UExtractFrustumPlanes(viewProjection, planes);
+
+    // planes a node lies entirely in front of are dropped for its subtree
+    struct Pending
+    {
+        int node;
+        int planeMask;
+    };
+    Pending stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = Pending{ 0, 0x3f };
+    int visibleCount = 0;
+    while (top > 0)
+    {
+        Pending task = stack[--top];
+        const Node& node = nodes[task.node];
+
+        float center[3], halfSize[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            center[axis] = (node.boundsMin[axis] + node.boundsMax[axis]) * 0.5f;
+            halfSize[axis] = (node.boundsMax[axis] - node.boundsMin[axis]) * 0.5f;
+        }
+
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; ++p)
+        {
+            if (!(task.planeMask & (1 << p)))
+                continue;
+            const float* plane = planes[p];
+            float distance = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+            float reach = fabsf(plane[0]) * halfSize[0] + fabsf(plane[1]) * halfSize[1] + fabsf(plane[2]) * halfSize[2];
+            if (distance < -reach)
+                outside = true;
+            else if (distance >= reach)
+                task.planeMask &= ~(1 << p);
+        }
+        if (outside)
+            continue;
+
+        if (task.planeMask == 0)
+        {
+            // the whole subtree is inside
+            for (int i = node.first; i < node.first + node.count; ++i)
+                visible[order[i]] = 1;
+            visibleCount += node.count;
+            continue;
+        }
+
+        if (node.child >= 0)
+        {
+            stack[top++] = Pending{ node.child + 1, task.planeMask };
+            stack[top++] = Pending{ node.child, task.planeMask };
+            continue;
+        }
+
+        // straddling leaf: the per-object test of CullBounds, sphere and box
+        for (int i = node.first; i < node.first + node.count; ++i)
+        {
+            const Object& object = objects[order[i]];
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p)
+            {
+                const float* plane = planes[p];
+                float distance = plane[0] * object.center.x + plane[1] * object.center.y + plane[2] * object.center.z + plane[3];
+                float reach = fabsf(plane[0]) * object.extent.x + fabsf(plane[1]) * object.extent.y + fabsf(plane[2]) * object.extent.z;
+                inside = distance >= -std::min(reach, object.radius);
+            }
+            if (inside)
+            {
+                visible[order[i]] = 1;
+                ++visibleCount;
+            }
+        }
+    }
+    return visibleCount;
+}
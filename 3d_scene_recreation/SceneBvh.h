@@ -0,0 +1,106 @@
+// Author: Joshua Gauthier
+// Bounding volume hierarchy over the scene objects, for ray picking and frustum queries
+
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Surface a ray is tested against once it reaches an object
+enum PickShape
+{
+    PICK_BOX,           // the model-space box boundsMin..boundsMax (cubes, planes)
+    PICK_SPHERE,        // radius 1 around the origin
+    PICK_CYLINDER       // z from -0.5 to 0.5, base and top radius from radiusScale, with caps
+};
+
+// One object as the hierarchy sees it, in model space: its exact shape and
+// the box the hierarchy bounds it with
+struct PickVolume
+{
+    PickShape shape;
+    float boundsMin[3];
+    float boundsMax[3];
+    float boundsRadius;         // sphere around the box center, for cull()
+    glm::vec2 radiusScale;      // PICK_CYLINDER: taper of the unit cylinder, as in PrimitiveShape
+};
+
+// world-space ray under a window position (x, y from the top left, in the
+// same units as width and height), through the inverse of viewProjection.
+// origin lies on the near plane and origin + direction on the far plane, so
+// distances returned by SceneBvh::pick are fractions of the view depth
+void UCursorRay(const glm::mat4& viewProjection, float x, float y, float width, float height,
+    glm::vec3& origin, glm::vec3& direction);
+
+// Binary tree of world boxes over every object, split by the surface area
+// heuristic. Leaves hold a few objects, so a query visits O(log n) boxes and
+// only tests the exact shapes of the objects its ray or frustum reaches.
+//
+// usage: add() every object, build() once, then pick() and cull() freely.
+// Moving an object is setTransform() followed by refit(), which grows or
+// shrinks only the boxes above the moved objects; the split planes stay, so
+// build() again after large rearrangements.
+class SceneBvh
+{
+public:
+    SceneBvh() : depth(0) {}
+
+    void clear();
+    // returns the object's index, also the index pick() and cull() report
+    int add(const PickVolume& volume, const glm::mat4& model);
+    int size() const { return (int)objects.size(); }
+
+    void build();
+    void setTransform(int object, const glm::mat4& model);
+    void refit();
+
+    // nearest object hit by the ray origin + t * direction, 0 <= t < limit,
+    // or -1; distance receives its t. A UCursorRay stops at the far plane
+    // with a limit of 1
+    int pick(const glm::vec3& origin, const glm::vec3& direction, float limit, float* distance = nullptr) const;
+
+    // same contract and result as CullBounds::cull: visible[i] = 1 when object
+    // i may be inside the frustum of viewProjection, 0 when certainly outside.
+    // Whole subtrees are accepted or rejected by their box
+    int cull(const glm::mat4& viewProjection, unsigned char* visible) const;
+
+    int getNodeCount() const { return (int)nodes.size(); }
+    int getDepth() const { return depth; }
+
+private:
+    // The subtree of a node covers order[first, first + count); an inner
+    // node's children are nodes[child] and nodes[child + 1]
+    struct Node
+    {
+        float boundsMin[3];
+        float boundsMax[3];
+        int first;
+        int count;
+        int child;          // -1 for a leaf
+    };
+
+    struct Object
+    {
+        PickVolume volume;
+        glm::mat4 inverseModel;     // world to model space, for the exact tests
+        glm::vec3 center;           // world box center and half size, and bounding sphere radius,
+        glm::vec3 extent;           // computed as CullBounds does so both cull alike
+        float radius;
+    };
+
+    void place(Object& object, const glm::mat4& model);
+    void fitNode(Node& node) const;
+    int splitNode(const Node& node);
+
+    std::vector<Object> objects;
+    std::vector<Node> nodes;
+    std::vector<int> order;         // object indices, grouped by leaf
+    std::vector<int> parents;       // per node, -1 for the root
+    std::vector<int> leaves;        // per object, the leaf holding it
+    std::vector<int> moved;         // objects changed since the last refit
+    std::vector<unsigned char> stale;   // per node, queued by the current refit
+    int depth;
+};
+
+#endif
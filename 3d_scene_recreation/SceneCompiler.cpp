@@ -0,0 +1,53 @@
+// Author: Joshua Gauthier
+// Compiles a text scene description into the packed binary the renderer reads without parsing
+//
+// usage: scene_compile input.scene output.bscene
+
+#include <chrono>
+#include <iostream>
+
+#include "SceneFile.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    if (argc != 3)
+    {
+        cout << "usage: " << argv[0] << " input.scene output.bscene" << endl;
+        return 1;
+    }
+
+    SceneFile scene;
+    Clock::time_point start = Clock::now();
+    if (!scene.loadText(argv[1]))
+    {
+        cout << scene.getError() << endl;
+        return 1;
+    }
+    double parseMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    if (!scene.saveBinary(argv[2]))
+    {
+        cout << "cannot write " << argv[2] << endl;
+        return 1;
+    }
+
+    // read it back the way the renderer does, to check it and to show the difference
+    SceneFile compiled;
+    start = Clock::now();
+    if (!compiled.loadBinary(argv[2]))
+    {
+        cout << compiled.getError() << endl;
+        return 1;
+    }
+    double loadMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    cout << argv[2] << ": " << scene.getTextureCount() << " textures, " << scene.getMaterialCount() << " materials, "
+        << scene.getPrimitiveCount() << " primitives, " << scene.getObjectCount() << " objects, "
+        << scene.getLightCount() << " lights, " << scene.getByteCount() << " bytes" << endl;
+    cout << "text parse " << parseMs << " ms, binary load " << loadMs << " ms" << endl;
+    return 0;
+}
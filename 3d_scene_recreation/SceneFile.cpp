@@ -0,0 +1,474 @@
+// Author: Joshua Gauthier
+// Scene description: the hand-written text form and the packed binary it compiles to
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "SceneFile.h"
+
+namespace
+{
+    const char SCENE_MAGIC[4] = { 'B', 'S', 'C', 'N' };
+    const unsigned int SCENE_VERSION = 2;
+
+    // record sizes in file order
+    const size_t SCENE_RECORD_SIZES[5] = { sizeof(SceneTextureDesc), sizeof(SceneMaterialDesc),
+        sizeof(ScenePrimitiveDesc), sizeof(SceneObjectDesc), sizeof(SceneLightDesc) };
+
+    // words of one line: quoted words may hold spaces, # ends the line
+    std::vector<std::string> USplitWords(const std::string& line)
+    {
+        std::vector<std::string> words;
+        size_t i = 0;
+        while (i < line.size())
+        {
+            char c = line[i];
+            if (c == '#')
+                break;
+            if (c == ' ' || c == '\t' || c == '\r')
+            {
+                ++i;
+                continue;
+            }
+
+            std::string word;
+            if (c == '"')
+            {
+                size_t end = line.find('"', i + 1);
+                if (end == std::string::npos)
+                    end = line.size();
+                word = line.substr(i + 1, end - i - 1);
+                i = end + 1;
+            }
+            else
+            {
+                while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r' && line[i] != '#')
+                    word += line[i++];
+            }
+            words.push_back(word);
+        }
+        return words;
+    }
+
+    bool UParseFloat(const std::string& word, float& value)
+    {
+        char* end;
+        value = strtof(word.c_str(), &end);
+        return !word.empty() && *end == '\0';
+    }
+
+    bool UParseInt(const std::string& word, int& value)
+    {
+        char* end;
+        value = (int)strtol(word.c_str(), &end, 10);
+        return !word.empty() && *end == '\0';
+    }
+
+    bool UCopyText(char* target, size_t capacity, const std::string& text)
+    {
+        if (text.size() >= capacity)
+            return false;
+        memset(target, 0, capacity);
+        memcpy(target, text.c_str(), text.size());
+        return true;
+    }
+
+    // a fixed-size string field holds its terminating zero
+    template <size_t Capacity>
+    bool UTerminated(const char (&field)[Capacity])
+    {
+        return memchr(field, 0, Capacity) != nullptr;
+    }
+
+    // a shape the renderer knows, with a size and a tessellation it can build
+    bool UValidPrimitive(const ScenePrimitiveDesc& primitive)
+    {
+        if (primitive.shape == SCENE_PLANE || primitive.shape == SCENE_CUBE)
+            return true;
+        if (primitive.shape != SCENE_CYLINDER && primitive.shape != SCENE_SPHERE)
+            return false;
+        return std::isfinite(primitive.baseRadius) && std::isfinite(primitive.topRadius) && std::isfinite(primitive.height)
+            && primitive.baseRadius >= 0.0f && primitive.topRadius >= 0.0f && primitive.height >= 0.0f
+            && primitive.sectorCount >= SCENE_MIN_SECTORS && primitive.sectorCount <= SCENE_MAX_SECTORS
+            && primitive.stackCount >= SCENE_MIN_STACKS && primitive.stackCount <= SCENE_MAX_STACKS;
+    }
+
+    bool UFinite(const float* values, int count)
+    {
+        for (int i = 0; i < count; ++i)
+            if (!std::isfinite(values[i]))
+                return false;
+        return true;
+    }
+
+    // a NaN or infinite matrix poisons the inverse the BVH places the object with
+    bool UValidObject(const SceneObjectDesc& object)
+    {
+        return UFinite(object.model, 16);
+    }
+
+    bool UValidLight(const SceneLightDesc& light)
+    {
+        return UFinite(light.position, 3) && UFinite(light.color, 3) && std::isfinite(light.strength)
+            && std::isfinite(light.range) && light.range >= 0.0f;
+    }
+
+    bool UValidMaterial(const SceneMaterialDesc& material)
+    {
+        return UFinite(material.ambient, 3) && std::isfinite(material.specular);
+    }
+
+    // index of a name declared earlier, -1 when unknown
+    int UFind(const std::map<std::string, int>& names, const std::string& name)
+    {
+        std::map<std::string, int>::const_iterator found = names.find(name);
+        return found == names.end() ? -1 : found->second;
+    }
+
+    template <typename Record>
+    void UAppend(std::vector<unsigned char>& data, const std::vector<Record>& records)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(records.data());
+        data.insert(data.end(), bytes, bytes + records.size() * sizeof(Record));
+    }
+}
+
+
+/* ------------------- An empty scene -------------------*/
+SceneFile::SceneFile()
+{
+    Header header = {};
+    memcpy(header.magic, SCENE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_VERSION;
+    header.byteCount = sizeof(Header);
+    data.assign(reinterpret_cast<const unsigned char*>(&header), reinterpret_cast<const unsigned char*>(&header) + sizeof(Header));
+}
+
+
+bool SceneFile::fail(const std::string& message)
+{
+    error = message;
+    return false;
+}
+
+
+/* ------------------- Records of one section -------------------*/
+const unsigned char* SceneFile::getRecords(int section) const
+{
+    const Header& header = getHeader();
+    const int counts[5] = { header.textureCount, header.materialCount, header.primitiveCount, header.objectCount, header.lightCount };
+    size_t offset = sizeof(Header);
+    for (int i = 0; i < section; ++i)
+        offset += counts[i] * SCENE_RECORD_SIZES[i];
+    return data.data() + offset;
+}
+
+const SceneTextureDesc* SceneFile::getTextures() const { return reinterpret_cast<const SceneTextureDesc*>(getRecords(0)); }
+const SceneMaterialDesc* SceneFile::getMaterials() const { return reinterpret_cast<const SceneMaterialDesc*>(getRecords(1)); }
+const ScenePrimitiveDesc* SceneFile::getPrimitives() const { return reinterpret_cast<const ScenePrimitiveDesc*>(getRecords(2)); }
+const SceneObjectDesc* SceneFile::getObjects() const { return reinterpret_cast<const SceneObjectDesc*>(getRecords(3)); }
+const SceneLightDesc* SceneFile::getLights() const { return reinterpret_cast<const SceneLightDesc*>(getRecords(4)); }
+
+
+/* ------------------- Load either form -------------------*/
+bool SceneFile::load(const char* path)
+{
+    char magic[4] = {};
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return fail(std::string("cannot open ") + path);
+    size_t read = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+
+    if (read == sizeof(magic) && memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0)
+        return loadBinary(path);
+    return loadText(path);
+}
+
+
+/* ------------------- Read a compiled scene in one go -------------------*/
+bool SceneFile::loadBinary(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return fail(std::string("cannot open ") + path);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    std::vector<unsigned char> bytes(size > 0 ? (size_t)size : 0);
+    size_t read = fread(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+    if (read != bytes.size() || bytes.size() < sizeof(Header))
+        return fail(std::string(path) + ": truncated");
+
+    // the header must match and its counts fit the file
+    const Header& header = *reinterpret_cast<const Header*>(bytes.data());
+    if (memcmp(header.magic, SCENE_MAGIC, sizeof(header.magic)) != 0 || header.version != SCENE_VERSION)
+        return fail(std::string(path) + ": not a compiled scene of version " + std::to_string(SCENE_VERSION));
+    const int counts[5] = { header.textureCount, header.materialCount, header.primitiveCount, header.objectCount, header.lightCount };
+    size_t expected = sizeof(Header);
+    for (int i = 0; i < 5; ++i)
+    {
+        if (counts[i] < 0)
+            return fail(std::string(path) + ": corrupt header");
+        expected += counts[i] * SCENE_RECORD_SIZES[i];
+    }
+    if (expected != bytes.size() || header.byteCount != bytes.size())
+        return fail(std::string(path) + ": size does not match its header");
+
+    data.swap(bytes);
+    return checkRecords(path);
+}
+
+
+/* ------------------- Every record of a compiled scene is usable -------------------*/
+// Names and paths reach fopen, the profiler and its trace, so each must end
+// within its field; primitives must be buildable, numbers finite and indices
+// point at records
+bool SceneFile::checkRecords(const char* path)
+{
+    const SceneTextureDesc* textures = getTextures();
+    const SceneMaterialDesc* materials = getMaterials();
+    const ScenePrimitiveDesc* primitives = getPrimitives();
+    const SceneObjectDesc* objects = getObjects();
+    const SceneLightDesc* lights = getLights();
+
+    const char* problem = nullptr;
+    for (int i = 0; i < getTextureCount() && !problem; ++i)
+        if (!UTerminated(textures[i].name) || !UTerminated(textures[i].path))
+            problem = "unterminated texture name or path";
+    for (int i = 0; i < getMaterialCount() && !problem; ++i)
+    {
+        if (!UTerminated(materials[i].name))
+            problem = "unterminated material name";
+        else if (materials[i].texture < 0 || materials[i].texture >= getTextureCount()
+            || materials[i].extraTexture < SCENE_NO_TEXTURE || materials[i].extraTexture >= getTextureCount())
+            problem = "texture index out of range";
+        else if (!UValidMaterial(materials[i]))
+            problem = "material color or specular not finite";
+    }
+    for (int i = 0; i < getPrimitiveCount() && !problem; ++i)
+    {
+        if (!UTerminated(primitives[i].name))
+            problem = "unterminated primitive name";
+        else if (!UValidPrimitive(primitives[i]))
+            problem = "primitive shape, size or tessellation out of range";
+    }
+    for (int i = 0; i < getObjectCount() && !problem; ++i)
+    {
+        if (!UTerminated(objects[i].name))
+            problem = "unterminated object name";
+        else if (objects[i].primitive < 0 || objects[i].primitive >= getPrimitiveCount()
+            || objects[i].material < 0 || objects[i].material >= getMaterialCount())
+            problem = "primitive or material index out of range";
+        else if (!UValidObject(objects[i]))
+            problem = "object model matrix not finite";
+    }
+    for (int i = 0; i < getLightCount() && !problem; ++i)
+        if (!UValidLight(lights[i]))
+            problem = "light not finite or with a negative range";
+
+    if (!problem)
+        return true;
+    *this = SceneFile();
+    return fail(std::string(path) + ": " + problem);
+}
+
+
+/* ------------------- Write the compiled form -------------------*/
+bool SceneFile::saveBinary(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && written;
+}
+
+
+/* ------------------- Parse the text form -------------------*/
+bool SceneFile::loadText(const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return fail(std::string("cannot open ") + path);
+
+    std::vector<SceneTextureDesc> textures;
+    std::vector<SceneMaterialDesc> materials;
+    std::vector<ScenePrimitiveDesc> primitives;
+    std::vector<SceneObjectDesc> objects;
+    std::vector<SceneLightDesc> lights;
+    std::map<std::string, int> textureNames, materialNames, primitiveNames;
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        std::vector<std::string> words = USplitWords(line);
+        if (words.empty())
+            continue;
+
+        std::string where = std::string(path) + ":" + std::to_string(lineNumber) + ": ";
+        const std::string& keyword = words[0];
+        size_t count = words.size();
+        float numbers[8];
+
+        if (keyword == "texture")
+        {
+            SceneTextureDesc texture;
+            if (count != 3 || !UCopyText(texture.name, sizeof(texture.name), words[1]) || !UCopyText(texture.path, sizeof(texture.path), words[2]))
+                return fail(where + "expected texture NAME PATH");
+            if (!textureNames.insert(std::make_pair(words[1], (int)textures.size())).second)
+                return fail(where + "texture " + words[1] + " declared twice");
+            textures.push_back(texture);
+        }
+        else if (keyword == "material")
+        {
+            SceneMaterialDesc material;
+            bool valid = (count == 7 || count == 8) && UCopyText(material.name, sizeof(material.name), words[1]);
+            for (int i = 0; i < 4 && valid; ++i)
+                valid = UParseFloat(words[2 + i], numbers[i]);
+            if (!valid)
+                return fail(where + "expected material NAME AMBIENT_R AMBIENT_G AMBIENT_B SPECULAR TEXTURE [EXTRA_TEXTURE]");
+            for (int i = 0; i < 3; ++i)
+                material.ambient[i] = numbers[i];
+            material.specular = numbers[3];
+            if (!UValidMaterial(material))
+                return fail(where + "material color and specular must be finite");
+            material.texture = UFind(textureNames, words[6]);
+            material.extraTexture = count == 8 ? UFind(textureNames, words[7]) : SCENE_NO_TEXTURE;
+            if (material.texture < 0 || (count == 8 && material.extraTexture < 0))
+                return fail(where + "unknown texture");
+            if (!materialNames.insert(std::make_pair(words[1], (int)materials.size())).second)
+                return fail(where + "material " + words[1] + " declared twice");
+            materials.push_back(material);
+        }
+        else if (keyword == "plane" || keyword == "cube" || keyword == "cylinder" || keyword == "sphere")
+        {
+            ScenePrimitiveDesc primitive = {};
+            primitive.smooth = 1;
+            if (count >= 2 && words[count - 1] == "flat")
+            {
+                primitive.smooth = 0;
+                --count;
+            }
+
+            bool valid = count >= 2 && UCopyText(primitive.name, sizeof(primitive.name), words[1]);
+            if (keyword == "plane" || keyword == "cube")
+            {
+                primitive.shape = keyword == "plane" ? SCENE_PLANE : SCENE_CUBE;
+                valid = valid && count == 2;
+            }
+            else if (keyword == "cylinder")
+            {
+                primitive.shape = SCENE_CYLINDER;
+                valid = valid && count == 7 && UParseFloat(words[2], primitive.baseRadius) && UParseFloat(words[3], primitive.topRadius)
+                    && UParseFloat(words[4], primitive.height) && UParseInt(words[5], primitive.sectorCount) && UParseInt(words[6], primitive.stackCount);
+            }
+            else
+            {
+                primitive.shape = SCENE_SPHERE;
+                valid = valid && count == 5 && UParseFloat(words[2], primitive.baseRadius)
+                    && UParseInt(words[3], primitive.sectorCount) && UParseInt(words[4], primitive.stackCount);
+                primitive.topRadius = primitive.height = primitive.baseRadius;
+            }
+            if (!valid)
+                return fail(where + "bad " + keyword + " record");
+            if (!UValidPrimitive(primitive))
+                return fail(where + "sizes must be finite and non-negative, sectors within " + std::to_string(SCENE_MIN_SECTORS) + "-"
+                    + std::to_string(SCENE_MAX_SECTORS) + " and stacks within " + std::to_string(SCENE_MIN_STACKS) + "-" + std::to_string(SCENE_MAX_STACKS));
+            if (!primitiveNames.insert(std::make_pair(words[1], (int)primitives.size())).second)
+                return fail(where + "primitive " + words[1] + " declared twice");
+            primitives.push_back(primitive);
+        }
+        else if (keyword == "light")
+        {
+            bool valid = count == 8 || count == 9;
+            numbers[7] = 0.0f;
+            for (int i = 0; i < (int)count - 1 && valid; ++i)
+                valid = UParseFloat(words[1 + i], numbers[i]);
+            if (!valid)
+                return fail(where + "expected light X Y Z R G B STRENGTH [RANGE]");
+            SceneLightDesc light;
+            for (int i = 0; i < 3; ++i)
+            {
+                light.position[i] = numbers[i];
+                light.color[i] = numbers[3 + i];
+            }
+            light.strength = numbers[6];
+            light.range = numbers[7];
+            if (!UValidLight(light))
+                return fail(where + "light numbers must be finite and its range non-negative");
+            lights.push_back(light);
+        }
+        else if (keyword == "object")
+        {
+            SceneObjectDesc object;
+            if (count < 4 || !UCopyText(object.name, sizeof(object.name), words[1]))
+                return fail(where + "expected object NAME PRIMITIVE MATERIAL [translate X Y Z] [rotate RADIANS X Y Z]... [scale X Y Z]");
+            object.primitive = UFind(primitiveNames, words[2]);
+            object.material = UFind(materialNames, words[3]);
+            if (object.primitive < 0 || object.material < 0)
+                return fail(where + "unknown primitive or material");
+
+            // the same products the scene was built from in code: translation * rotation * scale
+            glm::mat4 translation(1.0f), rotation(1.0f), scale(1.0f);
+            size_t i = 4;
+            while (i < count)
+            {
+                const std::string& transform = words[i];
+                int arguments = transform == "rotate" ? 4 : 3;
+                bool valid = (transform == "translate" || transform == "rotate" || transform == "scale") && i + arguments < count;
+                for (int k = 0; k < arguments && valid; ++k)
+                    valid = UParseFloat(words[i + 1 + k], numbers[k]);
+                if (!valid)
+                    return fail(where + "bad transform after " + words[i - 1]);
+
+                if (transform == "translate")
+                    translation = glm::translate(glm::mat4(1.0f), glm::vec3(numbers[0], numbers[1], numbers[2]));
+                else if (transform == "rotate")
+                    rotation = glm::rotate(rotation, numbers[0], glm::vec3(numbers[1], numbers[2], numbers[3]));
+                else
+                    scale = glm::scale(glm::mat4(1.0f), glm::vec3(numbers[0], numbers[1], numbers[2]));
+                i += 1 + arguments;
+            }
+            glm::mat4 model = translation * rotation * scale;
+            memcpy(object.model, glm::value_ptr(model), sizeof(object.model));
+            if (!UValidObject(object))
+                return fail(where + "transform numbers must be finite");
+            objects.push_back(object);
+        }
+        else
+            return fail(where + "unknown record " + keyword);
+    }
+
+    // lay the records out exactly as the compiled file
+    Header header = {};
+    memcpy(header.magic, SCENE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_VERSION;
+    header.textureCount = (int)textures.size();
+    header.materialCount = (int)materials.size();
+    header.primitiveCount = (int)primitives.size();
+    header.objectCount = (int)objects.size();
+    header.lightCount = (int)lights.size();
+
+    std::vector<unsigned char> bytes(reinterpret_cast<const unsigned char*>(&header), reinterpret_cast<const unsigned char*>(&header) + sizeof(Header));
+    UAppend(bytes, textures);
+    UAppend(bytes, materials);
+    UAppend(bytes, primitives);
+    UAppend(bytes, objects);
+    UAppend(bytes, lights);
+    reinterpret_cast<Header*>(bytes.data())->byteCount = (unsigned int)bytes.size();
+
+    data.swap(bytes);
+    return true;
+}
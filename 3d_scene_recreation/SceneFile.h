@@ -0,0 +1,141 @@
+// Author: Joshua Gauthier
+// Scene description: the hand-written text form and the packed binary it compiles to
+
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <string>
+#include <vector>
+
+const int SCENE_NAME_LENGTH = 32;       // with the terminating zero
+const int SCENE_PATH_LENGTH = 128;
+const int SCENE_NO_TEXTURE = -1;
+// tessellation either form may ask for; the level of detail chain doubles it
+const int SCENE_MIN_SECTORS = 3;
+const int SCENE_MAX_SECTORS = 1024;
+const int SCENE_MIN_STACKS = 1;
+const int SCENE_MAX_STACKS = 512;
+
+enum SceneShape
+{
+    SCENE_PLANE,        // the built-in plane mesh
+    SCENE_CUBE,         // the built-in cube mesh
+    SCENE_CYLINDER,     // baseRadius, topRadius, height
+    SCENE_SPHERE        // baseRadius is the radius
+};
+
+// Records of the compiled file. Every field is 4 bytes wide, so the arrays
+// are read straight into memory with no padding to account for.
+// Texture and material references are indices into the arrays before them
+struct SceneTextureDesc
+{
+    char name[SCENE_NAME_LENGTH];
+    char path[SCENE_PATH_LENGTH];       // relative to the working directory
+};
+
+struct SceneMaterialDesc
+{
+    char name[SCENE_NAME_LENGTH];
+    float ambient[3];
+    float specular;
+    int texture;
+    int extraTexture;                   // drawn over texture, or SCENE_NO_TEXTURE
+};
+
+struct ScenePrimitiveDesc
+{
+    char name[SCENE_NAME_LENGTH];
+    int shape;                          // SceneShape
+    float baseRadius;
+    float topRadius;
+    float height;
+    int sectorCount;
+    int stackCount;
+    int smooth;
+};
+
+struct SceneObjectDesc
+{
+    char name[SCENE_NAME_LENGTH];
+    int primitive;
+    int material;
+    // translate * rotations * scale as written in the text; the primitive's
+    // own size is applied on top by the renderer
+    float model[16];                    // column-major, as glm
+};
+
+struct SceneLightDesc
+{
+    float position[3];
+    float color[3];
+    float strength;
+    float range;                        // distance at which it fades out, 0 for no falloff
+};
+
+// A scene in memory, always held in its compiled layout: a header and then
+// the textures, materials, primitives, objects and lights back to back.
+// loadText() parses the text form into that layout; loadBinary() reads a
+// compiled file with a single read and then only checks its header and that
+// every record is usable (terminated strings, sizes and tessellation within
+// the limits above, finite numbers, indices in range), so large scenes load
+// at disk speed.
+// Binaries are in the byte order of the machine that compiled them.
+//
+// Text form, one record per line, # starts a comment, names with spaces in quotes:
+//   texture NAME PATH
+//   material NAME AMBIENT_R AMBIENT_G AMBIENT_B SPECULAR TEXTURE [EXTRA_TEXTURE]
+//   plane NAME | cube NAME
+//   cylinder NAME BASE_RADIUS TOP_RADIUS HEIGHT SECTORS STACKS [flat]
+//   sphere NAME RADIUS SECTORS STACKS [flat]
+//   light X Y Z R G B STRENGTH [RANGE]
+//   object NAME PRIMITIVE MATERIAL [translate X Y Z] [rotate RADIANS X Y Z]... [scale X Y Z]
+// An object's model matrix is translate * rotate * ... * scale, rotations
+// composed in the order written (the last one turns the object first).
+class SceneFile
+{
+public:
+    SceneFile();
+
+    // either form, told apart by the first bytes
+    bool load(const char* path);
+    bool loadText(const char* path);
+    bool loadBinary(const char* path);
+    bool saveBinary(const char* path) const;
+    // what the last failed call ran into, with the line for text files
+    const std::string& getError() const { return error; }
+
+    int getTextureCount() const { return getHeader().textureCount; }
+    int getMaterialCount() const { return getHeader().materialCount; }
+    int getPrimitiveCount() const { return getHeader().primitiveCount; }
+    int getObjectCount() const { return getHeader().objectCount; }
+    int getLightCount() const { return getHeader().lightCount; }
+    const SceneTextureDesc* getTextures() const;
+    const SceneMaterialDesc* getMaterials() const;
+    const ScenePrimitiveDesc* getPrimitives() const;
+    const SceneObjectDesc* getObjects() const;
+    const SceneLightDesc* getLights() const;
+    size_t getByteCount() const { return data.size(); }
+
+private:
+    struct Header
+    {
+        char magic[4];
+        unsigned int version;
+        int textureCount;
+        int materialCount;
+        int primitiveCount;
+        int objectCount;
+        int lightCount;
+        unsigned int byteCount;         // whole file, header included
+    };
+
+    const Header& getHeader() const { return *reinterpret_cast<const Header*>(data.data()); }
+    const unsigned char* getRecords(int section) const;
+    bool fail(const std::string& message);
+    bool checkRecords(const char* path);
+
+    std::vector<unsigned char> data;
+    std::string error;
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include <iomanip>
 #include <cmath>
 #include "Sphere.h"
+#include "MeshKernels.h"
 
 
 
@@ -26,7 +27,9 @@ const int MIN_STACK_COUNT = 2;
 ///////////////////////////////////////////////////////////////////////////////
 // ctor
 ///////////////////////////////////////////////////////////////////////////////
-Sphere::Sphere(float radius, int sectors, int stacks, bool smooth) : interleavedStride(32)
+template <class Format>
+BasicSphere<Format>::BasicSphere(float radius, int sectors, int stacks, bool smooth, std::pmr::memory_resource* resource)
+    : strips(false), interleavedVertices(resource), indices(resource), lineIndices(resource)
 {
     set(radius, sectors, stacks, smooth);
 }
@@ -36,42 +39,52 @@ Sphere::Sphere(float radius, int sectors, int stacks, bool smooth) : interleaved
 ///////////////////////////////////////////////////////////////////////////////
 // setters
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::set(float radius, int sectors, int stacks, bool smooth)
+template <class Format>
+void BasicSphere<Format>::set(float radius, int sectors, int stacks, bool smooth)
 {
     this->radius = radius;
     this->sectorCount = sectors;
     if (sectors < MIN_SECTOR_COUNT)
         this->sectorCount = MIN_SECTOR_COUNT;
     this->stackCount = stacks;
-    if (sectors < MIN_STACK_COUNT)
-        this->sectorCount = MIN_STACK_COUNT;
+    if (stacks < MIN_STACK_COUNT)
+        this->stackCount = MIN_STACK_COUNT;
     this->smooth = smooth;
 
+    // quantized formats store positions relative to the bounds
+    float boundsMin[3] = { -this->radius, -this->radius, -this->radius };
+    float boundsMax[3] = { this->radius, this->radius, this->radius };
+    decode = Format::positionDecode(boundsMin, boundsMax);
+
     if (smooth)
         buildVerticesSmooth();
     else
         buildVerticesFlat();
 }
 
-void Sphere::setRadius(float radius)
+template <class Format>
+void BasicSphere<Format>::setRadius(float radius)
 {
     if (radius != this->radius)
         set(radius, sectorCount, stackCount, smooth);
 }
 
-void Sphere::setSectorCount(int sectors)
+template <class Format>
+void BasicSphere<Format>::setSectorCount(int sectors)
 {
     if (sectors != this->sectorCount)
         set(radius, sectors, stackCount, smooth);
 }
 
-void Sphere::setStackCount(int stacks)
+template <class Format>
+void BasicSphere<Format>::setStackCount(int stacks)
 {
     if (stacks != this->stackCount)
         set(radius, sectorCount, stacks, smooth);
 }
 
-void Sphere::setSmooth(bool smooth)
+template <class Format>
+void BasicSphere<Format>::setSmooth(bool smooth)
 {
     if (this->smooth == smooth)
         return;
@@ -83,12 +96,26 @@ void Sphere::setSmooth(bool smooth)
         buildVerticesFlat();
 }
 
+template <class Format>
+void BasicSphere<Format>::setStrips(bool strips)
+{
+    if (this->strips == strips)
+        return;
+
+    this->strips = strips;
+    if (smooth)
+        buildVerticesSmooth();
+    else
+        buildVerticesFlat();
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // print itself
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::printSelf() const
+template <class Format>
+void BasicSphere<Format>::printSelf() const
 {
     std::cout << "===== Sphere =====\n"
         << "        Radius: " << radius << "\n"
@@ -96,10 +123,10 @@ void Sphere::printSelf() const
         << "   Stack Count: " << stackCount << "\n"
         << "Smooth Shading: " << (smooth ? "true" : "false") << "\n"
         << "Triangle Count: " << getTriangleCount() << "\n"
-        << "   Index Count: " << getIndexCount() << "\n"
+        << "   Index Count: " << getIndexCount() << " (" << getIndexWidth() * 8 << "-bit"
+        << (strips ? ", strips" : "") << ")\n"
         << "  Vertex Count: " << getVertexCount() << "\n"
-        << "  Normal Count: " << getNormalCount() << "\n"
-        << "TexCoord Count: " << getTexCoordCount() << std::endl;
+        << "        Stride: " << getInterleavedStride() << " bytes" << std::endl;
 }
 
 
@@ -108,17 +135,25 @@ void Sphere::printSelf() const
 // draw a sphere in VertexArray mode
 // OpenGL RC must be set before calling it
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::draw() const
+template <class Format>
+void BasicSphere<Format>::draw() const
 {
+    // the fixed-function arrays only read unnormalized floats, and there is
+    // no fixed restart index before GL 4.3
+    if (Format::attributes[0].type != ATTRIBUTE_FLOAT || strips)
+        return;
+
     // interleaved array
+    const char* base = (const char*)interleavedVertices.data();
+    const int stride = getInterleavedStride();
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
+    glVertexPointer(3, GL_FLOAT, stride, base + Format::attributes[0].offset);
+    glNormalPointer(GL_FLOAT, stride, base + Format::attributes[1].offset);
+    glTexCoordPointer(2, GL_FLOAT, stride, base + Format::attributes[2].offset);
 
-    glDrawElements(GL_TRIANGLES, (unsigned int)indices.size(), GL_UNSIGNED_INT, indices.data());
+    glDrawElements(GL_TRIANGLES, indices.size(), indices.width() == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, indices.data());
 
     glDisableClientState(GL_VERTEX_ARRAY);
     glDisableClientState(GL_NORMAL_ARRAY);
@@ -131,8 +166,12 @@ void Sphere::draw() const
 // draw lines only
 // the caller must set the line width before call this
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::drawLines(const float lineColor[4]) const
+template <class Format>
+void BasicSphere<Format>::drawLines(const float lineColor[4]) const
 {
+    if (Format::attributes[0].type != ATTRIBUTE_FLOAT)
+        return;
+
     // set line colour
     glColor4fv(lineColor);
     glMaterialfv(GL_FRONT, GL_DIFFUSE, lineColor);
@@ -141,9 +180,9 @@ void Sphere::drawLines(const float lineColor[4]) const
     glDisable(GL_LIGHTING);
     glDisable(GL_TEXTURE_2D);
     glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, 0, vertices.data());
+    glVertexPointer(3, GL_FLOAT, getInterleavedStride(), (const char*)interleavedVertices.data() + Format::attributes[0].offset);
 
-    glDrawElements(GL_LINES, (unsigned int)lineIndices.size(), GL_UNSIGNED_INT, lineIndices.data());
+    glDrawElements(GL_LINES, lineIndices.size(), lineIndices.width() == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, lineIndices.data());
 
     glDisableClientState(GL_VERTEX_ARRAY);
     glEnable(GL_LIGHTING);
@@ -156,7 +195,8 @@ void Sphere::drawLines(const float lineColor[4]) const
 // draw a sphere surfaces and lines on top of it
 // the caller must set the line width before call this
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::drawWithLines(const float lineColor[4]) const
+template <class Format>
+void BasicSphere<Format>::drawWithLines(const float lineColor[4]) const
 {
     glEnable(GL_POLYGON_OFFSET_FILL);
     glPolygonOffset(1.0, 1.0f); // move polygon backward
@@ -198,13 +238,28 @@ void Sphere::updateRadius()
 ///////////////////////////////////////////////////////////////////////////////
 // dealloc vectors
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::clearArrays()
+template <class Format>
+void BasicSphere<Format>::clearArrays()
 {
-    std::vector<float>().swap(vertices);
-    std::vector<float>().swap(normals);
-    std::vector<float>().swap(texCoords);
-    std::vector<unsigned int>().swap(indices);
-    std::vector<unsigned int>().swap(lineIndices);
+    std::pmr::memory_resource* resource = interleavedVertices.get_allocator().resource();
+    std::pmr::vector<Vertex>(resource).swap(interleavedVertices);
+    indices.release();
+    lineIndices.release();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// allocate every array once at its exact final size
+// the add* functions below then never reallocate
+// the vertex count also picks the index width (16-bit up to 65535 vertices)
+///////////////////////////////////////////////////////////////////////////////
+template <class Format>
+void BasicSphere<Format>::reserveArrays(unsigned int vertexCount, unsigned int indexCount, unsigned int lineIndexCount)
+{
+    interleavedVertices.reserve(vertexCount);
+    indices.reset(vertexCount, indexCount);
+    lineIndices.reset(vertexCount, lineIndexCount);
 }
 
 
@@ -217,50 +272,28 @@ void Sphere::clearArrays()
 // where u: stack(latitude) angle (-90 <= u <= 90)
 //       v: sector(longitude) angle (0 <= v <= 360)
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::buildVerticesSmooth()
+template <class Format>
+void BasicSphere<Format>::buildVerticesSmooth()
 {
-    const float PI = acos(-1);
-
     // clear memory of prev arrays
     clearArrays();
 
-    float x, y, z, xy;                              // vertex position
-    float nx, ny, nz, lengthInv = 1.0f / radius;    // normal
-    float s, t;                                     // texCoord
-
-    float sectorStep = 2 * PI / sectorCount;
-    float stackStep = PI / stackCount;
-    float sectorAngle, stackAngle;
-
-    for (int i = 0; i <= stackCount; ++i)
-    {
-        stackAngle = PI / 2 - i * stackStep;        // starting from pi/2 to -pi/2
-        xy = radius * cosf(stackAngle);             // r * cos(u)
-        z = radius * sinf(stackAngle);              // r * sin(u)
-
-        // add (sectorCount+1) vertices per stack
-        // the first and last vertices have same position and normal, but different tex coords
-        for (int j = 0; j <= sectorCount; ++j)
-        {
-            sectorAngle = j * sectorStep;           // starting from 0 to 2pi
-
-            // vertex position
-            x = xy * cosf(sectorAngle);             // r * cos(u) * cos(v)
-            y = xy * sinf(sectorAngle);             // r * cos(u) * sin(v)
-            addVertex(x, y, z);
-
-            // normalized vertex normal
-            nx = x * lengthInv;
-            ny = y * lengthInv;
-            nz = z * lengthInv;
-            addNormal(nx, ny, nz);
-
-            // vertex tex coord between [0, 1]
-            s = (float)j / sectorCount;
-            t = (float)i / stackCount;
-            addTexCoord(s, t);
-        }
-    }
+    // (sectorCount+1) vertices per stack
+    // the first and last vertices have same position and normal, but different tex coords
+    // 2 triangles per sector except the first and last stacks (1 triangle)
+    // or 1 strip of 2 indices per column per stack, separated by restart indices
+    // 1 vertical line per sector, plus 1 horizontal line except the first stack
+    unsigned int vertexCount = (stackCount + 1) * (sectorCount + 1);
+    unsigned int indexCount = strips ? stackCount * (2 * sectorCount + 3) - 1
+                                     : sectorCount * (2 * stackCount - 2) * 3;
+    unsigned int lineIndexCount = sectorCount * (4 * stackCount - 2);
+    reserveArrays(vertexCount, indexCount, lineIndexCount);
+    interleavedVertices.resize(vertexCount);
+
+    // whole rings at a time from batched sin/cos tables (MeshKernels),
+    // straight into the interleaved layout
+    USphereRings<Format>(radius, sectorCount, stackCount, interleavedVertices.data(), decode,
+        interleavedVertices.get_allocator().resource());
 
     // indices
     //  k1--k1+1
@@ -273,32 +306,42 @@ void Sphere::buildVerticesSmooth()
         k1 = i * (sectorCount + 1);     // beginning of current stack
         k2 = k1 + sectorCount + 1;      // beginning of next stack
 
+        // one strip per stack: k1, k2, k1+1, k2+1, ... gives the same triangles
+        // and winding as the list, plus one zero-area triangle per sector at
+        // each pole (the pole vertices share a position) that the rasterizer drops
+        if (strips)
+        {
+            indices.beginStrip();
+            for (int j = 0; j <= sectorCount; ++j)
+            {
+                indices.push(k1 + j);
+                indices.push(k2 + j);
+            }
+        }
+
         for (int j = 0; j < sectorCount; ++j, ++k1, ++k2)
         {
             // 2 triangles per sector excluding 1st and last stacks
-            if (i != 0)
+            if (i != 0 && !strips)
             {
                 addIndices(k1, k2, k1 + 1);   // k1---k2---k1+1
             }
 
-            if (i != (stackCount - 1))
+            if (i != (stackCount - 1) && !strips)
             {
                 addIndices(k1 + 1, k2, k2 + 1); // k1+1---k2---k2+1
             }
 
             // vertical lines for all stacks
-            lineIndices.push_back(k1);
-            lineIndices.push_back(k2);
+            lineIndices.push(k1);
+            lineIndices.push(k2);
             if (i != 0)  // horizontal lines except 1st stack
             {
-                lineIndices.push_back(k1);
-                lineIndices.push_back(k1 + 1);
+                lineIndices.push(k1);
+                lineIndices.push(k1 + 1);
             }
         }
     }
-
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
 }
 
 
@@ -307,37 +350,42 @@ void Sphere::buildVerticesSmooth()
 // generate vertices with flat shading
 // each triangle is independent (no shared vertices)
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::buildVerticesFlat()
+template <class Format>
+void BasicSphere<Format>::buildVerticesFlat()
 {
     const float PI = acos(-1);
 
     // tmp vertex definition (x,y,z,s,t)
-    struct Vertex
+    struct GridVertex
     {
         float x, y, z, s, t;
     };
-    std::vector<Vertex> tmpVertices;
+    std::pmr::memory_resource* resource = interleavedVertices.get_allocator().resource();
+    std::pmr::vector<GridVertex> tmpVertices(resource);
+    tmpVertices.reserve((stackCount + 1) * (sectorCount + 1));
 
     float sectorStep = 2 * PI / sectorCount;
     float stackStep = PI / stackCount;
-    float sectorAngle, stackAngle;
+
+    // sin/cos of every sector and stack angle, batched
+    std::pmr::vector<float> sectorSin(sectorCount + 1, resource), sectorCos(sectorCount + 1, resource);
+    std::pmr::vector<float> stackSin(stackCount + 1, resource), stackCos(stackCount + 1, resource);
+    USinCosRamp(0.0f, sectorStep, sectorCount + 1, sectorSin.data(), sectorCos.data());    // 0 to 2pi
+    USinCosRamp(PI / 2, -stackStep, stackCount + 1, stackSin.data(), stackCos.data());    // pi/2 to -pi/2
 
     // compute all vertices first, each vertex contains (x,y,z,s,t) except normal
     for (int i = 0; i <= stackCount; ++i)
     {
-        stackAngle = PI / 2 - i * stackStep;        // starting from pi/2 to -pi/2
-        float xy = radius * cosf(stackAngle);       // r * cos(u)
-        float z = radius * sinf(stackAngle);        // r * sin(u)
+        float xy = radius * stackCos[i];            // r * cos(u)
+        float z = radius * stackSin[i];             // r * sin(u)
 
         // add (sectorCount+1) vertices per stack
         // the first and last vertices have same position and normal, but different tex coords
         for (int j = 0; j <= sectorCount; ++j)
         {
-            sectorAngle = j * sectorStep;           // starting from 0 to 2pi
-
-            Vertex vertex;
-            vertex.x = xy * cosf(sectorAngle);      // x = r * cos(u) * cos(v)
-            vertex.y = xy * sinf(sectorAngle);      // y = r * cos(u) * sin(v)
+            GridVertex vertex;
+            vertex.x = xy * sectorCos[j];           // x = r * cos(u) * cos(v)
+            vertex.y = xy * sectorSin[j];           // y = r * cos(u) * sin(v)
             vertex.z = z;                           // z = r * sin(u)
             vertex.s = (float)j / sectorCount;        // s
             vertex.t = (float)i / stackCount;         // t
@@ -348,10 +396,18 @@ void Sphere::buildVerticesFlat()
     // clear memory of prev arrays
     clearArrays();
 
-    Vertex v1, v2, v3, v4;                          // 4 vertex positions and tex coords
-    std::vector<float> n;                           // 1 face normal
+    // first and last stacks: 1 triangle (3 vertices, 2 or 4 line indices) per sector
+    // other stacks: a quad (4 vertices, 6 indices, 4 line indices) per sector
+    // no vertex is shared, so strips are a 3 or 4 index strip per sector plus restarts
+    unsigned int vertexCount = sectorCount * (4 * stackCount - 2);
+    unsigned int indexCount = strips ? vertexCount + sectorCount * stackCount - 1
+                                     : sectorCount * (6 * stackCount - 6);
+    reserveArrays(vertexCount, indexCount, sectorCount * (4 * stackCount - 2));
+
+    GridVertex v1, v2, v3, v4;                      // 4 vertex positions and tex coords
+    std::array<float, 3> n;                         // 1 face normal
 
-    int i, j, k, vi1, vi2;
+    int i, j, vi1, vi2;
     int index = 0;                                  // index for vertex
     for (i = 0; i < stackCount; ++i)
     {
@@ -373,174 +429,115 @@ void Sphere::buildVerticesFlat()
             // otherwise, store 2 triangles (quad) per sector
             if (i == 0) // a triangle for first stack ==========================
             {
-                // put a triangle
-                addVertex(v1.x, v1.y, v1.z);
-                addVertex(v2.x, v2.y, v2.z);
-                addVertex(v4.x, v4.y, v4.z);
-
-                // put tex coords of triangle
-                addTexCoord(v1.s, v1.t);
-                addTexCoord(v2.s, v2.t);
-                addTexCoord(v4.s, v4.t);
-
-                // put normal
+                // put a triangle, same normal for 3 vertices
                 n = computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v4.x, v4.y, v4.z);
-                for (k = 0; k < 3; ++k)  // same normals for 3 vertices
-                {
-                    addNormal(n[0], n[1], n[2]);
-                }
+                addVertex(v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                addVertex(v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                addVertex(v4.x, v4.y, v4.z, n[0], n[1], n[2], v4.s, v4.t);
 
                 // put indices of 1 triangle
-                addIndices(index, index + 1, index + 2);
+                if (strips)
+                    addStrip(index, 3);
+                else
+                    addIndices(index, index + 1, index + 2);
 
                 // indices for line (first stack requires only vertical line)
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 1);
+                lineIndices.push(index);
+                lineIndices.push(index + 1);
 
                 index += 3;     // for next
             }
             else if (i == (stackCount - 1)) // a triangle for last stack =========
             {
-                // put a triangle
-                addVertex(v1.x, v1.y, v1.z);
-                addVertex(v2.x, v2.y, v2.z);
-                addVertex(v3.x, v3.y, v3.z);
-
-                // put tex coords of triangle
-                addTexCoord(v1.s, v1.t);
-                addTexCoord(v2.s, v2.t);
-                addTexCoord(v3.s, v3.t);
-
-                // put normal
+                // put a triangle, same normal for 3 vertices
                 n = computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v3.x, v3.y, v3.z);
-                for (k = 0; k < 3; ++k)  // same normals for 3 vertices
-                {
-                    addNormal(n[0], n[1], n[2]);
-                }
+                addVertex(v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                addVertex(v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                addVertex(v3.x, v3.y, v3.z, n[0], n[1], n[2], v3.s, v3.t);
 
                 // put indices of 1 triangle
-                addIndices(index, index + 1, index + 2);
+                if (strips)
+                    addStrip(index, 3);
+                else
+                    addIndices(index, index + 1, index + 2);
 
                 // indices for lines (last stack requires both vert/hori lines)
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 1);
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 2);
+                lineIndices.push(index);
+                lineIndices.push(index + 1);
+                lineIndices.push(index);
+                lineIndices.push(index + 2);
 
                 index += 3;     // for next
             }
             else // 2 triangles for others ====================================
             {
-                // put quad vertices: v1-v2-v3-v4
-                addVertex(v1.x, v1.y, v1.z);
-                addVertex(v2.x, v2.y, v2.z);
-                addVertex(v3.x, v3.y, v3.z);
-                addVertex(v4.x, v4.y, v4.z);
-
-                // put tex coords of quad
-                addTexCoord(v1.s, v1.t);
-                addTexCoord(v2.s, v2.t);
-                addTexCoord(v3.s, v3.t);
-                addTexCoord(v4.s, v4.t);
-
-                // put normal
+                // put quad vertices: v1-v2-v3-v4, same normal for 4 vertices
                 n = computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v3.x, v3.y, v3.z);
-                for (k = 0; k < 4; ++k)  // same normals for 4 vertices
-                {
-                    addNormal(n[0], n[1], n[2]);
-                }
+                addVertex(v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                addVertex(v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                addVertex(v3.x, v3.y, v3.z, n[0], n[1], n[2], v3.s, v3.t);
+                addVertex(v4.x, v4.y, v4.z, n[0], n[1], n[2], v4.s, v4.t);
 
                 // put indices of quad (2 triangles)
-                addIndices(index, index + 1, index + 2);
-                addIndices(index + 2, index + 1, index + 3);
+                if (strips)
+                {
+                    addStrip(index, 4);
+                }
+                else
+                {
+                    addIndices(index, index + 1, index + 2);
+                    addIndices(index + 2, index + 1, index + 3);
+                }
 
                 // indices for lines
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 1);
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 2);
+                lineIndices.push(index);
+                lineIndices.push(index + 1);
+                lineIndices.push(index);
+                lineIndices.push(index + 2);
 
                 index += 4;     // for next
             }
         }
     }
 
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// generate interleaved vertices: V/N/T
-// stride must be 32 bytes
-///////////////////////////////////////////////////////////////////////////////
-void Sphere::buildInterleavedVertices()
-{
-    std::vector<float>().swap(interleavedVertices);
-
-    std::size_t i, j;
-    std::size_t count = vertices.size();
-    for (i = 0, j = 0; i < count; i += 3, j += 2)
-    {
-        interleavedVertices.push_back(vertices[i]);
-        interleavedVertices.push_back(vertices[i + 1]);
-        interleavedVertices.push_back(vertices[i + 2]);
-
-        interleavedVertices.push_back(normals[i]);
-        interleavedVertices.push_back(normals[i + 1]);
-        interleavedVertices.push_back(normals[i + 2]);
-
-        interleavedVertices.push_back(texCoords[j]);
-        interleavedVertices.push_back(texCoords[j + 1]);
-    }
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// add single vertex to array
-///////////////////////////////////////////////////////////////////////////////
-void Sphere::addVertex(float x, float y, float z)
-{
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z);
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// add single normal to array
+// encode a single vertex straight into the interleaved array
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::addNormal(float nx, float ny, float nz)
+template <class Format>
+void BasicSphere<Format>::addVertex(float x, float y, float z, float nx, float ny, float nz, float s, float t)
 {
-    normals.push_back(nx);
-    normals.push_back(ny);
-    normals.push_back(nz);
+    interleavedVertices.emplace_back();
+    Format::write(interleavedVertices.back(), decode, x, y, z, nx, ny, nz, s, t);
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// add single texture coord to array
+// add 3 indices to array
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::addTexCoord(float s, float t)
+template <class Format>
+void BasicSphere<Format>::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
 {
-    texCoords.push_back(s);
-    texCoords.push_back(t);
+    indices.push(i1);
+    indices.push(i2);
+    indices.push(i3);
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// add 3 indices to array
+// add a strip of count consecutive indices, after a restart index
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
+template <class Format>
+void BasicSphere<Format>::addStrip(unsigned int first, unsigned int count)
 {
-    indices.push_back(i1);
-    indices.push_back(i2);
-    indices.push_back(i3);
+    indices.beginStrip();
+    for (unsigned int i = 0; i < count; ++i)
+        indices.push(first + i);
 }
 
 
@@ -549,13 +546,14 @@ void Sphere::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
 // return face normal of a triangle v1-v2-v3
 // if a triangle has no surface (normal length = 0), then return a zero vector
 ///////////////////////////////////////////////////////////////////////////////
-std::vector<float> Sphere::computeFaceNormal(float x1, float y1, float z1,  // v1
+template <class Format>
+std::array<float, 3> BasicSphere<Format>::computeFaceNormal(float x1, float y1, float z1,  // v1
     float x2, float y2, float z2,  // v2
     float x3, float y3, float z3)  // v3
 {
     const float EPSILON = 0.000001f;
 
-    std::vector<float> normal(3, 0.0f);     // default return value (0,0,0)
+    std::array<float, 3> normal = { 0.0f, 0.0f, 0.0f };    // default return value (0,0,0)
     float nx, ny, nz;
 
     // find 2 edge vectors: v1-v2, v1-v3
@@ -584,3 +582,10 @@ std::vector<float> Sphere::computeFaceNormal(float x1, float y1, float z1,  // v
 
     return normal;
 }
+
+
+
+// formats the sphere is built in //////////////////////////////////////////////
+template class BasicSphere<VertexP3N3T2>;
+template class BasicSphere<VertexUnorm16Oct>;
+template class BasicSphere<VertexHalfOct>;
@@ -3,14 +3,25 @@
 #ifndef GEOMETRY_SPHERE_H
 #define GEOMETRY_SPHERE_H
 
+#include <array>
+#include <memory_resource>
 #include <vector>
+#include "MeshIndices.h"
+#include "VertexFormat.h"
 
-class Sphere
+// Format: vertex layout the builders write into (VertexFormat.h)
+template <class Format>
+class BasicSphere
 {
 public:
+    typedef typename Format::Vertex Vertex;
+
     // ctor/dtor
-    Sphere(float radius = 1.0f, int sectorCount = 36, int stackCount = 18, bool smooth = true);
-    ~Sphere() {}
+    // every array (and every temporary of the builders) is allocated from resource,
+    // a constant number of allocations per build whatever the sector/stack counts
+    BasicSphere(float radius = 1.0f, int sectorCount = 36, int stackCount = 18, bool smooth = true,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    ~BasicSphere() {}
 
     // getters/setters
     float getRadius() const { return radius; }
@@ -21,32 +32,29 @@ public:
     void setSectorCount(int sectorCount);
     void setStackCount(int stackCount);
     void setSmooth(bool smooth);
+    void setStrips(bool strips);                        // one triangle strip per stack ring
 
     // for vertex data
-    unsigned int getVertexCount() const { return (unsigned int)vertices.size() / 3; }
-    unsigned int getNormalCount() const { return (unsigned int)normals.size() / 3; }
-    unsigned int getTexCoordCount() const { return (unsigned int)texCoords.size() / 2; }
+    unsigned int getVertexCount() const { return (unsigned int)interleavedVertices.size(); }
     unsigned int getIndexCount() const { return (unsigned int)indices.size(); }
     unsigned int getLineIndexCount() const { return (unsigned int)lineIndices.size(); }
-    unsigned int getTriangleCount() const { return getIndexCount() / 3; }
-    unsigned int getVertexSize() const { return (unsigned int)vertices.size() * sizeof(float); }
-    unsigned int getNormalSize() const { return (unsigned int)normals.size() * sizeof(float); }
-    unsigned int getTexCoordSize() const { return (unsigned int)texCoords.size() * sizeof(float); }
-    unsigned int getIndexSize() const { return (unsigned int)indices.size() * sizeof(unsigned int); }
-    unsigned int getLineIndexSize() const { return (unsigned int)lineIndices.size() * sizeof(unsigned int); }
-    const float* getVertices() const { return vertices.data(); }
-    const float* getNormals() const { return normals.data(); }
-    const float* getTexCoords() const { return texCoords.data(); }
-    const unsigned int* getIndices() const { return indices.data(); }
-    const unsigned int* getLineIndices() const { return lineIndices.data(); }
+    unsigned int getTriangleCount() const { return sectorCount * (stackCount - 1) * 2; }
+    unsigned int getIndexSize() const { return indices.size() * indices.width(); }
+    unsigned int getLineIndexSize() const { return lineIndices.size() * lineIndices.width(); }
+    unsigned int getIndexWidth() const { return indices.width(); }     // 2 or 4 bytes, same for lines
+    IndexTopology getIndexTopology() const { return strips ? INDEX_TRIANGLE_STRIP : INDEX_TRIANGLES; }
+    const void* getIndices() const { return indices.data(); }
+    const void* getLineIndices() const { return lineIndices.data(); }
 
-    // for interleaved vertices: V/N/T
+    // for interleaved vertices, the only copy of the vertex data
     unsigned int getInterleavedVertexCount() const { return getVertexCount(); }    // # of vertices
-    unsigned int getInterleavedVertexSize() const { return (unsigned int)interleavedVertices.size() * sizeof(float); }    // # of bytes
-    int getInterleavedStride() const { return interleavedStride; }   // should be 32 bytes
-    const float* getInterleavedVertices() const { return interleavedVertices.data(); }
+    unsigned int getInterleavedVertexSize() const { return (unsigned int)(interleavedVertices.size() * sizeof(Vertex)); }    // # of bytes
+    int getInterleavedStride() const { return (int)sizeof(Vertex); }   // 32 bytes for VertexP3N3T2
+    const Vertex* getInterleavedVertices() const { return interleavedVertices.data(); }
+    // position = decode.offset + decode.scale * stored position (identity for float formats)
+    const VertexDecode& getPositionDecode() const { return decode; }
 
-    // draw in VertexArray mode
+    // draw in VertexArray mode (32-bit float formats, triangle lists only)
     void draw() const;                                  // draw surface
     void drawLines(const float lineColor[4]) const;     // draw lines only
     void drawWithLines(const float lineColor[4]) const; // draw surface and lines
@@ -60,13 +68,12 @@ private:
     // member functions
     void buildVerticesSmooth();
     void buildVerticesFlat();
-    void buildInterleavedVertices();
     void clearArrays();
-    void addVertex(float x, float y, float z);
-    void addNormal(float x, float y, float z);
-    void addTexCoord(float s, float t);
+    void reserveArrays(unsigned int vertexCount, unsigned int indexCount, unsigned int lineIndexCount);
+    void addVertex(float x, float y, float z, float nx, float ny, float nz, float s, float t);
     void addIndices(unsigned int i1, unsigned int i2, unsigned int i3);
-    std::vector<float> computeFaceNormal(float x1, float y1, float z1,
+    void addStrip(unsigned int first, unsigned int count);
+    std::array<float, 3> computeFaceNormal(float x1, float y1, float z1,
         float x2, float y2, float z2,
         float x3, float y3, float z3);
 
@@ -75,16 +82,15 @@ private:
     int sectorCount;                        // longitude, # of slices
     int stackCount;                         // latitude, # of stacks
     bool smooth;
-    std::vector<float> vertices;
-    std::vector<float> normals;
-    std::vector<float> texCoords;
-    std::vector<unsigned int> indices;
-    std::vector<unsigned int> lineIndices;
-
-    // interleaved
-    std::vector<float> interleavedVertices;
-    int interleavedStride;                  // # of bytes to hop to the next vertex (should be 32 bytes)
+    bool strips;
+    std::pmr::vector<Vertex> interleavedVertices;   // written once by the builders
+    VertexDecode decode;                    // positions relative to the bounds
+    MeshIndices indices;                    // 16-bit up to 65535 vertices
+    MeshIndices lineIndices;
 
 };
 
+// the scene's sphere: full-precision V/N/T, 32 bytes per vertex
+typedef BasicSphere<VertexP3N3T2> Sphere;
+
 #endif
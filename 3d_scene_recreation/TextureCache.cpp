@@ -0,0 +1,306 @@
+// Author: Joshua Gauthier
+// On-disk cache of decoded, flipped and mipmapped texel data
+
+#include <algorithm>        // max
+#include <cstddef>          // offsetof
+#include <cstdio>
+#include <cstring>          // memcmp, strlen
+#include <iostream>         // cout
+#include <vector>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>         // _mkdir
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "TextureCache.h"
+#include "CpuProfiler.h"
+
+namespace
+{
+    const char CACHE_MAGIC[4] = { 'B', 'T', 'X', 'C' };
+    const uint32_t CACHE_VERSION = 1;
+
+    // FNV-1a, 64 bit
+    uint64_t UHash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // hash of a whole file's contents
+    bool UHashFile(const char* path, uint64_t& hash)
+    {
+        FILE* file = fopen(path, "rb");
+        if (file == NULL)
+            return false;
+
+        hash = 14695981039346656037ull;
+        unsigned char buffer[65536];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            hash = UHash(buffer, read, hash);
+
+        fclose(file);
+        return true;
+    }
+
+    bool UStatFile(const char* path, int64_t& mtime, uint64_t& size)
+    {
+        struct stat info;
+        if (stat(path, &info) != 0)
+            return false;
+        mtime = (int64_t)info.st_mtime;
+        size = (uint64_t)info.st_size;
+        return true;
+    }
+
+    // record a new modification time for an entry whose source only got touched,
+    // so the next launch skips the content hash again
+    void URefreshMtime(const std::string& path, int64_t mtime)
+    {
+        FILE* file = fopen(path.c_str(), "r+b");
+        if (file == NULL)
+            return;
+        if (fseek(file, offsetof(TextureCacheHeader, sourceMtime), SEEK_SET) == 0)
+            fwrite(&mtime, sizeof(mtime), 1, file);
+        fclose(file);
+    }
+
+    // Read-only view of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile() : data(NULL), size(0)
+#ifdef _WIN32
+            , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+        {}
+        ~MappedFile() { close(); }
+
+        bool open(const char* path)
+        {
+#ifdef _WIN32
+            file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER fileSize;
+            GetFileSizeEx(file, &fileSize);
+            size = (size_t)fileSize.QuadPart;
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping == NULL)
+                return false;
+            data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0)
+            {
+                size = (size_t)info.st_size;
+                void* view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                data = view == MAP_FAILED ? NULL : (const unsigned char*)view;
+            }
+            ::close(fd);    // the mapping keeps the file alive
+#endif
+            return data != NULL;
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (data != NULL)
+                UnmapViewOfFile(data);
+            if (mapping != NULL)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+            mapping = NULL;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (data != NULL)
+                munmap((void*)data, size);
+#endif
+            data = NULL;
+            size = 0;
+        }
+
+        const unsigned char* data;
+        size_t size;
+
+    private:
+#ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+#endif
+    };
+}
+
+
+/* ------------------- Entry file of a source path -------------------*/
+std::string TextureCache::entryPath(uint64_t pathHash) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.btxc", (unsigned long long)pathHash);
+    return directory + name;
+}
+
+
+/* ------------------- Upload a cached texture -------------------*/
+bool TextureCache::upload(const char* source, GLuint texture)
+{
+    PROFILE_ZONE("texture cache upload");
+
+    int64_t mtime;
+    uint64_t size;
+    if (!UStatFile(source, mtime, size))
+        return false;
+
+    uint64_t pathHash = UHash(source, strlen(source));
+    std::string path = entryPath(pathHash);
+    MappedFile entry;
+    if (!entry.open(path.c_str()) || entry.size < sizeof(TextureCacheHeader))
+        return false;
+
+    // validate the key before trusting any offsets
+    const TextureCacheHeader& header = *(const TextureCacheHeader*)entry.data;
+    if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION ||
+        header.pathHash != pathHash || header.sourceSize != size ||
+        (header.channels != 3 && header.channels != 4) ||
+        header.levelCount == 0 || header.levelCount > TextureCacheHeader::MAX_LEVELS)
+        return false;
+
+    // every level must lie inside the file and halve the one before it, or
+    // the driver would read past the mapping
+    for (uint32_t level = 0; level < header.levelCount; ++level)
+    {
+        const TextureCacheHeader::Level& mip = header.levels[level];
+        uint32_t width = level == 0 ? header.width : std::max(1u, header.levels[level - 1].width / 2);
+        uint32_t height = level == 0 ? header.height : std::max(1u, header.levels[level - 1].height / 2);
+        if (mip.width != width || mip.height != height || mip.width == 0 || mip.height == 0 ||
+            mip.offset < sizeof(TextureCacheHeader) || mip.offset > entry.size ||
+            (uint64_t)mip.width * mip.height > (entry.size - mip.offset) / header.channels)
+            return false;
+    }
+
+    // a touched but unchanged file (checkout, copy) is still a hit
+    bool touched = header.sourceMtime != mtime;
+    if (touched)
+    {
+        uint64_t contentHash;
+        if (!UHashFile(source, contentHash) || contentHash != header.contentHash)
+            return false;
+    }
+
+    GLenum internalFormat = header.channels == 3 ? GL_RGB8 : GL_RGBA8;
+    GLenum format = header.channels == 3 ? GL_RGB : GL_RGBA;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    // straight from the mapping: no decode, no flip, no mipmap generation
+    for (uint32_t level = 0; level < header.levelCount; ++level)
+    {
+        const TextureCacheHeader::Level& mip = header.levels[level];
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, entry.data + mip.offset);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levelCount - 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // unmapped first: the entry cannot be written while it is mapped on Windows
+    entry.close();
+    if (touched)
+        URefreshMtime(path, mtime);
+
+    return true;
+}
+
+
+/* ------------------- Write an entry from an uploaded texture -------------------*/
+bool TextureCache::store(const char* source, GLuint texture, int channels)
+{
+    PROFILE_ZONE("texture cache store");
+
+    TextureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.pathHash = UHash(source, strlen(source));
+    header.channels = channels;
+    if (!UStatFile(source, header.sourceMtime, header.sourceSize) || !UHashFile(source, header.contentHash))
+        return false;
+
+    // size of every level the driver generated
+    glBindTexture(GL_TEXTURE_2D, texture);
+    uint64_t offset = sizeof(TextureCacheHeader);
+    for (int level = 0; level < TextureCacheHeader::MAX_LEVELS; ++level)
+    {
+        GLint width = 0, height = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0 || height == 0)
+            break;
+
+        header.levels[level].offset = offset;
+        header.levels[level].width = width;
+        header.levels[level].height = height;
+        offset += (uint64_t)width * height * channels;
+        ++header.levelCount;
+
+        if (width == 1 && height == 1)
+            break;
+    }
+    header.width = header.levels[0].width;
+    header.height = header.levels[0].height;
+
+    // read the whole chain back (the cold path only)
+    std::vector<unsigned char> texels((size_t)(offset - sizeof(TextureCacheHeader)));
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (uint32_t level = 0; level < header.levelCount; ++level)
+    {
+        glGetTexImage(GL_TEXTURE_2D, level, channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE,
+            texels.data() + (header.levels[level].offset - sizeof(TextureCacheHeader)));
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+
+    // write beside the entry and swap it in, so a crash never leaves half an entry
+    std::string path = entryPath(header.pathHash);
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == NULL)
+    {
+        std::cout << "Failed to write texture cache entry " << path << std::endl;
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(texels.data(), 1, texels.size(), file) == texels.size();
+    fclose(file);
+
+    remove(path.c_str());
+    if (!written || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
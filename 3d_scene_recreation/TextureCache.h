@@ -0,0 +1,57 @@
+// Author: Joshua Gauthier
+// On-disk cache of decoded, flipped and mipmapped texel data
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include "GLLoader.h"
+
+// Layout of a cache entry: this header, then every mip level tightly packed
+// (bottom row first, as OpenGL expects), level 0 first
+struct TextureCacheHeader
+{
+    static const int MAX_LEVELS = 16;
+
+    char magic[4];              // "BTXC"
+    uint32_t version;
+    uint64_t pathHash;          // key: source path
+    int64_t sourceMtime;        // key: source modification time
+    uint64_t sourceSize;
+    uint64_t contentHash;       // key: source bytes, checked when the mtime moved
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;          // 3 or 4
+    uint32_t levelCount;
+    struct Level
+    {
+        uint64_t offset;        // from the start of the file
+        uint32_t width;
+        uint32_t height;
+    } levels[MAX_LEVELS];
+};
+
+// One file per source image, named after the hash of its path. A hit maps
+// the file and hands every level straight to glTexImage2D; a miss is filled
+// by reading back the mip chain the driver generated for the decoded image
+class TextureCache
+{
+public:
+    TextureCache() : directory("texture_cache") {}
+
+    void setDirectory(const char* path) { directory = path; }
+
+    // uploads every level of a valid entry into texture. False when there is
+    // no entry or it is stale, in which case the caller decodes the source
+    bool upload(const char* source, GLuint texture);
+    // reads back texture's mip chain and writes a fresh entry for source
+    bool store(const char* source, GLuint texture, int channels);
+
+private:
+    std::string entryPath(uint64_t pathHash) const;
+
+    std::string directory;
+};
+
+#endif
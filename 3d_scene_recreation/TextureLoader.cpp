@@ -0,0 +1,226 @@
+// Author: Joshua Gauthier
+// Decodes textures on a worker pool and uploads them through a pixel buffer object
+
+#include <cstring>          // memcpy
+#include <iostream>         // cout
+
+#include "TextureLoader.h"
+#include "CpuProfiler.h"
+#include "stb_image.h"
+
+
+/* ------------------- Queue a file -------------------*/
+GLuint TextureLoader::load(const char* filename)
+{
+    Job job;
+    glGenTextures(1, &job.texture);
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+
+    // set the texture wrapping parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // warm start: every level comes straight from the cache
+    if (useCache && cache.upload(filename, job.texture))
+        return job.texture;
+
+    // only the header is read here; the decode happens on a worker
+    if (!stbi_info(filename, &job.width, &job.height, &job.channels))
+    {
+        glDeleteTextures(1, &job.texture);
+        return 0;
+    }
+    if (job.channels != 3 && job.channels != 4)
+    {
+        std::cout << "Not implemented to handle image with " << job.channels << " channels" << std::endl;
+        glDeleteTextures(1, &job.texture);
+        return 0;
+    }
+
+    job.filename = filename;
+    job.offset = 0;
+
+    // grey until the real image arrives
+    const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    jobs.push_back(job);
+    return job.texture;
+}
+
+
+/* ------------------- Start decoding -------------------*/
+void TextureLoader::start()
+{
+    if (jobs.empty())
+        return;
+
+    // one slice of the pixel buffer per image, laid out back to back
+    size_t size = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        jobs[i].offset = size;
+        size += (size_t)jobs[i].width * jobs[i].height * jobs[i].channels;
+    }
+
+    // persistent + coherent: workers write while the GL thread uploads other slices
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+    mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    states.reset(new std::atomic<int>[jobs.size()]);
+    for (size_t i = 0; i < jobs.size(); ++i)
+        states[i].store(JOB_DECODING, std::memory_order_relaxed);
+    remaining = (int)jobs.size();
+    nextJob.store(0);
+
+    unsigned int threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+    if (threadCount > jobs.size())
+        threadCount = (unsigned int)jobs.size();
+
+    for (unsigned int t = 0; t < threadCount; ++t)
+    {
+        workers.push_back(std::thread([this]()
+        {
+            CpuProfiler::setThreadName("texture worker");
+            // pull the next file until the queue is empty
+            for (size_t i = nextJob.fetch_add(1); i < jobs.size(); i = nextJob.fetch_add(1))
+                decode(i);
+        }));
+    }
+}
+
+
+/* ------------------- Worker: decode one image into its slice -------------------*/
+void TextureLoader::decode(size_t index)
+{
+    PROFILE_ZONE("decode texture");
+
+    const Job& job = jobs[index];
+    int width, height, channels;
+    unsigned char* image = stbi_load(job.filename.c_str(), &width, &height, &channels, job.channels);
+
+    if (image == NULL || width != job.width || height != job.height)
+    {
+        if (image != NULL)
+            stbi_image_free(image);
+        states[index].store(JOB_FAILED, std::memory_order_release);
+        return;
+    }
+
+    // the copy into the pixel buffer is also the vertical flip OpenGL expects
+    size_t rowSize = (size_t)width * job.channels;
+    unsigned char* destination = mapped + job.offset;
+    for (int row = 0; row < height; ++row)
+        memcpy(destination + row * rowSize, image + (height - 1 - row) * rowSize, rowSize);
+
+    stbi_image_free(image);
+
+    // publish after the pixels are written
+    states[index].store(JOB_READY, std::memory_order_release);
+}
+
+
+/* ------------------- GL thread: upload finished images -------------------*/
+int TextureLoader::update(int maxUploads)
+{
+    if (remaining == 0)
+        return 0;
+
+    int uploads = 0;
+    for (size_t i = 0; i < jobs.size() && uploads < maxUploads; ++i)
+    {
+        int state = states[i].load(std::memory_order_acquire);
+        if (state == JOB_READY)
+        {
+            upload(jobs[i]);
+            ++uploads;
+        }
+        else if (state == JOB_FAILED)
+            std::cout << "Failed to load texture " << jobs[i].filename << std::endl;
+        else
+            continue;
+
+        states[i].store(JOB_DONE, std::memory_order_relaxed);
+        --remaining;
+    }
+
+    // everything is on the GPU: the staging memory can go
+    if (remaining == 0)
+        destroy();
+
+    return remaining;
+}
+
+
+/* ------------------- Block until everything is uploaded -------------------*/
+void TextureLoader::finish()
+{
+    joinWorkers();
+    update((int)jobs.size());
+}
+
+
+/* ------------------- Upload one image from the pixel buffer -------------------*/
+void TextureLoader::upload(const Job& job)
+{
+    PROFILE_ZONE("upload texture");
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+
+    // rows are tightly packed in the pixel buffer
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (job.channels == 3)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, job.width, job.height, 0, GL_RGB, GL_UNSIGNED_BYTE, (void*)job.offset);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, job.width, job.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)job.offset);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    // a bound unpack buffer would turn later client pointers into offsets
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // next launch skips the decode
+    if (useCache)
+        cache.store(job.filename.c_str(), job.texture, job.channels);
+}
+
+
+/* ------------------- Release the workers and pixel buffer -------------------*/
+void TextureLoader::destroy()
+{
+    joinWorkers();
+
+    if (pbo != 0)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &pbo);
+    }
+    pbo = 0;
+    mapped = NULL;
+}
+
+
+/* ------------------- Wait for the workers to exit -------------------*/
+void TextureLoader::joinWorkers()
+{
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    workers.clear();
+}
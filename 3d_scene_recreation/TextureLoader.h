@@ -0,0 +1,82 @@
+// Author: Joshua Gauthier
+// Decodes textures on a worker pool and uploads them through a pixel buffer object
+
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GLLoader.h"
+#include "TextureCache.h"
+
+// Loads every queued image concurrently. load() hands back a texture name that
+// is usable immediately (a 1x1 grey placeholder); the workers decode and flip
+// each image straight into one persistently mapped pixel buffer object, and
+// update() on the GL thread turns finished decodes into texture uploads. The
+// render loop can therefore start before the last image is ready.
+//
+// Files with a valid TextureCache entry skip all of that: load() uploads them
+// on the spot. Decoded files write a fresh entry after their upload.
+//
+// usage: load() each file, start() once, then update() every frame (or
+// finish() to block until everything is uploaded)
+class TextureLoader
+{
+public:
+    TextureLoader() : useCache(true), pbo(0), mapped(NULL), nextJob(0), remaining(0) {}
+    ~TextureLoader() { joinWorkers(); }
+
+    // queues a file and creates its placeholder texture. Returns 0 when the
+    // file cannot be read or has an unsupported channel count
+    GLuint load(const char* filename);
+    // maps the pixel buffer and starts the workers
+    void start();
+    // uploads at most maxUploads finished images. Returns the number still pending
+    int update(int maxUploads);
+    // waits for every decode and uploads the rest
+    void finish();
+    // stops the workers and releases the pixel buffer (textures belong to the caller)
+    void destroy();
+
+    int getPending() const { return remaining; }
+    // always decode and never write entries when false
+    void setCacheEnabled(bool enabled) { useCache = enabled; }
+    TextureCache& getCache() { return cache; }
+
+private:
+    enum JobState
+    {
+        JOB_DECODING,
+        JOB_READY,      // pixels are in the pixel buffer
+        JOB_FAILED,
+        JOB_DONE        // uploaded or reported
+    };
+    struct Job
+    {
+        std::string filename;
+        GLuint texture;
+        int width;
+        int height;
+        int channels;
+        size_t offset;  // into the pixel buffer
+    };
+
+    void decode(size_t job);
+    void upload(const Job& job);
+    void joinWorkers();
+
+    TextureCache cache;
+    bool useCache;
+    std::vector<Job> jobs;
+    std::unique_ptr<std::atomic<int>[]> states;     // JobState per job, written by the workers
+    std::vector<std::thread> workers;
+    GLuint pbo;
+    unsigned char* mapped;
+    std::atomic<size_t> nextJob;
+    int remaining;
+};
+
+#endif
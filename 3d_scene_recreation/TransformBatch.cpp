@@ -0,0 +1,115 @@
+// Author: Joshua Gauthier
+// Cached model and normal matrices of the scene objects, recomputed only when an object moves
+
+#include <algorithm>        // sort
+
+#include "TransformBatch.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_BATCH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+#ifdef TRANSFORM_BATCH_SSE
+    // a x b in xyz; w is 0 when a.w * b.w is finite
+    inline __m128 UCross(__m128 a, __m128 b)
+    {
+        __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 zxy = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+        return _mm_shuffle_ps(zxy, zxy, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+
+    void UComputeNormalMatrix(ObjectTransform& transform)
+    {
+        __m128 c0 = _mm_loadu_ps(&transform.model[0][0]);
+        __m128 c1 = _mm_loadu_ps(&transform.model[1][0]);
+        __m128 c2 = _mm_loadu_ps(&transform.model[2][0]);
+
+        // rows of the 3x3 inverse are the cross products of the other two columns over the determinant
+        __m128 n0 = UCross(c1, c2);
+        __m128 n1 = UCross(c2, c0);
+        __m128 n2 = UCross(c0, c1);
+        __m128 products = _mm_mul_ps(c0, n0);
+        float det = _mm_cvtss_f32(products)
+            + _mm_cvtss_f32(_mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)))
+            + _mm_cvtss_f32(_mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 2, 2, 2)));
+        __m128 inverseDet = _mm_set1_ps(1.0f / det);
+        _mm_storeu_ps(&transform.normalMatrix[0][0], _mm_mul_ps(n0, inverseDet));
+        _mm_storeu_ps(&transform.normalMatrix[1][0], _mm_mul_ps(n1, inverseDet));
+        _mm_storeu_ps(&transform.normalMatrix[2][0], _mm_mul_ps(n2, inverseDet));
+    }
+#else
+    void UComputeNormalMatrix(ObjectTransform& transform)
+    {
+        const glm::mat4& model = transform.model;
+        glm::vec3 c0(model[0]), c1(model[1]), c2(model[2]);
+        glm::vec3 n0 = glm::cross(c1, c2);
+        float inverseDet = 1.0f / glm::dot(c0, n0);
+        transform.normalMatrix[0] = glm::vec4(n0 * inverseDet, 0.0f);
+        transform.normalMatrix[1] = glm::vec4(glm::cross(c2, c0) * inverseDet, 0.0f);
+        transform.normalMatrix[2] = glm::vec4(glm::cross(c0, c1) * inverseDet, 0.0f);
+    }
+#endif
+}
+
+
+void TransformBatch::clear()
+{
+    transforms.clear();
+    dirty.clear();
+    dirtyFlags.clear();
+    changed.clear();
+}
+
+
+int TransformBatch::add(const glm::mat4& model)
+{
+    ObjectTransform transform;
+    transform.model = model;
+    transforms.push_back(transform);
+    dirtyFlags.push_back(0);
+
+    int index = (int)transforms.size() - 1;
+    setModel(index, model);
+    return index;
+}
+
+
+void TransformBatch::setModel(int index, const glm::mat4& model)
+{
+    transforms[index].model = model;
+    if (dirtyFlags[index])
+        return;
+    dirtyFlags[index] = 1;
+    dirty.push_back(index);
+}
+
+
+int TransformBatch::update()
+{
+    int count = (int)dirty.size();
+    changed.clear();
+    if (count == 0)
+        return 0;
+
+    // in index order, so that neighbours merge into one run
+    std::sort(dirty.begin(), dirty.end());
+    for (int i = 0; i < count; ++i)
+    {
+        int index = dirty[i];
+        UComputeNormalMatrix(transforms[index]);
+        dirtyFlags[index] = 0;
+        if (!changed.empty() && changed.back().end == index)
+            ++changed.back().end;
+        else
+        {
+            Range range = { index, index + 1 };
+            changed.push_back(range);
+        }
+    }
+    dirty.clear();
+    return count;
+}
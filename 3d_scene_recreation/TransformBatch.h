@@ -0,0 +1,63 @@
+// Author: Joshua Gauthier
+// Cached model and normal matrices of the scene objects, recomputed only when an object moves
+
+#ifndef TRANSFORM_BATCH_H
+#define TRANSFORM_BATCH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// One entry of the TransformBuffer storage block (std430), read by every
+// vertex shader instead of the model matrix
+struct ObjectTransform
+{
+    glm::mat4 model;
+    glm::vec4 normalMatrix[3];      // columns of the inverse transpose of the model's 3x3 (a std430 mat3), w unused
+};
+
+// The transform of every object, cached in the layout of the storage buffer.
+// An object is dirty from add() or setModel() until the next update(), which
+// recomputes the normal matrices of the dirty objects only (three cross
+// products over the determinant, one object at a time with its xyz in SSE
+// lanes) and reports the runs of consecutive entries to upload. A static scene is computed and uploaded
+// once; the camera only changes the per-frame uniforms. The vertex shaders
+// no longer invert the model matrix for every vertex.
+//
+// usage: add() every object, update() and upload, then every frame update()
+// and upload the changed ranges when it returns more than 0
+class TransformBatch
+{
+public:
+    // entries [first, end) of one changed run
+    struct Range
+    {
+        int first;
+        int end;
+    };
+
+    TransformBatch() {}
+
+    void clear();
+    // returns the object's index, also its entry in the buffer
+    int add(const glm::mat4& model);
+    int size() const { return (int)transforms.size(); }
+    const glm::mat4& getModel(int index) const { return transforms[index].model; }
+    // moves an object; its entry is recomputed by the next update()
+    void setModel(int index, const glm::mat4& model);
+
+    // recomputes the dirty objects and returns how many there were
+    int update();
+    // runs of entries changed by the last update(), in order and never
+    // touching, so that static objects between moved ones are not uploaded
+    // again; empty when it returned 0
+    const std::vector<Range>& getChangedRanges() const { return changed; }
+    const ObjectTransform* getTransforms() const { return transforms.data(); }
+
+private:
+    std::vector<ObjectTransform> transforms;
+    std::vector<int> dirty;                 // objects to recompute, each once
+    std::vector<unsigned char> dirtyFlags;  // per object, 1 while listed in dirty
+    std::vector<Range> changed;
+};
+
+#endif
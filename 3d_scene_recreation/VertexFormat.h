@@ -0,0 +1,342 @@
+// Author: Joshua Gauthier
+// Vertex format descriptors: the interleaved layout the mesh generators write
+
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <cmath>
+#include <cstddef>      // offsetof
+#include <cstdint>
+#include <cstring>
+
+// Storage of one attribute component
+enum VertexAttributeType
+{
+    ATTRIBUTE_FLOAT,        // 32-bit float
+    ATTRIBUTE_HALF_FLOAT,   // 16-bit float
+    ATTRIBUTE_UNORM16,      // unsigned short read as [0,1]
+    ATTRIBUTE_SNORM16,      // signed short read as [-1,1]
+};
+
+// One attribute of an interleaved vertex, enough to set up glVertexAttribPointer
+struct VertexAttribute
+{
+    unsigned int location;      // shader attribute location
+    int components;
+    VertexAttributeType type;
+    bool normalized;            // integer types only: read as [0,1] / [-1,1]
+    unsigned int offset;        // bytes from the start of the vertex
+};
+
+// Per-mesh position decode: position = offset + scale * stored position.
+// Quantized formats store positions relative to the mesh bounds; float is the identity
+struct VertexDecode
+{
+    float offset[3];
+    float scale[3];
+};
+
+// A vertex format is a struct with
+//   Vertex                  - the interleaved vertex, sizeof(Vertex) is the stride
+//   ATTRIBUTE_COUNT         - # of entries in attributes
+//   attributes[]            - position (location 0), normal (1), texture coordinate (2);
+//                             a 2-component normal is octahedral-encoded
+//   positionDecode(min,max) - the VertexDecode of a mesh with these bounds
+//   write(vertex, decode, ...) - encode one full-precision vertex into Vertex
+//   read(vertex, decode, out)  - decode it back to x,y,z, nx,ny,nz, s,t (error reports)
+// BasicSphere, BasicCylinder and USphereRings are templated on it, so each vertex
+// is written once, straight into its final layout.
+
+
+
+/* ------------------- Component encoders -------------------*/
+// IEEE half from float, rounded to nearest even; overflow saturates to infinity
+inline uint16_t UFloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t magnitude = bits & 0x7fffffffu;
+
+    if (magnitude >= 0x7f800000u)                   // inf / nan
+        return (uint16_t)(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+    if (magnitude >= 0x47800000u)                   // too large for half
+        return (uint16_t)(sign | 0x7c00u);
+    if (magnitude < 0x38800000u)                    // subnormal half (or zero)
+    {
+        float f;
+        memcpy(&f, &magnitude, sizeof(f));
+        return (uint16_t)(sign | (uint32_t)lrintf(f * 16777216.0f));     // units of 2^-24
+    }
+
+    // normal: rebias the exponent and round the 13 dropped mantissa bits
+    uint32_t half = (magnitude - 0x38000000u) >> 13;
+    uint32_t rest = magnitude & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        ++half;
+    return (uint16_t)(sign | half);
+}
+
+inline float UHalfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    float magnitude;
+    if (exponent == 0)
+        magnitude = mantissa / 16777216.0f;         // subnormal: mantissa * 2^-24
+    else if (exponent == 31)
+        magnitude = mantissa ? NAN : INFINITY;
+    else
+        magnitude = ldexpf((float)(mantissa | 0x400u), (int)exponent - 25);
+    uint32_t bits;
+    memcpy(&bits, &magnitude, sizeof(bits));
+    bits |= sign;
+    memcpy(&magnitude, &bits, sizeof(bits));
+    return magnitude;
+}
+
+inline uint16_t UFloatToUnorm16(float value)
+{
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return (uint16_t)lrintf(value * 65535.0f);
+}
+
+inline int16_t UFloatToSnorm16(float value)
+{
+    value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    return (int16_t)lrintf(value * 32767.0f);
+}
+
+// same rule as GL for normalized signed integers
+inline float USnorm16ToFloat(int16_t value)
+{
+    float f = value / 32767.0f;
+    return f < -1.0f ? -1.0f : f;
+}
+
+// Octahedral normal: project onto |x|+|y|+|z| = 1 and fold the lower half over
+// the diagonals, giving 2 components in [-1,1]. The shader reverses it
+inline void UOctEncode(float nx, float ny, float nz, int16_t encoded[2])
+{
+    float l1 = fabsf(nx) + fabsf(ny) + fabsf(nz);
+    float u = 0.0f, v = 0.0f;
+    if (l1 > 0.0f)
+    {
+        u = nx / l1;
+        v = ny / l1;
+        if (nz < 0.0f)
+        {
+            float fu = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            float fv = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = fu;
+            v = fv;
+        }
+    }
+    encoded[0] = UFloatToSnorm16(u);
+    encoded[1] = UFloatToSnorm16(v);
+}
+
+inline void UOctDecode(const int16_t encoded[2], float normal[3])
+{
+    float u = USnorm16ToFloat(encoded[0]);
+    float v = USnorm16ToFloat(encoded[1]);
+    float z = 1.0f - fabsf(u) - fabsf(v);
+    if (z < 0.0f)
+    {
+        float fu = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float fv = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+    float lengthInv = 1.0f / sqrtf(u * u + v * v + z * z);
+    normal[0] = u * lengthInv;
+    normal[1] = v * lengthInv;
+    normal[2] = z * lengthInv;
+}
+
+
+
+/* ------------------- Formats -------------------*/
+// position, normal and texture coordinate as 32-bit floats: 8 floats, 32 bytes
+struct VertexP3N3T2
+{
+    struct Vertex
+    {
+        float position[3];
+        float normal[3];
+        float texCoord[2];
+    };
+
+    static const int ATTRIBUTE_COUNT = 3;
+    static constexpr VertexAttribute attributes[ATTRIBUTE_COUNT] = {
+        { 0, 3, ATTRIBUTE_FLOAT, false, offsetof(Vertex, position) },
+        { 1, 3, ATTRIBUTE_FLOAT, false, offsetof(Vertex, normal) },
+        { 2, 2, ATTRIBUTE_FLOAT, false, offsetof(Vertex, texCoord) },
+    };
+
+    static VertexDecode positionDecode(const float[3], const float[3])
+    {
+        return { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+    }
+
+    static void write(Vertex& vertex, const VertexDecode&, float x, float y, float z,
+        float nx, float ny, float nz, float s, float t)
+    {
+        vertex.position[0] = x;
+        vertex.position[1] = y;
+        vertex.position[2] = z;
+        vertex.normal[0] = nx;
+        vertex.normal[1] = ny;
+        vertex.normal[2] = nz;
+        vertex.texCoord[0] = s;
+        vertex.texCoord[1] = t;
+    }
+
+    static void read(const Vertex& vertex, const VertexDecode&, float out[8])
+    {
+        memcpy(out, &vertex, sizeof(Vertex));
+    }
+};
+
+// unorm16 position across the mesh bounds, octahedral snorm16 normal, unorm16
+// texture coordinate: 16 bytes. Position error is 1/131070 of the bounds' extent
+struct VertexUnorm16Oct
+{
+    struct Vertex
+    {
+        uint16_t position[4];       // xyz, w is padding for 4-byte alignment
+        int16_t normal[2];
+        uint16_t texCoord[2];
+    };
+
+    static const int ATTRIBUTE_COUNT = 3;
+    static constexpr VertexAttribute attributes[ATTRIBUTE_COUNT] = {
+        { 0, 3, ATTRIBUTE_UNORM16, true, offsetof(Vertex, position) },
+        { 1, 2, ATTRIBUTE_SNORM16, true, offsetof(Vertex, normal) },
+        { 2, 2, ATTRIBUTE_UNORM16, true, offsetof(Vertex, texCoord) },
+    };
+
+    // [0,1] spans the bounds; a flat axis keeps scale 1 so it still decodes exactly
+    static VertexDecode positionDecode(const float boundsMin[3], const float boundsMax[3])
+    {
+        VertexDecode decode;
+        for (int i = 0; i < 3; ++i)
+        {
+            float extent = boundsMax[i] - boundsMin[i];
+            decode.offset[i] = boundsMin[i];
+            decode.scale[i] = extent > 0.0f ? extent : 1.0f;
+        }
+        return decode;
+    }
+
+    static void write(Vertex& vertex, const VertexDecode& decode, float x, float y, float z,
+        float nx, float ny, float nz, float s, float t)
+    {
+        vertex.position[0] = UFloatToUnorm16((x - decode.offset[0]) / decode.scale[0]);
+        vertex.position[1] = UFloatToUnorm16((y - decode.offset[1]) / decode.scale[1]);
+        vertex.position[2] = UFloatToUnorm16((z - decode.offset[2]) / decode.scale[2]);
+        vertex.position[3] = 0;
+        UOctEncode(nx, ny, nz, vertex.normal);
+        vertex.texCoord[0] = UFloatToUnorm16(s);
+        vertex.texCoord[1] = UFloatToUnorm16(t);
+    }
+
+    static void read(const Vertex& vertex, const VertexDecode& decode, float out[8])
+    {
+        for (int i = 0; i < 3; ++i)
+            out[i] = decode.offset[i] + decode.scale[i] * (vertex.position[i] / 65535.0f);
+        UOctDecode(vertex.normal, out + 3);
+        out[6] = vertex.texCoord[0] / 65535.0f;
+        out[7] = vertex.texCoord[1] / 65535.0f;
+    }
+};
+
+// half-float position across the bounds ([-1,1] around their center), octahedral
+// snorm16 normal, unorm16 texture coordinate: 16 bytes. Finer than unorm16 near
+// the center, coarser (up to 1/8192 of the extent) near the bounds
+struct VertexHalfOct
+{
+    struct Vertex
+    {
+        uint16_t position[4];       // xyz halfs, w is padding for 4-byte alignment
+        int16_t normal[2];
+        uint16_t texCoord[2];
+    };
+
+    static const int ATTRIBUTE_COUNT = 3;
+    static constexpr VertexAttribute attributes[ATTRIBUTE_COUNT] = {
+        { 0, 3, ATTRIBUTE_HALF_FLOAT, false, offsetof(Vertex, position) },
+        { 1, 2, ATTRIBUTE_SNORM16, true, offsetof(Vertex, normal) },
+        { 2, 2, ATTRIBUTE_UNORM16, true, offsetof(Vertex, texCoord) },
+    };
+
+    static VertexDecode positionDecode(const float boundsMin[3], const float boundsMax[3])
+    {
+        VertexDecode decode;
+        for (int i = 0; i < 3; ++i)
+        {
+            float halfExtent = 0.5f * (boundsMax[i] - boundsMin[i]);
+            decode.offset[i] = 0.5f * (boundsMin[i] + boundsMax[i]);
+            decode.scale[i] = halfExtent > 0.0f ? halfExtent : 1.0f;
+        }
+        return decode;
+    }
+
+    static void write(Vertex& vertex, const VertexDecode& decode, float x, float y, float z,
+        float nx, float ny, float nz, float s, float t)
+    {
+        vertex.position[0] = UFloatToHalf((x - decode.offset[0]) / decode.scale[0]);
+        vertex.position[1] = UFloatToHalf((y - decode.offset[1]) / decode.scale[1]);
+        vertex.position[2] = UFloatToHalf((z - decode.offset[2]) / decode.scale[2]);
+        vertex.position[3] = 0;
+        UOctEncode(nx, ny, nz, vertex.normal);
+        vertex.texCoord[0] = UFloatToUnorm16(s);
+        vertex.texCoord[1] = UFloatToUnorm16(t);
+    }
+
+    static void read(const Vertex& vertex, const VertexDecode& decode, float out[8])
+    {
+        for (int i = 0; i < 3; ++i)
+            out[i] = decode.offset[i] + decode.scale[i] * UHalfToFloat(vertex.position[i]);
+        UOctDecode(vertex.normal, out + 3);
+        out[6] = vertex.texCoord[0] / 65535.0f;
+        out[7] = vertex.texCoord[1] / 65535.0f;
+    }
+};
+
+
+
+/* ------------------- Runtime view of a format -------------------*/
+// For code that picks the format at runtime (GeometryArena): the attribute table
+// plus type-erased encode/decode of one vertex from/to x,y,z, nx,ny,nz, s,t
+struct VertexCodec
+{
+    const char* name;
+    unsigned int stride;
+    int attributeCount;
+    const VertexAttribute* attributes;
+    VertexDecode (*positionDecode)(const float boundsMin[3], const float boundsMax[3]);
+    void (*encode)(void* vertex, const VertexDecode& decode, const float full[8]);
+    void (*decode)(const void* vertex, const VertexDecode& decode, float full[8]);
+};
+
+template <class Format>
+constexpr VertexCodec UGetVertexCodec(const char* name)
+{
+    struct Erased
+    {
+        static void encode(void* vertex, const VertexDecode& decode, const float v[8])
+        {
+            Format::write(*(typename Format::Vertex*)vertex, decode, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+        }
+        static void decode(const void* vertex, const VertexDecode& decode, float v[8])
+        {
+            Format::read(*(const typename Format::Vertex*)vertex, decode, v);
+        }
+    };
+    return { name, (unsigned int)sizeof(typename Format::Vertex), Format::ATTRIBUTE_COUNT, Format::attributes,
+        &Format::positionDecode, &Erased::encode, &Erased::decode };
+}
+
+#endif